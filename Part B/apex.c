@@ -0,0 +1,312 @@
+/*
+ *  apex.c
+ *  Contains the embedding API of the APEX simulator. Every APEX_Sim owns a
+ *  cpu and a copy of it taken right after creation, so a reset is a copy
+ *  and never parses the program again. Pipeline events reach the user
+ *  callbacks through the cpu event hook.
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex.h"
+#include "cpu.h"
+#include "config.h"
+#include "lsq.h"
+#include "vector.h"
+#include "history.h"
+
+struct APEX_Sim
+{
+  APEX_CPU* cpu;
+  APEX_CPU initial;		    // State right after creation
+  APEX_Callbacks callbacks;
+  void* user;
+  int halted;
+  APEX_History* history;	    // Execution history, NULL when off
+};
+
+/*
+ * Translates a pipeline event for the user callbacks.
+ */
+static void event_hook(APEX_CPU* cpu, int event, CPU_Stage* stage)
+{
+  APEX_Sim* sim = cpu->event_data;
+  if (stage->pc == 0 || compare_opcode(stage->opcode, "NOP")) {
+    return;
+  }
+  if (event == APEX_EVENT_COMMIT && sim->callbacks.commit) {
+    int op = get_opcode_id(stage->opcode);
+    bool writes = op != OP_STORE && op != OP_STR && op != OP_BZ && op != OP_BNZ && op != OP_JUMP && !is_vector_opcode(op);
+    sim->callbacks.commit(sim->user, stage->pc, stage->opcode, writes ? stage->rd : -1, writes ? stage->buffer : 0);
+  }
+  else if (event == APEX_EVENT_STALL && sim->callbacks.stall) {
+    int index = 0;
+    while (index < cpu->num_stages - 1 && &cpu->stage[index] != stage) {
+      index++;
+    }
+    sim->callbacks.stall(sim->user, stage->pc, index);
+  }
+  else if (event == APEX_EVENT_FLUSH && sim->callbacks.flush) {
+    sim->callbacks.flush(sim->user, stage->pc, cpu->pc);
+  }
+}
+
+static APEX_Sim* create(APEX_Instruction* code_memory, int size)
+{
+  if (!code_memory) {
+    return NULL;
+  }
+  APEX_Sim* sim = calloc(1, sizeof(*sim));
+  if (!sim) {
+    free(code_memory);
+    return NULL;
+  }
+
+  sim->cpu = APEX_cpu_init_code(code_memory, size);
+  if (!sim->cpu) {
+    free(sim);
+    return NULL;
+  }
+  sim->cpu->quiet = 1;
+  sim->cpu->event_hook = event_hook;
+  sim->cpu->event_data = sim;
+  sim->initial = *sim->cpu;
+  return sim;
+}
+
+APEX_Sim* APEX_sim_create_file(const char* filename)
+{
+  int size;
+  if (!filename) {
+    return NULL;
+  }
+  APEX_Instruction* code_memory = create_code_memory(filename, &size);
+  return create(code_memory, size);
+}
+
+APEX_Sim* APEX_sim_create_buffer(const char* text, size_t length)
+{
+  int size;
+  APEX_Instruction* code_memory = create_code_memory_from_buffer(text, length, &size);
+  return create(code_memory, size);
+}
+
+void APEX_sim_destroy(APEX_Sim* sim)
+{
+  if (sim) {
+    APEX_cpu_stop(sim->cpu);
+    history_free(sim->history);
+    free(sim);
+  }
+}
+
+void APEX_sim_reset(APEX_Sim* sim)
+{
+  *sim->cpu = sim->initial;
+  sim->halted = 0;
+  if (sim->history) {
+    history_reset(sim->history, sim->cpu);
+  }
+}
+
+/*
+ * Makes the current state the one a reset goes back to.
+ */
+static void set_initial(APEX_Sim* sim)
+{
+  sim->initial = *sim->cpu;
+  if (sim->history) {
+    history_reset(sim->history, sim->cpu);
+  }
+}
+
+int APEX_sim_configure(APEX_Sim* sim, const char* config_file)
+{
+  APEX_sim_reset(sim);
+  if (APEX_config_load(sim->cpu, config_file)) {
+    APEX_sim_reset(sim);
+    return 1;
+  }
+  set_initial(sim);
+  return 0;
+}
+
+int APEX_sim_set_lsq(APEX_Sim* sim, int entries)
+{
+  if (entries < 0 || entries > MAX_STORE_BUFFER) {
+    return 1;
+  }
+  APEX_sim_reset(sim);
+  sim->cpu->lsq_size = entries;
+  set_initial(sim);
+  return 0;
+}
+
+int APEX_sim_set_fusion(APEX_Sim* sim, int enabled)
+{
+  APEX_sim_reset(sim);
+  sim->cpu->fusion = enabled != 0;
+  set_initial(sim);
+  return 0;
+}
+
+int APEX_sim_step(APEX_Sim* sim, int cycles)
+{
+  int i;
+  for (i = 0; i < cycles && !sim->halted; ++i) {
+    sim->halted = APEX_cpu_cycle(sim->cpu);
+    if (sim->history) {
+      history_record(sim->history, sim->cpu, sim->halted);
+    }
+  }
+  return i;
+}
+
+int APEX_sim_run(APEX_Sim* sim, int max_cycles)
+{
+  APEX_sim_step(sim, max_cycles);
+  return sim->halted;
+}
+
+int APEX_sim_halted(const APEX_Sim* sim)
+{
+  return sim->halted;
+}
+
+int APEX_sim_set_history(APEX_Sim* sim, int megabytes)
+{
+  if (megabytes < 0) {
+    return 1;
+  }
+  APEX_sim_reset(sim);
+  history_free(sim->history);
+  sim->history = NULL;
+  if (megabytes > 0) {
+    sim->history = history_create(sim->cpu, (size_t)megabytes << 20);
+    if (!sim->history) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/*
+ * Goes to step of the history, the state after that many cycles.
+ */
+static int seek(APEX_Sim* sim, long step)
+{
+  APEX_History* history = sim->history;
+  history_seek(history, sim->cpu, step);
+  sim->halted = history->done && history->step == history->newest;
+  return history->start_clock + history->step;
+}
+
+int APEX_sim_step_back(APEX_Sim* sim, int cycles)
+{
+  if (!sim->history || cycles < 0) {
+    return 0;
+  }
+  long step = sim->history->step;
+  seek(sim, step - cycles);
+  return step - sim->history->step;
+}
+
+int APEX_sim_goto(APEX_Sim* sim, int cycle)
+{
+  if (!sim->history) {
+    return -1;
+  }
+  return seek(sim, cycle - sim->history->start_clock);
+}
+
+int APEX_sim_history_start(const APEX_Sim* sim)
+{
+  if (!sim->history) {
+    return -1;
+  }
+  return sim->history->start_clock + sim->history->oldest;
+}
+
+void APEX_sim_set_callbacks(APEX_Sim* sim, const APEX_Callbacks* callbacks, void* user)
+{
+  if (callbacks) {
+    sim->callbacks = *callbacks;
+  }
+  else {
+    memset(&sim->callbacks, 0, sizeof(sim->callbacks));
+  }
+  sim->user = user;
+}
+
+int APEX_sim_get_register(const APEX_Sim* sim, int reg)
+{
+  if (reg < 0 || reg >= 32) {
+    return 0;
+  }
+  return sim->cpu->commit_regs[reg];
+}
+
+void APEX_sim_set_register(APEX_Sim* sim, int reg, int value)
+{
+  if (reg < 0 || reg >= 32) {
+    return;
+  }
+  sim->cpu->regs[reg] = value;
+  sim->cpu->dup_regs[reg] = value;
+  sim->cpu->commit_regs[reg] = value;
+}
+
+int APEX_sim_get_vector(const APEX_Sim* sim, int reg, int lane)
+{
+  if (reg < 0 || reg >= NUM_VREGS || lane < 0 || lane >= VECTOR_LANES) {
+    return 0;
+  }
+  return sim->cpu->vregs[reg][lane];
+}
+
+int APEX_sim_read_memory(const APEX_Sim* sim, int address)
+{
+  APEX_CPU* cpu = sim->cpu;
+  if (address < 0 || address >= 4096) {
+    return 0;
+  }
+  /* The youngest buffered store to the address holds its value */
+  for (int i = cpu->sb_count - 1; i >= 0; --i) {
+    Store_Buffer_Entry* entry = &cpu->store_buffer[(cpu->sb_head + i) % MAX_STORE_BUFFER];
+    if (entry->address == address) {
+      return entry->value;
+    }
+  }
+  return cpu->data_memory[address];
+}
+
+void APEX_sim_write_memory(APEX_Sim* sim, int address, int value)
+{
+  if (address < 0 || address >= 4096) {
+    return;
+  }
+  /* Older buffered stores must not overwrite the new value */
+  lsq_flush(sim->cpu);
+  sim->cpu->data_memory[address] = value;
+}
+
+int APEX_sim_pc(const APEX_Sim* sim)
+{
+  return sim->cpu->pc;
+}
+
+int APEX_sim_cycles(const APEX_Sim* sim)
+{
+  /* The cycle that completes the program does not advance the clock */
+  return sim->cpu->clock + sim->halted;
+}
+
+int APEX_sim_retired(const APEX_Sim* sim)
+{
+  return sim->cpu->ins_retired;
+}
@@ -0,0 +1,97 @@
+#ifndef _APEX_H_
+#define _APEX_H_
+/**
+ *  apex.h
+ *  Contains the embedding API of the APEX simulator (libapex). A program
+ *  links libapex.a or libapex.so and drives any number of independent
+ *  simulations through opaque APEX_Sim handles. The library does not print
+ *  the pipeline (only configuration errors go to stderr); it is observed
+ *  through the accessors and callbacks.
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stddef.h>
+
+#define APEX_API_VERSION 1
+
+typedef struct APEX_Sim APEX_Sim;
+
+/* Optional callbacks, any of them may be NULL */
+typedef struct APEX_Callbacks
+{
+  /* Instruction retired; rd is -1 if it writes no integer register */
+  void (*commit)(void* user, int pc, const char* opcode, int rd, int value);
+  /* Instruction at pc held in stage this cycle (1 is DRF, 2 is EX1, ...) */
+  void (*stall)(void* user, int pc, int stage);
+  /* Taken branch at pc redirected fetch to target */
+  void (*flush)(void* user, int pc, int target);
+} APEX_Callbacks;
+
+/* Creating and destroying simulations, NULL on a parse or memory error */
+APEX_Sim* APEX_sim_create_file(const char* filename);
+
+APEX_Sim* APEX_sim_create_buffer(const char* text, size_t length);
+
+void APEX_sim_destroy(APEX_Sim* sim);
+
+/* Pipeline shape and load/store queue, 0 on success. Both reset the sim */
+int APEX_sim_configure(APEX_Sim* sim, const char* config_file);
+
+int APEX_sim_set_lsq(APEX_Sim* sim, int entries);
+
+/* Macro-op fusion in decode, on when enabled is non-zero. Resets the sim */
+int APEX_sim_set_fusion(APEX_Sim* sim, int enabled);
+
+/* Back to the state right after creation, without parsing again */
+void APEX_sim_reset(APEX_Sim* sim);
+
+/* Simulates up to cycles clock cycles, returns the cycles simulated */
+int APEX_sim_step(APEX_Sim* sim, int cycles);
+
+/* Simulates until the program halts or max_cycles pass.
+ * Returns 1 if it halted, 0 otherwise */
+int APEX_sim_run(APEX_Sim* sim, int max_cycles);
+
+int APEX_sim_halted(const APEX_Sim* sim);
+
+/* Execution history: the state changes of the most recent cycles kept in
+ * about megabytes MB, so that the sim can go back to any of them; 0 turns
+ * it off. Resets the sim, 0 on success */
+int APEX_sim_set_history(APEX_Sim* sim, int megabytes);
+
+/* Goes back up to cycles cycles, returns the cycles gone back. Stepping
+ * from there simulates again and drops the cycles that were ahead */
+int APEX_sim_step_back(APEX_Sim* sim, int cycles);
+
+/* Goes back or forward to cycle, as APEX_sim_cycles() counts them, within
+ * the cycles kept. Returns the cycle reached, -1 without history */
+int APEX_sim_goto(APEX_Sim* sim, int cycle);
+
+/* Oldest cycle the sim can go back to, -1 without history */
+int APEX_sim_history_start(const APEX_Sim* sim);
+
+void APEX_sim_set_callbacks(APEX_Sim* sim, const APEX_Callbacks* callbacks, void* user);
+
+/* State accessors: registers as written by retired instructions, and
+ * data memory words 0..4095. Memory reads see stores still in the store
+ * buffer */
+int APEX_sim_get_register(const APEX_Sim* sim, int reg);
+
+void APEX_sim_set_register(APEX_Sim* sim, int reg, int value);
+
+/* Lane 0..3 of vector register V0..V7 as written by retired instructions */
+int APEX_sim_get_vector(const APEX_Sim* sim, int reg, int lane);
+
+int APEX_sim_read_memory(const APEX_Sim* sim, int address);
+
+void APEX_sim_write_memory(APEX_Sim* sim, int address, int value);
+
+int APEX_sim_pc(const APEX_Sim* sim);
+
+int APEX_sim_cycles(const APEX_Sim* sim);
+
+int APEX_sim_retired(const APEX_Sim* sim);
+
+#endif
@@ -0,0 +1,279 @@
+/*
+ *  cache.c
+ *  Contains the on-disk result cache. The key hashes everything a run
+ *  depends on: the decoded code memory, the initial registers and data
+ *  memory, the pipeline variant and shape, the store buffer size and the
+ *  cycle budget. A result is stored as <dir>/<key>.res.
+ *
+ *  Results are written to a temporary file and renamed into place, so a
+ *  reader never sees a partial result. A hit touches the file; a store
+ *  evicts the least recently touched results once the directory is over
+ *  its size limit.
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+
+/* Pipeline variant of this simulator: Part B, forwarding */
+static const char variant[] = "APEX Part B forwarding";
+
+/* Two FNV-1a streams with different offsets give a 128-bit key */
+typedef struct Key_Hash
+{
+  uint64_t h[2];
+} Key_Hash;
+
+static void hash_bytes(Key_Hash* key, const void* data, size_t length)
+{
+  const unsigned char* p = data;
+  for (size_t i = 0; i < length; ++i) {
+    key->h[0] = (key->h[0] ^ p[i]) * 1099511628211ULL;
+    key->h[1] = (key->h[1] ^ p[i]) * 1099511628211ULL;
+  }
+}
+
+static void hash_int(Key_Hash* key, int value)
+{
+  hash_bytes(key, &value, sizeof(value));
+}
+
+static void compute_key(APEX_CPU* cpu, int cycles, uint64_t out[2])
+{
+  Key_Hash key = { { 14695981039346656037ULL, 0x6c62272e07bb0142ULL } };
+
+  hash_int(&key, APEX_CACHE_VERSION);
+  hash_bytes(&key, variant, sizeof(variant));
+
+  /* Decoded code memory, field by field */
+  hash_int(&key, cpu->code_memory_size);
+  for (int i = 0; i < cpu->code_memory_size; ++i) {
+    APEX_Instruction* ins = &cpu->code_memory[i];
+    hash_bytes(&key, ins->opcode, strlen(ins->opcode) + 1);
+    hash_int(&key, ins->rd);
+    hash_int(&key, ins->rs1);
+    hash_int(&key, ins->rs2);
+    hash_int(&key, ins->rs3);
+    hash_int(&key, ins->imm);
+  }
+
+  /* Initial architectural state */
+  hash_int(&key, cpu->pc);
+  hash_bytes(&key, cpu->regs, sizeof(cpu->regs));
+  hash_bytes(&key, cpu->data_memory, sizeof(cpu->data_memory));
+
+  /* Pipeline shape and run parameters */
+  hash_int(&key, cpu->num_stages);
+  hash_int(&key, cpu->mem1);
+  hash_int(&key, cpu->wb);
+  hash_int(&key, cpu->branch_stage);
+  hash_int(&key, cpu->branch_stall);
+  hash_bytes(&key, cpu->forward, sizeof(cpu->forward));
+  hash_bytes(&key, cpu->latency, sizeof(cpu->latency));
+  hash_int(&key, cpu->lsq_size);
+  hash_int(&key, cpu->store_latency);
+  hash_int(&key, cpu->loop_buffer_size);
+  hash_int(&key, cycles);
+
+  out[0] = key.h[0];
+  out[1] = key.h[1];
+}
+
+static void result_path(const char* dir, const uint64_t key[2], char* path, size_t size)
+{
+  snprintf(path, size, "%s/%016llx%016llx.res", dir, (unsigned long long)key[0], (unsigned long long)key[1]);
+}
+
+/*
+ * Restores a cached result into cpu. Returns 1 on a hit.
+ */
+static int lookup(const char* path, const uint64_t key[2], APEX_CPU* cpu, int* completed)
+{
+  FILE* fp = fopen(path, "rb");
+  if (!fp) {
+    return 0;
+  }
+  APEX_Cache_Record record;
+  int hit = fread(&record, sizeof(record), 1, fp) == 1 && record.magic == APEX_CACHE_MAGIC && record.version == APEX_CACHE_VERSION && record.key[0] == key[0] && record.key[1] == key[1] && record.memory_words <= 4096;
+
+  int32_t words[2 * 4096];
+  if (hit) {
+    hit = fread(words, 2 * sizeof(int32_t), record.memory_words, fp) == record.memory_words;
+  }
+  fclose(fp);
+  if (!hit) {
+    return 0;
+  }
+
+  *completed = record.completed;
+  cpu->clock = record.clock;
+  cpu->ins_completed = record.ins_completed;
+  cpu->ins_retired = record.ins_retired;
+  cpu->lsq_stores = record.lsq_stores;
+  cpu->lsq_loads = record.lsq_loads;
+  cpu->lsq_forwards = record.lsq_forwards;
+  cpu->lsq_drains = record.lsq_drains;
+  cpu->lsq_full_stalls = record.lsq_full_stalls;
+  cpu->lsq_port_stalls = record.lsq_port_stalls;
+  cpu->loop_hits = record.loop_hits;
+  cpu->loop_redirects = record.loop_redirects;
+  cpu->loop_mispredicts = record.loop_mispredicts;
+  cpu->loops_retired = record.loops_retired;
+  cpu->vector_ops = record.vector_ops;
+  cpu->vector_loads = record.vector_loads;
+  cpu->vector_stores = record.vector_stores;
+  memcpy(cpu->regs, record.regs, sizeof(cpu->regs));
+  memcpy(cpu->regs_valid, record.regs_valid, sizeof(cpu->regs_valid));
+  memcpy(cpu->commit_regs, record.commit_regs, sizeof(cpu->commit_regs));
+  memcpy(cpu->vregs, record.vregs, sizeof(cpu->vregs));
+  memset(cpu->data_memory, 0, sizeof(cpu->data_memory));
+  for (uint32_t i = 0; i < record.memory_words; ++i) {
+    if (words[2 * i] >= 0 && words[2 * i] < 4096) {
+      cpu->data_memory[words[2 * i]] = words[2 * i + 1];
+    }
+  }
+
+  /* Most recently used */
+  utime(path, NULL);
+  return 1;
+}
+
+/*
+ * Removes the least recently used results until dir fits in limit bytes.
+ */
+static void evict(const char* dir, long limit)
+{
+  for (;;) {
+    DIR* d = opendir(dir);
+    if (!d) {
+      return;
+    }
+    long total = 0;
+    time_t oldest_time = 0;
+    char oldest[1024] = "";
+    struct dirent* ent;
+    while ((ent = readdir(d))) {
+      size_t n = strlen(ent->d_name);
+      if (n < 4 || strcmp(ent->d_name + n - 4, ".res")) {
+        continue;
+      }
+      char path[1024];
+      struct stat st;
+      snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+      if (stat(path, &st)) {
+        continue;
+      }
+      total += st.st_size;
+      if (!oldest[0] || st.st_mtime < oldest_time) {
+        oldest_time = st.st_mtime;
+        strcpy(oldest, path);
+      }
+    }
+    closedir(d);
+    if (total <= limit || !oldest[0]) {
+      return;
+    }
+    unlink(oldest);
+  }
+}
+
+static void store(const char* dir, const char* path, const uint64_t key[2], APEX_Cache_Record* record, int32_t* words, long limit)
+{
+  char tmp[1100];
+  snprintf(tmp, sizeof(tmp), "%s/.tmp.%ld.%016llx", dir, (long)getpid(), (unsigned long long)key[0]);
+  FILE* fp = fopen(tmp, "wb");
+  if (!fp) {
+    return;
+  }
+  int ok = fwrite(record, sizeof(*record), 1, fp) == 1 && fwrite(words, 2 * sizeof(int32_t), record->memory_words, fp) == record->memory_words;
+  ok = (fclose(fp) == 0) && ok;
+  if (!ok || rename(tmp, path)) {
+    unlink(tmp);
+    return;
+  }
+  evict(dir, limit);
+}
+
+/*
+ * Runs the quiet simulation through the cache: a hit restores the final
+ * state without simulating, a miss simulates and stores the result. Flush
+ * and halt notices are not printed either way, so a hit and a miss print
+ * the same output.
+ */
+int APEX_cache_run(APEX_CPU* cpu, int cycles, const char* dir, long limit_bytes)
+{
+  uint64_t key[2];
+  char path[1024];
+  int completed;
+
+  compute_key(cpu, cycles, key);
+  result_path(dir, key, path, sizeof(path));
+
+  if (lookup(path, key, cpu, &completed)) {
+    if (completed) {
+      printf("(apex) >> Simulation Complete\n");
+    }
+    APEX_cpu_print_state(cpu);
+    return 1;
+  }
+
+  cpu->quiet = 1;
+  completed = APEX_cpu_simulate(cpu, cycles, 0);
+  if (completed) {
+    printf("(apex) >> Simulation Complete\n");
+  }
+
+  APEX_Cache_Record record;
+  int32_t words[2 * 4096];
+  memset(&record, 0, sizeof(record));
+  record.magic = APEX_CACHE_MAGIC;
+  record.version = APEX_CACHE_VERSION;
+  record.key[0] = key[0];
+  record.key[1] = key[1];
+  record.completed = completed;
+  record.clock = cpu->clock;
+  record.ins_completed = cpu->ins_completed;
+  record.ins_retired = cpu->ins_retired;
+  record.lsq_stores = cpu->lsq_stores;
+  record.lsq_loads = cpu->lsq_loads;
+  record.lsq_forwards = cpu->lsq_forwards;
+  record.lsq_drains = cpu->lsq_drains;
+  record.lsq_full_stalls = cpu->lsq_full_stalls;
+  record.lsq_port_stalls = cpu->lsq_port_stalls;
+  record.loop_hits = cpu->loop_hits;
+  record.loop_redirects = cpu->loop_redirects;
+  record.loop_mispredicts = cpu->loop_mispredicts;
+  record.loops_retired = cpu->loops_retired;
+  record.vector_ops = cpu->vector_ops;
+  record.vector_loads = cpu->vector_loads;
+  record.vector_stores = cpu->vector_stores;
+  memcpy(record.regs, cpu->regs, sizeof(record.regs));
+  memcpy(record.regs_valid, cpu->regs_valid, sizeof(record.regs_valid));
+  memcpy(record.commit_regs, cpu->commit_regs, sizeof(record.commit_regs));
+  memcpy(record.vregs, cpu->vregs, sizeof(record.vregs));
+  for (int i = 0; i < 4096; ++i) {
+    if (cpu->data_memory[i]) {
+      words[2 * record.memory_words] = i;
+      words[2 * record.memory_words + 1] = cpu->data_memory[i];
+      record.memory_words++;
+    }
+  }
+
+  APEX_cpu_print_state(cpu);
+
+  if (mkdir(dir, 0777) && errno != EEXIST) {
+    return 0;
+  }
+  store(dir, path, key, &record, words, limit_bytes);
+  return 0;
+}
@@ -0,0 +1,51 @@
+#ifndef _APEX_CACHE_H_
+#define _APEX_CACHE_H_
+/**
+ *  cache.h
+ *  Contains the on-disk result cache: final state and statistics of a run,
+ *  stored under a hash of everything the run depends on
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdint.h>
+#include "cpu.h"
+
+/* Bump whenever a change to the simulator changes results */
+#define APEX_CACHE_VERSION 6
+#define APEX_CACHE_MAGIC 0x43585041	    // "APXC"
+
+/* Header of a cached result, followed by memory_words (address, value) pairs */
+typedef struct APEX_Cache_Record
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t key[2];
+  int32_t completed;
+  int32_t clock;
+  int32_t ins_completed;
+  int32_t ins_retired;
+  int32_t lsq_stores;
+  int32_t lsq_loads;
+  int32_t lsq_forwards;
+  int32_t lsq_drains;
+  int32_t lsq_full_stalls;
+  int32_t lsq_port_stalls;
+  int32_t loop_hits;
+  int32_t loop_redirects;
+  int32_t loop_mispredicts;
+  int32_t loops_retired;
+  int32_t vector_ops;
+  int32_t vector_loads;
+  int32_t vector_stores;
+  int32_t regs[32];
+  int32_t regs_valid[32];
+  int32_t commit_regs[32];
+  int32_t vregs[NUM_VREGS][VECTOR_LANES];
+  uint32_t memory_words;
+} APEX_Cache_Record;
+
+int APEX_cache_run(APEX_CPU* cpu, int cycles, const char* dir, long limit_bytes);
+
+#endif
@@ -0,0 +1,306 @@
+/*
+ *  config.c
+ *  Contains the pipeline configuration loader. A configuration file sets
+ *  the shape of the pipeline, one "key = value" per line:
+ *
+ *    execute_stages = 2      # EX1..EXn
+ *    memory_stages = 2       # MEM1..MEMn
+ *    branch_stage = 2        # EXk that resolves BZ/BNZ/JUMP, 0 for DRF
+ *    branch_stall = 1        # Cycles BZ/BNZ wait after the flag producer's EX1
+ *    forward = EX2 MEM2      # Stages whose results are forwarded
+ *    latency MUL = 3         # Cycles an opcode spends in EX1
+ *    loop_buffer = 16        # Instructions of a LOOP body fetch buffers, 0 for none
+ *    store_latency = 4       # Cycles a drained store holds the memory port (--lsq)
+ *    dram = open             # DRAM row buffer policy, open or closed; off for
+ *                            # single-cycle data memory
+ *    dram_channels = 1       # Channels, dram_banks = 8 banks each
+ *    dram_row = 64           # Words in a row
+ *    dram_tRCD = 5           # Activate, column and precharge timing
+ *    dram_tCAS = 5
+ *    dram_tRP = 5
+ *    dram_queue = 8          # Requests the memory controller queues
+ *
+ *  Lines starting with '#' are comments. The defaults describe the
+ *  Part B pipeline: F, DRF, EX1, EX2, MEM1, MEM2, WB.
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "config.h"
+#include "dram.h"
+
+/*
+ * Lays out the stages for the given number of execute and memory stages.
+ */
+static void set_layout(APEX_CPU* cpu, int execute_stages, int memory_stages)
+{
+  cpu->mem1 = EX1 + execute_stages;
+  cpu->wb = cpu->mem1 + memory_stages;
+  cpu->num_stages = cpu->wb + 1;
+}
+
+void APEX_config_default(APEX_CPU* cpu)
+{
+  set_layout(cpu, 2, 2);
+  cpu->branch_stage = EX1 + 1;
+  cpu->branch_stall = 1;
+  memset(cpu->forward, 0, sizeof(cpu->forward));
+  cpu->forward[EX1 + 1] = 1;
+  cpu->forward[cpu->mem1 + 1] = 1;
+  for (int i = 0; i < NUM_OPCODES; ++i) {
+    cpu->latency[i] = 1;
+  }
+  cpu->loop_buffer_size = 16;
+  cpu->store_latency = 4;
+  dram_default(&cpu->dram);
+}
+
+static char* trim(char* str)
+{
+  while (isspace((unsigned char)*str)) {
+    str++;
+  }
+  char* end = str + strlen(str);
+  while (end > str && isspace((unsigned char)end[-1])) {
+    *--end = '\0';
+  }
+  return str;
+}
+
+/*
+ * Converts a stage name (EXn or MEMn) into a stage index, -1 if invalid.
+ */
+static int parse_stage(APEX_CPU* cpu, int execute_stages, int memory_stages, const char* name)
+{
+  int n;
+  if (sscanf(name, "EX%d", &n) == 1 && n >= 1 && n <= execute_stages) {
+    return EX1 + n - 1;
+  }
+  if (sscanf(name, "MEM%d", &n) == 1 && n >= 1 && n <= memory_stages) {
+    return EX1 + execute_stages + n - 1;
+  }
+  return -1;
+}
+
+/*
+ * Reads a pipeline configuration from a stream, filename names it in
+ * error messages. Returns 0 on success; on error the cpu keeps its
+ * previous configuration.
+ */
+static int load_stream(APEX_CPU* cpu, FILE* fp, const char* filename)
+{
+  int execute_stages = 2, memory_stages = 2, branch_stage = 2, branch_stall = 1, loop_buffer = 16, store_latency = 4;
+  int latency[NUM_OPCODES];
+  char forward_list[256] = "EX2 MEM2";
+  DRAM_Model dram;
+  dram_default(&dram);
+  int dram_channels = 1;
+  for (int i = 0; i < NUM_OPCODES; ++i) {
+    latency[i] = 1;
+  }
+
+  char line[256];
+  int line_num = 0, error = 0;
+  while (!error && fgets(line, sizeof(line), fp)) {
+    line_num++;
+    char* hash = strchr(line, '#');
+    if (hash) {
+      *hash = '\0';
+    }
+    char* eq = strchr(line, '=');
+    char* key = trim(line);
+    if (*key == '\0') {
+      continue;
+    }
+    if (!eq) {
+      error = 1;
+      break;
+    }
+    *eq = '\0';
+    key = trim(key);
+    char* value = trim(eq + 1);
+    char opcode[32];
+
+    if (strcmp(key, "execute_stages") == 0) {
+      execute_stages = atoi(value);
+    }
+    else if (strcmp(key, "memory_stages") == 0) {
+      memory_stages = atoi(value);
+    }
+    else if (strcmp(key, "branch_stage") == 0) {
+      branch_stage = atoi(value);
+    }
+    else if (strcmp(key, "branch_stall") == 0) {
+      branch_stall = atoi(value);
+    }
+    else if (strcmp(key, "loop_buffer") == 0) {
+      loop_buffer = atoi(value);
+    }
+    else if (strcmp(key, "store_latency") == 0) {
+      store_latency = atoi(value);
+    }
+    else if (strcmp(key, "dram") == 0) {
+      if (strcmp(value, "off") == 0) {
+        dram.channels = 0;
+      }
+      else if (strcmp(value, "open") == 0 || strcmp(value, "closed") == 0) {
+        dram.channels = 1;
+        dram.closed_page = strcmp(value, "closed") == 0;
+      }
+      else {
+        error = 1;
+      }
+    }
+    else if (strcmp(key, "dram_channels") == 0) {
+      dram_channels = atoi(value);
+    }
+    else if (strcmp(key, "dram_banks") == 0) {
+      dram.banks = atoi(value);
+    }
+    else if (strcmp(key, "dram_row") == 0) {
+      dram.row_words = atoi(value);
+    }
+    else if (strcmp(key, "dram_tRCD") == 0) {
+      dram.tRCD = atoi(value);
+    }
+    else if (strcmp(key, "dram_tCAS") == 0) {
+      dram.tCAS = atoi(value);
+    }
+    else if (strcmp(key, "dram_tRP") == 0) {
+      dram.tRP = atoi(value);
+    }
+    else if (strcmp(key, "dram_queue") == 0) {
+      dram.queue_size = atoi(value);
+    }
+    else if (strcmp(key, "forward") == 0) {
+      strncpy(forward_list, value, sizeof(forward_list) - 1);
+      forward_list[sizeof(forward_list) - 1] = '\0';
+    }
+    else if (sscanf(key, "latency %31s", opcode) == 1) {
+      int id = get_opcode_id(opcode);
+      if (id == OP_NOP || atoi(value) < 1) {
+        error = 1;
+      }
+      else {
+        latency[id] = atoi(value);
+      }
+    }
+    else {
+      error = 1;
+    }
+  }
+
+  if (error) {
+    fprintf(stderr, "APEX_Error : %s:%d: invalid configuration line\n", filename, line_num);
+    return -1;
+  }
+  if (execute_stages < 1 || memory_stages < 1 || EX1 + execute_stages + memory_stages + 1 > MAX_STAGES) {
+    fprintf(stderr, "APEX_Error : %s: at most %d execute and memory stages in total\n", filename, MAX_STAGES - 3);
+    return -1;
+  }
+  if (branch_stage < 0 || branch_stage > execute_stages || branch_stall < 0) {
+    fprintf(stderr, "APEX_Error : %s: branch_stage must name DRF (0) or an execute stage\n", filename);
+    return -1;
+  }
+
+  if (loop_buffer < 0 || loop_buffer > MAX_LOOP_BUFFER) {
+    fprintf(stderr, "APEX_Error : %s: loop_buffer holds 0 to %d instructions\n", filename, MAX_LOOP_BUFFER);
+    return -1;
+  }
+
+  if (store_latency < 1) {
+    fprintf(stderr, "APEX_Error : %s: store_latency must be at least 1 cycle\n", filename);
+    return -1;
+  }
+
+  /* Only the dram key turns the model on */
+  if (dram.channels && (dram_channels < 1 || dram_channels > MAX_DRAM_CHANNELS || dram.banks < 1 || dram.banks > MAX_DRAM_BANKS)) {
+    fprintf(stderr, "APEX_Error : %s: DRAM has 1 to %d channels of 1 to %d banks\n", filename, MAX_DRAM_CHANNELS, MAX_DRAM_BANKS);
+    return -1;
+  }
+  if (dram.row_words < 1 || dram.tRCD < 0 || dram.tCAS < 1 || dram.tRP < 0 || dram.queue_size < 1 || dram.queue_size > MAX_DRAM_QUEUE) {
+    fprintf(stderr, "APEX_Error : %s: DRAM rows need a word, tCAS a cycle and the queue 1 to %d entries\n", filename, MAX_DRAM_QUEUE);
+    return -1;
+  }
+  dram.channels = dram.channels ? dram_channels : 0;
+
+  int forward[MAX_STAGES];
+  memset(forward, 0, sizeof(forward));
+  for (char* name = strtok(forward_list, " \t,"); name; name = strtok(NULL, " \t,")) {
+    int index = parse_stage(cpu, execute_stages, memory_stages, name);
+    if (index < 0) {
+      fprintf(stderr, "APEX_Error : %s: unknown forwarding stage %s\n", filename, name);
+      return -1;
+    }
+    forward[index] = 1;
+  }
+
+  set_layout(cpu, execute_stages, memory_stages);
+  cpu->branch_stage = EX1 + branch_stage - 1;
+  cpu->branch_stall = branch_stall;
+  memcpy(cpu->forward, forward, sizeof(forward));
+  memcpy(cpu->latency, latency, sizeof(latency));
+  cpu->loop_buffer_size = loop_buffer;
+  cpu->store_latency = store_latency;
+  cpu->dram = dram;
+  return 0;
+}
+
+/*
+ * Loads a pipeline configuration file. Returns 0 on success; on error the
+ * cpu keeps its previous configuration.
+ */
+int APEX_config_load(APEX_CPU* cpu, const char* filename)
+{
+  FILE* fp = fopen(filename, "r");
+  if (!fp) {
+    fprintf(stderr, "APEX_Error : Unable to open config file %s\n", filename);
+    return -1;
+  }
+  int status = load_stream(cpu, fp, filename);
+  fclose(fp);
+  return status;
+}
+
+/*
+ * Loads a pipeline configuration held in memory.
+ */
+int APEX_config_load_buffer(APEX_CPU* cpu, const char* text, size_t length)
+{
+  if (length == 0) {
+    return 0;
+  }
+  FILE* fp = fmemopen((void*)text, length, "r");
+  if (!fp) {
+    return -1;
+  }
+  int status = load_stream(cpu, fp, "<config>");
+  fclose(fp);
+  return status;
+}
+
+void APEX_config_print(APEX_CPU* cpu)
+{
+  printf("APEX_CPU : Pipeline F DRF");
+  for (int i = EX1; i < cpu->mem1; ++i) {
+    printf(" EX%d%s", i - EX1 + 1, cpu->forward[i] ? "*" : "");
+  }
+  for (int i = cpu->mem1; i < cpu->wb; ++i) {
+    printf(" MEM%d%s", i - cpu->mem1 + 1, cpu->forward[i] ? "*" : "");
+  }
+  if (cpu->branch_stage == DRF) {
+    printf(" WB (* forwards), branches resolve in DRF\n");
+  }
+  else {
+    printf(" WB (* forwards), branches resolve in EX%d\n", cpu->branch_stage - EX1 + 1);
+  }
+  if (cpu->dram.channels) {
+    printf("APEX_CPU : DRAM %d channel(s) x %d banks, %d-word rows, %s page, tRCD-tCAS-tRP %d-%d-%d, %d-entry queue\n", cpu->dram.channels, cpu->dram.banks, cpu->dram.row_words, cpu->dram.closed_page ? "closed" : "open", cpu->dram.tRCD, cpu->dram.tCAS, cpu->dram.tRP, cpu->dram.queue_size);
+  }
+}
@@ -0,0 +1,21 @@
+#ifndef _APEX_CONFIG_H_
+#define _APEX_CONFIG_H_
+/**
+ *  config.h
+ *  Contains the pipeline configuration loader
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include "cpu.h"
+
+void APEX_config_default(APEX_CPU* cpu);
+
+int APEX_config_load(APEX_CPU* cpu, const char* filename);
+
+int APEX_config_load_buffer(APEX_CPU* cpu, const char* text, size_t length);
+
+void APEX_config_print(APEX_CPU* cpu);
+
+#endif
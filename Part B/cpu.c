@@ -12,10 +12,18 @@
 #include <stdbool.h>
 
 #include "cpu.h"
-
-/* Set this flag to 1 to enable debug messages */
-int ENABLE_DEBUG_MESSAGES=1;
-int zeroFlag = 1, haltEncountered = 0, printedOnce = 1, branchTaken = 0, branchEncountered = 0, branchCounter = 0, dup_regs[16];
+#include "lsq.h"
+#include "config.h"
+#include "profile.h"
+#include "steady.h"
+#include "series.h"
+#include "telemetry.h"
+#include "fusion.h"
+#include "loop.h"
+#include "multicore.h"
+#include "vector.h"
+#include "logger.h"
+#include "dram.h"
 
 /*
  * This function creates and initializes APEX cpu.
@@ -26,38 +34,26 @@ APEX_CPU* APEX_cpu_init(const char* filename)
     return NULL;
   }
 
-  APEX_CPU* cpu = malloc(sizeof(*cpu));
-  if (!cpu) {
+  /* Parse input file and create code memory */
+  int size;
+  APEX_Instruction* code_memory = create_code_memory(filename, &size);
+  if (!code_memory) {
     return NULL;
   }
-
-  /* Initialize PC, Registers and all pipeline stages */
-  cpu->pc = 4000;
-  memset(cpu->regs, 0, sizeof(int) * 32);
-  memset(cpu->regs_valid, 1, sizeof(int) * 32);
-  memset(cpu->stage, 0, sizeof(CPU_Stage) * NUM_STAGES);
-  memset(cpu->data_memory, 0, sizeof(int) * 4000);
-
-  for(int i=0;i<16;i++){
-	  cpu->regs_valid[i]=1;
-  }
-  
-  /* Parse input file and create code memory */
-  cpu->code_memory = create_code_memory(filename, &cpu->code_memory_size);
-
-  if (!cpu->code_memory) {
-    free(cpu);
+  APEX_CPU* cpu = APEX_cpu_init_code(code_memory, size);
+  if (!cpu) {
     return NULL;
   }
+  /* The command line prints the pipeline unless a mode turns it off */
+  cpu->debug = 1;
 
-  if (ENABLE_DEBUG_MESSAGES) {
-    fprintf(stderr,
-            "APEX_CPU : Initialized APEX CPU, loaded %d instructions\n",
-            cpu->code_memory_size);
-    fprintf(stderr, "APEX_CPU : Printing Code Memory\n");
-    printf("%-9s %-9s %-9s %-9s %-9s %-9s\n", "code memory", "opcode", "rd", "rs1", "rs2", "imm");
+  fprintf(stderr,
+          "APEX_CPU : Initialized APEX CPU, loaded %d instructions\n",
+          cpu->code_memory_size);
+  fprintf(stderr, "APEX_CPU : Printing Code Memory\n");
+  printf("%-9s %-9s %-9s %-9s %-9s %-9s\n", "code memory", "opcode", "rd", "rs1", "rs2", "imm");
 
-    for (int i = 0; i < cpu->code_memory_size; ++i) {
+  for (int i = 0; i < cpu->code_memory_size; ++i) {
     if(compare_opcode(cpu->code_memory[i].opcode,"STR")){
       printf("%-9d %-9s %-9d %-9d %-9d\n",i,
              cpu->code_memory[i].opcode,
@@ -75,12 +71,44 @@ APEX_CPU* APEX_cpu_init(const char* filename)
              cpu->code_memory[i].rs1,
              cpu->code_memory[i].rs2,
              cpu->code_memory[i].imm);
-      }
     }
   }
+  return cpu;
+}
+
+/*
+ * This function creates and initializes APEX cpu around parsed code
+ * memory, which it takes ownership of.
+ */
+APEX_CPU* APEX_cpu_init_code(APEX_Instruction* code_memory, int size)
+{
+  APEX_CPU* cpu = calloc(1, sizeof(*cpu));
+  if (!cpu) {
+    free(code_memory);
+    return NULL;
+  }
+
+  /* Initialize PC, Registers and all pipeline stages */
+  cpu->pc = 4000;
+  memset(cpu->regs, 0, sizeof(int) * 32);
+  memset(cpu->regs_valid, 1, sizeof(int) * 32);
+  memset(cpu->stage, 0, sizeof(CPU_Stage) * MAX_STAGES);
+  memset(cpu->data_memory, 0, sizeof(int) * 4000);
+
+  for(int i=0;i<16;i++){
+	  cpu->regs_valid[i]=1;
+  }
+
+  /* Pipeline control state */
+  cpu->zeroFlag = 1;
+  cpu->printedOnce = 1;
+  APEX_config_default(cpu);
+  
+  cpu->code_memory = code_memory;
+  cpu->code_memory_size = size;
 
   /* Make all stages busy except Fetch stage, initally to start the pipeline */
-  for (int i = 1; i < NUM_STAGES; ++i) {
+  for (int i = 1; i < MAX_STAGES; ++i) {
     cpu->stage[i].busy = 1;
   }
 
@@ -92,6 +120,11 @@ APEX_CPU* APEX_cpu_init(const char* filename)
  */
 void APEX_cpu_stop(APEX_CPU* cpu)
 {
+  profile_free(cpu->profile);
+  steady_free(cpu->steady);
+  series_free(cpu->series);
+  telemetry_free(cpu->telemetry);
+  logger_free(cpu->logger);
   free(cpu->code_memory);
   free(cpu);
 }
@@ -104,75 +137,256 @@ int get_code_index(int pc)
   return (pc - 4000) / 4;
 }
 
-static void print_instruction(CPU_Stage* stage)
+/*
+ *  Formats the instruction of a latch into out, returns its length
+ */
+static int format_instruction(char* out, CPU_Stage* stage)
 {
   if (compare_opcode(stage->opcode, "STORE")) {
-    printf("%s,R%d,R%d,#%d ", stage->opcode, stage->rs1, stage->rs2, stage->imm);
+    return sprintf(out, "%s,R%d,R%d,#%d ", stage->opcode, stage->rs1, stage->rs2, stage->imm);
   }
   else if (compare_opcode(stage->opcode, "STR")) {
-    printf("%s,R%d,R%d,R%d ", stage->opcode, stage->rs1, stage->rs2, stage->rs3);
+    return sprintf(out, "%s,R%d,R%d,R%d ", stage->opcode, stage->rs1, stage->rs2, stage->rs3);
   }
   else if (compare_opcode(stage->opcode, "LOAD")) {
-    printf("%s,R%d,R%d,#%d ", stage->opcode, stage->rs1, stage->rs2, stage->imm);
+    return sprintf(out, "%s,R%d,R%d,#%d ", stage->opcode, stage->rs1, stage->rs2, stage->imm);
   }
   else if (compare_opcode(stage->opcode, "LDR")) {
-    printf("%s,R%d,R%d,R%d ", stage->opcode, stage->rs1, stage->rs2, stage->imm);
+    return sprintf(out, "%s,R%d,R%d,R%d ", stage->opcode, stage->rs1, stage->rs2, stage->imm);
   }
   else if (compare_opcode(stage->opcode, "MOVC")) {
-    printf("%s,R%d,#%d ", stage->opcode, stage->rd, stage->imm);
+    return sprintf(out, "%s,R%d,#%d ", stage->opcode, stage->rd, stage->imm);
   }
-  else if (compare_opcode(stage->opcode, "JUMP")) {
-    printf("%s,R%d,#%d ", stage->opcode, stage->rs1, stage->imm);
+  else if (compare_opcode(stage->opcode, "JUMP") || compare_opcode(stage->opcode, "LOOP")) {
+    return sprintf(out, "%s,R%d,#%d ", stage->opcode, stage->rs1, stage->imm);
   }
   else if (compare_opcode(stage->opcode, "ADD")) {
-    printf("%s,R%d,R%d,R%d ", stage->opcode, stage->rd, stage->rs1, stage->rs2);
+    return sprintf(out, "%s,R%d,R%d,R%d ", stage->opcode, stage->rd, stage->rs1, stage->rs2);
   }
   else if (compare_opcode(stage->opcode, "ADDL")) {
-    printf("%s,R%d,R%d,#%d ", stage->opcode, stage->rd, stage->rs1, stage->imm);
+    return sprintf(out, "%s,R%d,R%d,#%d ", stage->opcode, stage->rd, stage->rs1, stage->imm);
   }
   else if (compare_opcode(stage->opcode, "MUL")) {
-    printf("%s,R%d,R%d,R%d ", stage->opcode, stage->rd, stage->rs1, stage->rs2);
+    return sprintf(out, "%s,R%d,R%d,R%d ", stage->opcode, stage->rd, stage->rs1, stage->rs2);
   }
   else if (compare_opcode(stage->opcode, "SUB")) {
-    printf("%s,R%d,R%d,R%d ", stage->opcode, stage->rd, stage->rs1, stage->rs2);
+    return sprintf(out, "%s,R%d,R%d,R%d ", stage->opcode, stage->rd, stage->rs1, stage->rs2);
   }
   else if (compare_opcode(stage->opcode, "SUBL")) {
-    printf("%s,R%d,R%d,#%d ", stage->opcode, stage->rd, stage->rs1, stage->imm);
+    return sprintf(out, "%s,R%d,R%d,#%d ", stage->opcode, stage->rd, stage->rs1, stage->imm);
   }
   else if (compare_opcode(stage->opcode, "AND")) {
-    printf("%s,R%d,R%d,R%d ", stage->opcode, stage->rd, stage->rs1, stage->rs2);
+    return sprintf(out, "%s,R%d,R%d,R%d ", stage->opcode, stage->rd, stage->rs1, stage->rs2);
   }
   else if (compare_opcode(stage->opcode, "OR")) {
-    printf("%s,R%d,R%d,R%d ", stage->opcode, stage->rd, stage->rs1, stage->rs2);
+    return sprintf(out, "%s,R%d,R%d,R%d ", stage->opcode, stage->rd, stage->rs1, stage->rs2);
   }
   else if (compare_opcode(stage->opcode, "EX-OR")) {
-    printf("%s,R%d,R%d,R%d ", stage->opcode, stage->rd, stage->rs1, stage->rs2);
+    return sprintf(out, "%s,R%d,R%d,R%d ", stage->opcode, stage->rd, stage->rs1, stage->rs2);
+  }
+  else if (compare_opcode(stage->opcode, "VLOAD")) {
+    return sprintf(out, "%s,V%d,R%d,#%d ", stage->opcode, stage->rd - VREG_BASE, stage->rs1, stage->imm);
+  }
+  else if (compare_opcode(stage->opcode, "VSTORE")) {
+    return sprintf(out, "%s,V%d,R%d,#%d ", stage->opcode, stage->rs1 - VREG_BASE, stage->rs2, stage->imm);
+  }
+  else if (is_vector_opcode(get_opcode_id(stage->opcode))) {
+    return sprintf(out, "%s,V%d,V%d,V%d ", stage->opcode, stage->rd - VREG_BASE, stage->rs1 - VREG_BASE, stage->rs2 - VREG_BASE);
   }
   else if (compare_opcode(stage->opcode, "BZ") || compare_opcode(stage->opcode, "BNZ")) {
-    printf("%s,#%d", stage->opcode, stage->imm);
+    return sprintf(out, "%s,#%d", stage->opcode, stage->imm);
   }
   else if (compare_opcode(stage->opcode, "NOP")) {
-    printf("NOP");
+    return sprintf(out, "NOP");
   }
   else if(compare_opcode(stage->opcode, "HALT")){
-    printf("HALT");
+    return sprintf(out, "HALT");
   }
+  out[0] = '\0';
+  return 0;
 }
 
-/* 
- *  Debug function which dumps the cpu stagecontent
+/*
+ *  Formats the line print_stage_content prints into out, at least
+ *  APEX_STAGE_LINE bytes. Returns its length.
  */
-static void print_stage_content(char* name, CPU_Stage* stage)
+int format_stage_content(char* out, const char* name, CPU_Stage* stage)
 {
+  int length;
   if(compare_opcode(stage->opcode,"NOP") || stage->pc == 0){
-    printf("%-15s: (Idle):(%d) ", name,stage->pc);
+    length = sprintf(out, "%-15s: (Idle):(%d) ", name,stage->pc);
   }
   else{
-    printf("%-15s: (I%d):(%d) ", name,get_code_index(stage->pc),stage->pc);
+    length = sprintf(out, "%-15s: (I%d):(%d) ", name,get_code_index(stage->pc),stage->pc);
   }
   
-  print_instruction(stage);
-  printf("\n");
+  /* A fused pair is printed in program order */
+  if (stage->fused != OP_NOP) {
+    CPU_Stage partner = fusion_partner(stage);
+    length += format_instruction(out + length, stage->fused == OP_ADDL ? &partner : stage);
+    length += sprintf(out + length, "+ ");
+    length += format_instruction(out + length, stage->fused == OP_ADDL ? stage : &partner);
+  }
+  else {
+    length += format_instruction(out + length, stage);
+  }
+  out[length++] = '\n';
+  out[length] = '\0';
+  return length;
+}
+
+/* 
+ *  Debug function which dumps the cpu stagecontent
+ */
+static void print_stage_content(APEX_CPU* cpu, char* name, CPU_Stage* stage)
+{
+  if (cpu->logger) {
+    logger_stage(cpu->logger, name, stage);
+    return;
+  }
+  char line[APEX_STAGE_LINE];
+  format_stage_content(line, name, stage);
+  fputs(line, stdout);
+}
+
+/*
+ *  Prints a notice of the pipeline, through the logger if there is one
+ */
+static void print_text(APEX_CPU* cpu, const char* text)
+{
+  if (cpu->logger) {
+    logger_text(cpu->logger, text);
+    return;
+  }
+  fputs(text, stdout);
+}
+
+/*
+ *  Returns the display name of a pipeline stage
+ */
+static char* stage_name(APEX_CPU* cpu, int index, char* name)
+{
+  if (index >= cpu->mem1) {
+    sprintf(name, "Memory%d", index - cpu->mem1 + 1);
+  }
+  else {
+    sprintf(name, "Execute%d", index - EX1 + 1);
+  }
+  return name;
+}
+
+/*
+ *  Returns true if the instruction writes a destination register
+ */
+static bool writes_register(CPU_Stage* stage)
+{
+  int op = get_opcode_id(stage->opcode);
+  return op != OP_NOP && op != OP_STORE && op != OP_STR && op != OP_BZ && op != OP_BNZ && op != OP_JUMP && op != OP_HALT && op != OP_VSTORE;
+}
+
+/*
+ *  Returns true if the instruction is the youngest writer of its
+ *  destination past EX1, the only one whose result may be forwarded
+ */
+static bool owns_register(APEX_CPU* cpu, CPU_Stage* stage)
+{
+  return writes_register(stage) && cpu->reg_seq[stage->rd] == stage->seq;
+}
+
+/*
+ *  Returns true if the instruction, or an ADDL fused into it, sets the
+ *  zero flag
+ */
+static bool sets_flag(CPU_Stage* stage)
+{
+  int op = get_opcode_id(stage->opcode);
+  return op == OP_ADD || op == OP_ADDL || op == OP_SUB || op == OP_SUBL || op == OP_MUL || stage->fused == OP_ADDL;
+}
+
+/*
+ *  Returns the result the zero flag is set from
+ */
+static int flag_result(CPU_Stage* stage)
+{
+  return stage->fused == OP_ADDL ? stage->fused_value : stage->buffer;
+}
+
+/*
+ *  Returns true if the zero flag producer left EX1 less than branch_stall
+ *  cycles ago. A BZ/BNZ in DRF waits for it, not for unrelated work.
+ */
+static bool flag_pending(APEX_CPU* cpu)
+{
+  for (int i = EX1 + 1; i <= EX1 + cpu->branch_stall && i < cpu->num_stages; ++i) {
+    if (cpu->stage[i].tid == cpu->tid && cpu->stage[i].seq == cpu->flag_seq && sets_flag(&cpu->stage[i])) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ *  Returns true if the stage forwards the result of the instruction.
+ *  A load has no result before MEM1.
+ */
+static bool forwards_in(APEX_CPU* cpu, CPU_Stage* stage, int index)
+{
+  int op = get_opcode_id(stage->opcode);
+  return cpu->forward[index] && !(index < cpu->mem1 && (op == OP_LOAD || op == OP_LDR || op == OP_VLOAD));
+}
+
+/*
+ *  Sets the forwarded value of the destination register, all the lanes
+ *  of a vector register
+ */
+static void forward_value(APEX_CPU* cpu, CPU_Stage* stage)
+{
+  if (stage->rd >= VREG_BASE) {
+    memcpy(cpu->dup_vregs[stage->rd - VREG_BASE], stage->vbuffer, sizeof(stage->vbuffer));
+  }
+  else {
+    cpu->dup_regs[stage->rd] = stage->buffer;
+  }
+}
+
+/*
+ *  Makes the result of the instruction visible to younger instructions
+ */
+static void forward_result(APEX_CPU* cpu, CPU_Stage* stage, int index)
+{
+  if (forwards_in(cpu, stage, index) && owns_register(cpu, stage)) {
+    forward_value(cpu, stage);
+    cpu->regs_valid[stage->rd] = 1;
+  }
+  /* A fused ADDL has its result from EX1 on, also in front of a load */
+  if (stage->fused == OP_ADDL && cpu->forward[index] && cpu->reg_seq[stage->fused_rd] == stage->seq) {
+    cpu->dup_regs[stage->fused_rd] = stage->fused_value;
+    cpu->regs_valid[stage->fused_rd] = 1;
+  }
+}
+
+/*
+ *  Returns true if the latch holds a branch, jump or LOOP
+ */
+static bool is_control_transfer(CPU_Stage* stage)
+{
+  return compare_opcode(stage->opcode, "BZ") || compare_opcode(stage->opcode, "BNZ") || compare_opcode(stage->opcode, "JUMP") ||
+         compare_opcode(stage->opcode, "LOOP") || stage->fused == OP_BZ || stage->fused == OP_BNZ;
+}
+
+/*
+ *  Reports the retirement of the instructions of a latch, in program order
+ */
+static void commit_event(APEX_CPU* cpu, CPU_Stage* stage)
+{
+  CPU_Stage partner = fusion_partner(stage);
+  if (stage->fused == OP_ADDL) {
+    cpu->event_hook(cpu, APEX_EVENT_COMMIT, &partner);
+  }
+  cpu->event_hook(cpu, APEX_EVENT_COMMIT, stage);
+  if (stage->fused == OP_BZ || stage->fused == OP_BNZ) {
+    cpu->event_hook(cpu, APEX_EVENT_COMMIT, &partner);
+  }
 }
 
 /*
@@ -180,19 +394,55 @@ static void print_stage_content(char* name, CPU_Stage* stage)
  */
 int writeback(APEX_CPU* cpu)
 {
-  CPU_Stage* stage = &cpu->stage[WB];
+  CPU_Stage* stage = &cpu->stage[cpu->wb];
   
   if (!stage->busy && !stage->stalled) {
 
     /* Update register file */
     if(!compare_opcode(stage->opcode,"NOP")){
-      cpu->regs_valid[stage->rd] = 1;
+      if (owns_register(cpu, stage)) {
+        cpu->regs_valid[stage->rd] = 1;
+      }
+      if (stage->fused == OP_ADDL && cpu->reg_seq[stage->fused_rd] == stage->seq) {
+        cpu->regs_valid[stage->fused_rd] = 1;
+        cpu->dup_regs[stage->fused_rd] = stage->fused_value;
+      }
       
       if(!shouldStall(cpu)){
         cpu->stage[DRF].stalled = 0;
       }
       
-      cpu->ins_completed++;
+      /* A fused latch retires two instructions */
+      int count = stage->fused != OP_NOP ? 2 : 1;
+      cpu->ins_completed += count;
+      /* Only the first HALT retires, not its copies or the HALTs fetched
+       * past it */
+      if (compare_opcode(stage->opcode, "HALT")) {
+        count = !cpu->halt_retired;
+        cpu->halt_retired = 1;
+      }
+      cpu->ins_retired += count;
+      if (stage->fused == OP_ADDL) {
+        cpu->commit_regs[stage->fused_rd] = stage->fused_value;
+        cpu->fused_addresses++;
+      }
+      else if (stage->fused != OP_NOP) {
+        cpu->fused_branches++;
+      }
+      if (compare_opcode(stage->opcode, "LOOP")) {
+        cpu->loops_retired++;
+        cpu->loop_redirects += stage->predicted == LOOP_PREDICTED_TAKEN;
+      }
+      int op = get_opcode_id(stage->opcode);
+      cpu->vector_loads += op == OP_VLOAD;
+      cpu->vector_stores += op == OP_VSTORE;
+      cpu->vector_ops += is_vector_opcode(op) && op != OP_VLOAD && op != OP_VSTORE;
+      if (cpu->event_hook && !compare_opcode(stage->opcode, "HALT")) {
+        commit_event(cpu, stage);
+      }
+      if (cpu->steady && !compare_opcode(stage->opcode, "HALT")) {
+        steady_commit(cpu, stage);
+      }
     }
     if (compare_opcode(stage->opcode, "MOVC")) {
       cpu->regs[stage->rd] = stage->buffer;
@@ -204,122 +454,469 @@ int writeback(APEX_CPU* cpu)
     else if(compare_opcode(stage->opcode, "AND") || compare_opcode(stage->opcode, "OR") || compare_opcode(stage->opcode, "EX-OR")){
        cpu->regs[stage->rd] = stage->buffer;
      }
+    if (owns_register(cpu, stage)) {
+      forward_value(cpu, stage);
+    }
+    if (writes_register(stage) && stage->rd >= VREG_BASE) {
+      memcpy(cpu->vregs[stage->rd - VREG_BASE], stage->vbuffer, sizeof(stage->vbuffer));
+    }
+    else if (writes_register(stage)) {
+      cpu->commit_regs[stage->rd] = stage->buffer;
+    }
+    if (sets_flag(stage)) {
+      cpu->commit_zeroFlag = flag_result(stage) != 0;
+    }
    }
-   if (ENABLE_DEBUG_MESSAGES) {
-     print_stage_content("Writeback", stage);
+   if (cpu->debug) {
+     print_stage_content(cpu, "Writeback", stage);
    }
   return 0;
 }
 
 /*
- *  Memeory2 Stage of APEX Pipeline
+ *  Memory stages after the first one. They only pass the instruction on
+ *  and forward its result if the stage is a forwarding source.
  */
-int memory2(APEX_CPU *cpu){
-  CPU_Stage* stage = &cpu->stage[MEM2];
+int memoryN(APEX_CPU *cpu, int index){
+  CPU_Stage* stage = &cpu->stage[index];
+  char name[32];
   
   if(!stage->stalled && !stage->busy){
 
-   dup_regs[stage->rd] = stage->buffer;
-   cpu->regs_valid[stage->rd] = 1;
+   forward_result(cpu, stage, index);
 
    if(compare_opcode(stage->opcode,"HALT")){
-      cpu->stage[WB] = cpu->stage[MEM2];
+      cpu->stage[index+1] = cpu->stage[index];
       return 0;
     }       
   }
-   if(ENABLE_DEBUG_MESSAGES){
-      print_stage_content("Memory2", stage);
+   if(cpu->debug){
+      print_stage_content(cpu, stage_name(cpu, index, name), stage);
     }
-  cpu->stage[WB] = cpu->stage[MEM2];
+  cpu->stage[index+1] = cpu->stage[index];
   return 0;
 }
 
+/*
+ *  Returns true if the access in MEM1 goes to the DRAM: loads the store
+ *  buffer cannot forward, and stores it does not take
+ */
+static bool uses_dram(APEX_CPU* cpu, CPU_Stage* stage)
+{
+  if (compare_opcode(stage->opcode, "STORE") || compare_opcode(stage->opcode, "STR")) {
+    return !cpu->lsq_size;
+  }
+  if (compare_opcode(stage->opcode, "LOAD") || compare_opcode(stage->opcode, "LDR")) {
+    return !cpu->lsq_size || !lsq_holds(cpu, stage->mem_address);
+  }
+  /* A VSTORE the store buffer cannot take writes once the buffer is empty */
+  if (compare_opcode(stage->opcode, "VSTORE")) {
+    return cpu->lsq_size < VECTOR_LANES && !cpu->sb_count;
+  }
+  return compare_opcode(stage->opcode, "VLOAD");
+}
+
 /*
  *  Mem1 Stage of APEX Pipeline
  */
 int memory1(APEX_CPU* cpu){
-  CPU_Stage* stage = &cpu->stage[MEM1];
+  CPU_Stage* stage = &cpu->stage[cpu->mem1];
+  CPU_Stage* next = &cpu->stage[cpu->mem1+1];
   
+  /* Buffered stores use the memory port whenever a load does not */
+  if (cpu->lsq_size && !compare_opcode(stage->opcode, "LOAD") && !compare_opcode(stage->opcode, "LDR") && !compare_opcode(stage->opcode, "VLOAD")) {
+    lsq_drain(cpu);
+  }
+
   if(!stage->busy && !stage->stalled){
 
+    /* A multicore core holds the access in MEM1 until the bus serves it */
+    if (cpu->core && (compare_opcode(stage->opcode, "LOAD") || compare_opcode(stage->opcode, "LDR") || compare_opcode(stage->opcode, "STORE") || compare_opcode(stage->opcode, "STR")) && !core_access(cpu, stage)) {
+      cpu->stall_stage = cpu->mem1;
+      if(cpu->debug){
+        print_stage_content(cpu, "Stalled Memory1",stage);
+      }
+      CPU_Stage nop;
+      memset(&nop, 0, sizeof(nop));
+      memcpy(&nop.opcode, "NOP", 3);
+      *next = nop;
+      return 0;
+    }
+
+    /* With the DRAM model the access holds MEM1 until its data arrives */
+    int op = get_opcode_id(stage->opcode);
+    int words = op == OP_VLOAD || op == OP_VSTORE ? VECTOR_LANES : 1;
+    if (cpu->dram.channels && uses_dram(cpu, stage) && !dram_access(cpu, stage->mem_address, words, op == OP_STORE || op == OP_STR || op == OP_VSTORE)) {
+      cpu->stall_stage = cpu->mem1;
+      if(cpu->debug){
+        print_stage_content(cpu, "Stalled Memory1",stage);
+      }
+      CPU_Stage nop;
+      memset(&nop, 0, sizeof(nop));
+      memcpy(&nop.opcode, "NOP", 3);
+      *next = nop;
+      return 0;
+    }
+
+    /* A load the store buffer cannot serve waits while a store is written */
+    int load_words = 0;
+    if (compare_opcode(stage->opcode, "LOAD") || compare_opcode(stage->opcode, "LDR")) {
+      load_words = 1;
+    }
+    else if (compare_opcode(stage->opcode, "VLOAD")) {
+      load_words = VECTOR_LANES;
+    }
+    if (cpu->lsq_size && load_words && lsq_port_wait(cpu, stage->mem_address, load_words)) {
+      cpu->stall_stage = cpu->mem1;
+      if(cpu->debug){
+        print_stage_content(cpu, "Stalled Memory1",stage);
+      }
+      CPU_Stage nop;
+      memset(&nop, 0, sizeof(nop));
+      memcpy(&nop.opcode, "NOP", 3);
+      *next = nop;
+      return 0;
+    }
+
     if (compare_opcode(stage->opcode, "STORE") || compare_opcode(stage->opcode, "STR")) {
-    cpu->data_memory[stage->mem_address] = stage->rs1_value;
+      if (!cpu->lsq_size) {
+        cpu->data_memory[stage->mem_address] = stage->rs1_value;
+        cpu->mem_stores++;
+      }
+      else if (!lsq_store(cpu, stage->mem_address, stage->rs1_value)) {
+        /* Store buffer full, hold the store in MEM1 */
+        cpu->stall_stage = cpu->mem1;
+        if(cpu->debug){
+          print_stage_content(cpu, "Stalled Memory1",stage);
+        }
+        CPU_Stage nop;
+        memset(&nop, 0, sizeof(nop));
+        memcpy(&nop.opcode, "NOP", 3);
+        *next = nop;
+        return 0;
+      }
+      else {
+        cpu->mem_stores++;
+      }
     }
 	
     /* LOAD*/
     else if (strcmp(stage->opcode, "LOAD") == 0 || compare_opcode(stage->opcode, "LDR")) { 
-      cpu->regs[stage->rd] = stage->mem_address;
+      int value;
+      if (!cpu->lsq_size || !lsq_forward(cpu, stage->mem_address, &value)) {
+        value = cpu->data_memory[stage->mem_address];
+      }
+      stage->buffer = value;
+      cpu->mem_loads++;
+      cpu->regs[stage->rd] = value;
+      if (owns_register(cpu, stage)) {
+        cpu->dup_regs[stage->rd] = value;
+      }
+    }
+    else if (compare_opcode(stage->opcode, "VSTORE")) {
+      if (!vector_store(cpu, stage->mem_address, stage->vbuffer)) {
+        /* No room for all the lanes, hold the store in MEM1 */
+        cpu->stall_stage = cpu->mem1;
+        if(cpu->debug){
+          print_stage_content(cpu, "Stalled Memory1",stage);
+        }
+        CPU_Stage nop;
+        memset(&nop, 0, sizeof(nop));
+        memcpy(&nop.opcode, "NOP", 3);
+        *next = nop;
+        return 0;
+      }
+    }
+    else if (compare_opcode(stage->opcode, "VLOAD")) {
+      vector_load(cpu, stage->mem_address, stage->vbuffer);
     }
     else if(compare_opcode(stage->opcode,"HALT")){
-      cpu->stage[MEM2] = cpu->stage[MEM1];
+      *next = *stage;
       return 0;
     }
+    forward_result(cpu, stage, cpu->mem1);
   }
-  if(ENABLE_DEBUG_MESSAGES){
-      print_stage_content("Memory1",stage);
+  if(cpu->debug){
+      print_stage_content(cpu, "Memory1",stage);
   }
-  cpu->stage[MEM2] = cpu->stage[MEM1];
+  *next = *stage;
   return 0;
 }
 
-int execute2(APEX_CPU* cpu){
-  CPU_Stage* stage = &cpu->stage[EX2];
-  if(!stage->busy && !stage->stalled){
-  
-   //destRegister1 = stage->rd;
-   dup_regs[stage->rd] = stage->buffer;
-   cpu->regs_valid[stage->rd] = 1;
-      
-    if(compare_opcode(stage->opcode,"HALT")){
-      cpu->stage[MEM1] = cpu->stage[EX2];
-      return 0;
+static void announce_flush(APEX_CPU* cpu)
+{
+  if(cpu->quiet){
+    return;
+  }
+  if(cpu->branch_stage == DRF){
+    print_text(cpu, "Instruction in F stage flushed as the branch is taken.\n");
+  }
+  else{
+    print_text(cpu, "Instructions in F, DRF and EX1 stage flushed as the branch is taken.\n");
+  }
+}
+
+/*
+ *  Undoes the scoreboard and flag updates of the instructions a taken
+ *  branch squashes after they left EX1, EX2 up to the branch stage. Each
+ *  register they wrote goes back to its youngest older writer still in
+ *  flight, in the stages past the branch, or to its retired value.
+ */
+static void restore_scoreboard(APEX_CPU* cpu)
+{
+  int squashed[32] = {0};
+  int flag = 0;
+  for (int i = EX1 + 1; i < cpu->branch_stage; ++i) {
+    CPU_Stage* stage = &cpu->stage[i];
+    if (stage->tid != cpu->tid) {
+      continue;
+    }
+    if (writes_register(stage)) {
+      squashed[stage->rd] = 1;
+    }
+    if (stage->fused == OP_ADDL) {
+      squashed[stage->fused_rd] = 1;
+    }
+    flag |= sets_flag(stage);
+  }
+  for (int r = 0; r < 32; ++r) {
+    if (squashed[r]) {
+      cpu->reg_seq[r] = 0;
+      cpu->dup_regs[r] = cpu->commit_regs[r];
+      cpu->regs_valid[r] = 1;
+      if (r >= VREG_BASE) {
+        memcpy(cpu->dup_vregs[r - VREG_BASE], cpu->vregs[r - VREG_BASE], sizeof(cpu->vregs[0]));
+      }
+    }
+  }
+  if (flag) {
+    cpu->zeroFlag = cpu->commit_zeroFlag;
+    cpu->flag_seq = 0;
+  }
+
+  /* stage[branch_stage + 1] still holds a copy of the next one. The
+   * branch stage comes last: a compare fused with the branch is the
+   * youngest writer left, and it has forwarded in that stage already */
+  for (int i = cpu->wb; i >= cpu->branch_stage; --i) {
+    CPU_Stage* stage = &cpu->stage[i];
+    int passed = i == cpu->branch_stage ? i + 1 : i;
+    if (stage->tid != cpu->tid || i == cpu->branch_stage + 1) {
+      continue;
+    }
+    if (flag && sets_flag(stage)) {
+      cpu->zeroFlag = flag_result(stage) != 0;
+      cpu->flag_seq = stage->seq;
+    }
+    if (stage->fused == OP_ADDL && squashed[stage->fused_rd]) {
+      int forwarded = 0;
+      for (int k = EX1; k < passed; ++k) {
+        forwarded |= cpu->forward[k];
+      }
+      cpu->reg_seq[stage->fused_rd] = stage->seq;
+      cpu->regs_valid[stage->fused_rd] = forwarded;
+      if (forwarded) {
+        cpu->dup_regs[stage->fused_rd] = stage->fused_value;
+      }
+    }
+    if (!writes_register(stage) || !squashed[stage->rd]) {
+      continue;
+    }
+    int forwarded = 0;
+    for (int k = EX1; k < passed; ++k) {
+      forwarded |= forwards_in(cpu, stage, k);
+    }
+    cpu->reg_seq[stage->rd] = stage->seq;
+    cpu->regs_valid[stage->rd] = forwarded;
+    if (forwarded) {
+      forward_value(cpu, stage);
+    }
+  }
+}
+
+/*
+ *  Returns the fused latches older than the branch stage. Each retires two
+ *  instructions, one more than the completion count expects.
+ */
+static int fused_in_flight(APEX_CPU* cpu)
+{
+  int count = 0;
+  for (int i = cpu->branch_stage + 2; i <= cpu->wb; ++i) {
+    count += cpu->stage[i].tid == cpu->tid && cpu->stage[i].fused != OP_NOP;
+  }
+  return count;
+}
+
+/*
+ *  Resolves a branch or jump in the configured branch stage
+ */
+static void resolve_branch(APEX_CPU* cpu, CPU_Stage* stage)
+{
+    int taken = cpu->branchTaken;
+    /* A fused branch tests the result of its compare */
+    if(stage->fused == OP_BZ || stage->fused == OP_BNZ){
+      if((stage->buffer != 0) == (stage->fused == OP_BNZ)){
+        cpu->pc = stage->fused_pc + stage->fused_imm;
+        cpu->ins_completed = get_code_index(cpu->pc);
+        cpu->branchTaken = 1;
+        announce_flush(cpu);
+      }
     }
     else if(compare_opcode(stage->opcode,"BNZ")){
-      if(zeroFlag){                  // If branch taken
-        cpu->pc = cpu->pc + stage->imm - 12;
+      if(stage->buffer){                  // If branch taken
+        cpu->pc = stage->pc + stage->imm;
         cpu->ins_completed = get_code_index(cpu->pc);
-        branchTaken = 1;
-        printf("Instructions in F, DRF and EX1 stage flushed as the branch is taken.\n");
+        cpu->branchTaken = 1;
+        announce_flush(cpu);
       }
     }
     else if(compare_opcode(stage->opcode,"BZ")){
-    if(!zeroFlag){                      // If branch taken
-        cpu->pc = cpu->pc + stage->imm  - 12;
+    if(!stage->buffer){                      // If branch taken
+        cpu->pc = stage->pc + stage->imm;
         cpu->ins_completed = get_code_index(cpu->pc);
-        branchTaken = 1;
-        printf("Instructions in F, DRF and EX1 stage flushed as the branch is taken.\n");
+        cpu->branchTaken = 1;
+        announce_flush(cpu);
       }
     }
     else if(compare_opcode(stage->opcode,"JUMP")){
       cpu->pc = stage->rs1_value + stage->imm;
       cpu->ins_completed = get_code_index(cpu->pc)-3;
-      branchTaken = 1;
-      printf("Instructions in F, DRF and EX1 stage flushed as the branch is taken.\n");
+      cpu->branchTaken = 1;
+      announce_flush(cpu);
+    }
+    /* Fetch has gone back to the head already if it took the LOOP from
+     * the loop buffer; only a wrong guess redirects */
+    else if(compare_opcode(stage->opcode,"LOOP")){
+      int target = stage->buffer ? stage->pc - 4 * stage->imm : stage->pc + 4;
+      if((stage->buffer != 0) != (stage->predicted == LOOP_PREDICTED_TAKEN)){
+        cpu->pc = target;
+        cpu->ins_completed = get_code_index(cpu->pc);
+        cpu->branchTaken = 1;
+        announce_flush(cpu);
+      }
+      else if(stage->buffer){
+        cpu->ins_completed = get_code_index(target) - fused_in_flight(cpu);
+      }
+      loop_resolve(cpu, stage);
+    }
+    /* F, DRF and the execute stages in front of this one are squashed */
+    if(cpu->branchTaken && !taken && cpu->branch_stage > EX1){
+      restore_scoreboard(cpu);
+    }
+    if(cpu->branchTaken && !taken){
+      cpu->flushes++;
+      cpu->ins_completed -= fused_in_flight(cpu);
+      if(!compare_opcode(stage->opcode,"LOOP")){
+        loop_flush(cpu);
+      }
     }
+    CPU_Stage branch = stage->fused != OP_NOP ? fusion_partner(stage) : *stage;
+    if(cpu->profile && cpu->branchTaken && !taken){
+      profile_flush(cpu, branch.pc, cpu->branch_stage);
+    }
+    if(cpu->event_hook && cpu->branchTaken && !taken){
+      cpu->event_hook(cpu, APEX_EVENT_FLUSH, &branch);
+    }
+}
+
+/*
+ *  Execute stages after the first one. A stage in front of the branch
+ *  stage is flushed by a taken branch; the branch stage resolves branches.
+ */
+int executeN(APEX_CPU* cpu, int index){
+  CPU_Stage* stage = &cpu->stage[index];
+  char name[32];
+  if(cpu->stall_stage > index){
+    if (cpu->debug) {
+      char label[48];
+      sprintf(label, "Stalled %s", stage_name(cpu, index, name));
+      print_stage_content(cpu, label, stage);
+    }
+    return 0;
   }
-    if(ENABLE_DEBUG_MESSAGES){
-      print_stage_content("Execute2", stage);
+  if(!stage->busy && !stage->stalled){
+    if(cpu->branchTaken && index < cpu->branch_stage){
+      CPU_Stage nop;
+      memset(&nop, 0, sizeof(nop));
+      memcpy(&nop.opcode, "NOP", 3);
+      cpu->stage[index+1] = nop;
+      return 0;
     }
-  cpu->stage[MEM1] = cpu->stage[EX2];
+  
+   forward_result(cpu, stage, index);
+      
+    if(compare_opcode(stage->opcode,"HALT")){
+      cpu->stage[index+1] = cpu->stage[index];
+      return 0;
+    }
+    if(index == cpu->branch_stage){
+      resolve_branch(cpu, stage);
+    }
+  }
+    if(cpu->debug){
+      print_stage_content(cpu, stage_name(cpu, index, name), stage);
+    }
+  cpu->stage[index+1] = cpu->stage[index];
   return 0;
 } 
 int execute1(APEX_CPU* cpu)
 {
   CPU_Stage* stage = &cpu->stage[EX1];
+  if(cpu->stall_stage > EX1){
+    if (cpu->debug) {
+      print_stage_content(cpu, "Stalled Execute1", stage);
+    }
+    return 0;
+  }
   if (!stage->stalled && !stage->busy) {
 
-    stage->rs1_value = dup_regs[stage->rs1];
-    stage->rs2_value = dup_regs[stage->rs2];
-    stage->rs3_value = dup_regs[stage->rs3];
-    if(branchTaken){
+    if (!stage->counted) {
+      stage->rs1_value = cpu->dup_regs[stage->rs1];
+    }
+    stage->rs2_value = cpu->dup_regs[stage->rs2];
+    stage->rs3_value = cpu->dup_regs[stage->rs3];
+    if(cpu->branchTaken){
       CPU_Stage nop;
-		  printf("EX1 stage flushed.\n");
+      if(!cpu->quiet){
+        print_text(cpu, "EX1 stage flushed.\n");
+      }
       memset(&nop, 0, sizeof(nop));
 		  memcpy(&nop.opcode, "NOP", 3);
-      cpu->stage[EX2] = nop;
+      cpu->stage[EX1+1] = nop;
       return 0;
     }
 
+    /* Multi-cycle operations hold EX1 and the stages behind it */
+    int latency = cpu->latency[get_opcode_id(stage->opcode)];
+    if (stage->fused == OP_ADDL && cpu->latency[OP_ADDL] > latency) {
+      latency = cpu->latency[OP_ADDL];
+    }
+    if (stage->elapsed + 1 < latency) {
+      stage->elapsed++;
+      cpu->stall_stage = EX1;
+      if (cpu->debug) {
+        print_stage_content(cpu, "Busy Execute1", stage);
+      }
+      CPU_Stage nop;
+      memset(&nop, 0, sizeof(nop));
+      memcpy(&nop.opcode, "NOP", 3);
+      cpu->stage[EX1+1] = nop;
+      return 0;
+    }
+
+    /* A fused ADDL computes the base register of its load or store first */
+    if (stage->fused == OP_ADDL) {
+      stage->fused_value = cpu->dup_regs[stage->fused_rs1] + stage->fused_imm;
+      if (stage->rs1 == stage->fused_rd) {
+        stage->rs1_value = stage->fused_value;
+      }
+      if (stage->rs2 == stage->fused_rd) {
+        stage->rs2_value = stage->fused_value;
+      }
+      cpu->zeroFlag = stage->fused_value != 0;
+      cpu->regs_valid[stage->fused_rd] = 0;
+      cpu->reg_seq[stage->fused_rd] = stage->seq;
+    }
+
     /* Store */
     if (compare_opcode(stage->opcode, "STORE")) {
       stage->mem_address = stage->rs2_value + stage->imm;
@@ -342,31 +939,31 @@ int execute1(APEX_CPU* cpu)
   	else if (compare_opcode(stage->opcode, "ADD")) {
 	    stage->buffer = stage->rs1_value + stage->rs2_value;
      if(stage->buffer == 0){
-       zeroFlag = 0;
+       cpu->zeroFlag = 0;
      }
      else{
-       zeroFlag = 1;
+       cpu->zeroFlag = 1;
      }
       cpu->regs_valid[stage->rd] = 0;
     }
   	else if (compare_opcode(stage->opcode, "ADDL")) {
 	    stage->buffer = stage->rs1_value + stage->imm;
      if(stage->buffer == 0){
-       zeroFlag = 0;
+       cpu->zeroFlag = 0;
      }
      else{
-       zeroFlag = 1;
+       cpu->zeroFlag = 1;
      }
       cpu->regs_valid[stage->rd] = 0;
     }
   	else if (compare_opcode(stage->opcode, "SUB")) {
 	    stage->buffer = stage->rs1_value - stage->rs2_value;
      if(stage->buffer == 0){
-       zeroFlag = 0;
+       cpu->zeroFlag = 0;
        //printf("ZeroFlag set to 0.\n");
      }
      else{
-       zeroFlag = 1;
+       cpu->zeroFlag = 1;
        //printf("ZeroFlag set to 1.\n");
      }
      cpu->regs_valid[stage->rd] = 0;
@@ -374,10 +971,10 @@ int execute1(APEX_CPU* cpu)
   	else if (compare_opcode(stage->opcode, "SUBL")) {
 	    stage->buffer = stage->rs1_value - stage->imm;
      if(stage->buffer == 0){
-       zeroFlag = 0;
+       cpu->zeroFlag = 0;
      }
      else{
-       zeroFlag = 1;
+       cpu->zeroFlag = 1;
      }
      cpu->regs_valid[stage->rd] = 0;
     }
@@ -396,23 +993,55 @@ int execute1(APEX_CPU* cpu)
     else if (compare_opcode(stage->opcode, "MUL")) {
       stage->buffer=stage->rs1_value*stage->rs2_value;
      if(stage->buffer == 0){
-       zeroFlag = 0;
+       cpu->zeroFlag = 0;
      }
      else{
-       zeroFlag = 1;
+       cpu->zeroFlag = 1;
      }
       cpu->regs_valid[stage->rd] = 0;
     }
+    else if(compare_opcode(stage->opcode, "BZ") || compare_opcode(stage->opcode, "BNZ")){
+      /* Keep the flag of the older instructions for a later branch stage */
+      stage->buffer = cpu->zeroFlag;
+    }
+    else if (compare_opcode(stage->opcode, "LOOP")) {
+      stage->buffer = stage->rs1_value - 1;
+      cpu->regs_valid[stage->rd] = 0;
+    }
+    /* Vector registers are read here like the integer ones, from the
+     * forwarded values */
+    else if (compare_opcode(stage->opcode, "VLOAD")) {
+      stage->mem_address = stage->rs1_value + stage->imm;
+      cpu->regs_valid[stage->rd] = 0;
+    }
+    else if (compare_opcode(stage->opcode, "VSTORE")) {
+      stage->mem_address = stage->rs2_value + stage->imm;
+      memcpy(stage->vbuffer, cpu->dup_vregs[stage->rs1 - VREG_BASE], sizeof(stage->vbuffer));
+    }
+    else if (is_vector_opcode(get_opcode_id(stage->opcode))) {
+      vector_execute(get_opcode_id(stage->opcode), cpu->dup_vregs[stage->rs1 - VREG_BASE], cpu->dup_vregs[stage->rs2 - VREG_BASE], stage->vbuffer);
+      cpu->regs_valid[stage->rd] = 0;
+    }
     else if(compare_opcode(stage->opcode,"HALT")){
-      cpu->stage[EX2] = cpu->stage[EX1];
+      cpu->stage[EX1+1] = cpu->stage[EX1];
       return 0;
     }  
+    if (writes_register(stage)) {
+      cpu->reg_seq[stage->rd] = stage->seq;
+    }
+    if (sets_flag(stage)) {
+      cpu->flag_seq = stage->seq;
+    }
+    forward_result(cpu, stage, EX1);
+    if(cpu->branch_stage == EX1){
+      resolve_branch(cpu, stage);
+    }
   }
-  if (ENABLE_DEBUG_MESSAGES) {
-      print_stage_content("Execute1", stage);
+  if (cpu->debug) {
+      print_stage_content(cpu, "Execute1", stage);
     }
   /* Copy data from Execute1 latch to Execute2 latch*/
-    cpu->stage[EX2] = cpu->stage[EX1];
+    cpu->stage[EX1+1] = cpu->stage[EX1];
 
   return 0;
 }
@@ -422,16 +1051,28 @@ int execute1(APEX_CPU* cpu)
 int decode(APEX_CPU* cpu)
 {
   CPU_Stage* stage = &cpu->stage[DRF];
+  if(cpu->stall_stage > DRF){
+    if (cpu->debug) {
+      print_stage_content(cpu, "Stalled Decode/RF", stage);
+    }
+    return 0;
+  }
 
   if (!stage->busy && !stage->stalled) {
-   if(branchTaken){
+   if(cpu->branchTaken){
       CPU_Stage nop;
-      printf("DRF stage flushed.\n");
+      if(!cpu->quiet){
+        print_text(cpu, "DRF stage flushed.\n");
+      }
 		  memset(&nop, 0, sizeof(nop));
 		  memcpy(&nop.opcode, "NOP", 3);
       cpu->stage[EX1] = nop;
       return 0;
     }
+
+    if (cpu->fusion) {
+      fusion_pair(cpu, stage);
+    }
     
     /* Read data from register file for store */
     if (compare_opcode(stage->opcode, "STORE") || compare_opcode(stage->opcode, "ADD") || compare_opcode(stage->opcode, "OR") || compare_opcode(stage->opcode, "AND") || compare_opcode(stage->opcode, "MUL") || compare_opcode(stage->opcode, "SUB") || compare_opcode(stage->opcode, "EX-OR") || compare_opcode(stage->opcode, "LDR")) {
@@ -448,37 +1089,58 @@ int decode(APEX_CPU* cpu)
     else if (compare_opcode(stage->opcode, "JUMP") || compare_opcode(stage->opcode, "MOVC") || compare_opcode(stage->opcode, "ADDL") || compare_opcode(stage->opcode, "SUBL") || compare_opcode(stage->opcode, "LOAD")) {
       stage->rs1_value=cpu->regs[stage->rs1];
     }
+
+    else if (compare_opcode(stage->opcode, "LOOP") && !stage->counted) {
+      stage->rs1_value=cpu->regs[stage->rs1];
+    }
     
     else if (compare_opcode(stage->opcode, "BZ")  || compare_opcode(stage->opcode, "BNZ")) {
   
-      if(branchCounter!=1){
-        branchEncountered=1;
+      /* Resolved in DRF, the zero flag of the producer in EX1 is already set */
+      if(cpu->branch_stage != DRF && flag_pending(cpu)){
+        cpu->branchEncountered=1;
         CPU_Stage nop;
 		    memset(&nop, 0, sizeof(nop));
 		    memcpy(&nop.opcode, "NOP", 3);
         cpu->stage[EX1] = nop;
       
-        if (ENABLE_DEBUG_MESSAGES) {
-          print_stage_content("Decode/RF", stage);
-          printf("Next DRF will be stalled.\n");
+        if (cpu->debug) {
+          print_stage_content(cpu, "Decode/RF", stage);
+          print_text(cpu, "Next DRF will be stalled.\n");
         }
-        branchCounter++;
         return 0;
       }
     }
     
     else if(compare_opcode(stage->opcode,"HALT")){
-      haltEncountered = 1;
+      /* A HALT behind an unresolved branch may be on the wrong path */
+      bool branch_in_flight = false;
+      for (int i = EX1; i <= cpu->branch_stage; ++i) {
+        branch_in_flight = branch_in_flight || (cpu->stage[i].tid == cpu->tid && is_control_transfer(&cpu->stage[i]));
+      }
+      if(branch_in_flight){
+        cpu->branchEncountered=1;
+        CPU_Stage nop;
+        memset(&nop, 0, sizeof(nop));
+        memcpy(&nop.opcode, "NOP", 3);
+        cpu->stage[EX1] = nop;
+        return 0;
+      }
+      cpu->haltEncountered = 1;
       cpu->stage[EX1] = cpu->stage[DRF];
-      if(printedOnce==1){
-        print_stage_content("Decode/RF", stage);
-        printedOnce++;
+      if(cpu->printedOnce==1){
+        if(!cpu->quiet){
+          print_stage_content(cpu, "Decode/RF", stage);
+        }
+        cpu->printedOnce++;
       }
+      /* HALT has issued, DRF no longer holds fetch */
+      cpu->branchEncountered = 0;
       return 0;
     }
     
-    if (ENABLE_DEBUG_MESSAGES) {
-      print_stage_content("Decode/RF", stage);
+    if (cpu->debug) {
+      print_stage_content(cpu, "Decode/RF", stage);
     }
     
     if(shouldStall(cpu)){
@@ -491,40 +1153,57 @@ int decode(APEX_CPU* cpu)
         cpu->stage[EX1] = nop;
       }
     else{
+      /* Early resolution: only the fetch slot is squashed */
+      if(cpu->branch_stage == DRF && is_control_transfer(stage)){
+        if (!stage->counted) {
+          stage->rs1_value = cpu->dup_regs[stage->rs1];
+        }
+        stage->buffer = compare_opcode(stage->opcode, "LOOP") ? stage->rs1_value - 1 : cpu->zeroFlag;
+        resolve_branch(cpu, stage);
+      }
     /* Copy data from decode latch to execute1 latch*/
         cpu->stage[EX1] = cpu->stage[DRF];  
       }
   }
   else if(stage->stalled){
-    if (ENABLE_DEBUG_MESSAGES) {
-      print_stage_content("Stalled Decode/RF", stage);
+    if (cpu->debug) {
+      print_stage_content(cpu, "Stalled Decode/RF", stage);
     }
   }
-  branchEncountered = 0;
-  branchCounter = 0;
+  cpu->branchEncountered = 0;
   return 0;
 }
 
 int fetch(APEX_CPU* cpu)
 {
   CPU_Stage* stage = &cpu->stage[F];
+  if(cpu->stall_stage > F){
+    if (cpu->debug) {
+      print_stage_content(cpu, "Stalled Fetch", stage);
+    }
+    return 0;
+  }
   
   if (!stage->busy && !stage->stalled) {
 
-    if(branchTaken){
+    if(cpu->branchTaken){
       CPU_Stage nop;
-      printf("F stage flushed.\n");
+      if(!cpu->quiet){
+        print_text(cpu, "F stage flushed.\n");
+      }
 		  memset(&nop, 0, sizeof(nop));
 		  memcpy(&nop.opcode, "NOP", 3);
       cpu->stage[DRF] = nop;
-      branchTaken=0;
+      cpu->branchTaken=0;
       return 0;
       }
     
-    if(haltEncountered){
-      if(printedOnce == 2){
-        printf("Halt encountered.Fetching stopped.\n");
-        printedOnce++;
+    if(cpu->haltEncountered){
+      if(cpu->printedOnce == 2){
+        if(!cpu->quiet){
+          print_text(cpu, "Halt encountered.Fetching stopped.\n");
+        }
+        cpu->printedOnce++;
       }
       cpu->code_memory_size = get_code_index(cpu->pc);
       cpu->stage[DRF] = cpu->stage[F];
@@ -533,24 +1212,37 @@ int fetch(APEX_CPU* cpu)
     
     /* Store current PC in fetch latch */
       stage->pc = cpu->pc;  
+      stage->seq = ++cpu->fetch_seq;
+      stage->tid = cpu->tid;
       /* Index into code memory using this pc and copy all instruction fields into
        * fetch latch
        */
-      APEX_Instruction* current_ins = &cpu->code_memory[get_code_index(cpu->pc)];
-      strcpy(stage->opcode, current_ins->opcode); 
-
-      stage->rd = current_ins->rd;
-      stage->rs1 = current_ins->rs1;
-      stage->rs2 = current_ins->rs2;
-      stage->rs3 = current_ins->rs3;  
-      stage->imm = current_ins->imm;
+      int index = get_code_index(cpu->pc);
+      APEX_Instruction* current_ins = loop_lookup(cpu, cpu->pc);
+      if (!current_ins && index >= 0 && index < cpu->code_memory_size) {
+        current_ins = &cpu->code_memory[index];
+      }
+      if (!current_ins) {
+        /* Fetching past the end of code memory yields HALT */
+        strcpy(stage->opcode, "HALT");
+        stage->rd = stage->rs1 = stage->rs2 = stage->rs3 = stage->imm = 0;
+      }
+      else {
+        strcpy(stage->opcode, current_ins->opcode); 
+
+        stage->rd = current_ins->rd;
+        stage->rs1 = current_ins->rs1;
+        stage->rs2 = current_ins->rs2;
+        stage->rs3 = current_ins->rs3;  
+        stage->imm = current_ins->imm;
+      }
       
-       if (ENABLE_DEBUG_MESSAGES) {
-          print_stage_content("Fetch", stage);
+       if (cpu->debug) {
+          print_stage_content(cpu, "Fetch", stage);
       }
-      if(!cpu->stage[DRF].stalled && !branchEncountered){
-          /* Update PC for next instruction */
-        cpu->pc += 4;
+      if(!cpu->stage[DRF].stalled && !cpu->branchEncountered){
+          /* Update PC for next instruction, a buffered LOOP may go back */
+        cpu->pc = loop_next_pc(cpu, stage);
 
         /* Copy data from fetch latch to decode latch*/
         cpu->stage[DRF] = cpu->stage[F];
@@ -561,49 +1253,180 @@ int fetch(APEX_CPU* cpu)
 }
 
 /*
- *  APEX CPU simulation loop
+ * This function creates a copy of an initialized APEX cpu with its own
+ * code memory, so that the copy can be simulated on another thread.
  */
-int APEX_cpu_run(APEX_CPU* cpu, int cycles, int flag)
+APEX_CPU* APEX_cpu_clone(const APEX_CPU* src)
 {
-  for(int i=0;i<16;i++){
-     dup_regs[i]=0;
+  APEX_CPU* cpu = malloc(sizeof(*cpu));
+  if (!cpu) {
+    return NULL;
   }
-  if(!flag){
-    ENABLE_DEBUG_MESSAGES=0;
+  memcpy(cpu, src, sizeof(*cpu));
+  cpu->profile = NULL;
+  cpu->steady = NULL;
+  cpu->series = NULL;
+  cpu->telemetry = NULL;
+  cpu->logger = NULL;
+  cpu->core = NULL;
+  cpu->event_hook = NULL;
+
+  cpu->code_memory = malloc(sizeof(APEX_Instruction) * src->code_memory_size);
+  if (!cpu->code_memory) {
+    free(cpu);
+    return NULL;
   }
-  else{
-    ENABLE_DEBUG_MESSAGES=1;
+  memcpy(cpu->code_memory, src->code_memory, sizeof(APEX_Instruction) * src->code_memory_size);
+  return cpu;
+}
+
+/*
+ *  Simulates one clock cycle of the APEX pipeline.
+ *  Returns 1 once the simulation is complete, 0 otherwise.
+ */
+int APEX_cpu_cycle(APEX_CPU* cpu)
+{
+  cpu->stall_stage = 0;
+  if(cpu->clock>=cpu->num_stages){
+    stageScoreBoard(cpu);
+  }
+  if (cpu->profile) {
+    profile_begin_cycle(cpu);
   }
-  
-  for(int i=0;i<cycles;i++){
 
-    if(i>=7){
-      stageScoreBoard(cpu);
+  if (cpu->debug && cpu->logger) {
+    logger_cycle(cpu->logger, cpu->clock+1);
+  }
+  else if (cpu->debug) {
+    printf("--------------------------------\n");
+    printf("Clock Cycle #: %d\n", cpu->clock+1);
+    printf("--------------------------------\n");
+  }
+
+  writeback(cpu);
+  for (int i = cpu->wb - 1; i > cpu->mem1; --i) {
+    memoryN(cpu, i);
+  }
+  memory1(cpu);
+  if (cpu->dram.channels) {
+    dram_schedule(cpu);
+  }
+  for (int i = cpu->mem1 - 1; i > EX1; --i) {
+    executeN(cpu, i);
+  }
+  execute1(cpu);
+
+  decode(cpu);
+  fetch(cpu);
+  if (cpu->profile) {
+    profile_end_cycle(cpu);
+  }
+  if (cpu->steady) {
+    steady_end_cycle(cpu);
+  }
+
+  /* One cause per stall cycle, a held stage first */
+  if (cpu->stall_stage) {
+    cpu->hold_stalls++;
+  }
+  else if (cpu->stage[DRF].stalled) {
+    cpu->raw_stalls++;
+  }
+  else if (cpu->branchEncountered) {
+    cpu->branch_stalls++;
+  }
+  if (cpu->event_hook) {
+    if (cpu->stage[DRF].stalled || cpu->branchEncountered) {
+      cpu->event_hook(cpu, APEX_EVENT_STALL, &cpu->stage[DRF]);
+    }
+    if (cpu->stall_stage) {
+      cpu->event_hook(cpu, APEX_EVENT_STALL, &cpu->stage[cpu->stall_stage]);
     }
+  }
 
-    if (ENABLE_DEBUG_MESSAGES) {
-      printf("--------------------------------\n");
-      printf("Clock Cycle #: %d\n", cpu->clock+1);
-      printf("--------------------------------\n");
+  /* Done once the instructions behind DRF have drained after HALT */
+  if (cpu->ins_completed >= cpu->code_memory_size + cpu->num_stages - 2 && cpu->sb_count == 0) {
+    if(!cpu->quiet){
+      print_text(cpu, "(apex) >> Simulation Complete\n");
     }
+    return 1;
+  }
+  cpu->clock++;
+  if (cpu->series && cpu->clock >= cpu->series->next) {
+    series_sample(cpu, cpu->clock);
+  }
+  if (cpu->telemetry && cpu->clock >= cpu->telemetry->next) {
+    telemetry_update(cpu, TELEMETRY_RUNNING);
+  }
+  return 0;
+}
 
-    writeback(cpu);
-    memory2(cpu);
-    memory1(cpu);
-    execute2(cpu);
-    execute1(cpu);
-    
-    decode(cpu);
-    fetch(cpu);
-    
-    //printf("insCompleted=%d CodeMemorySize=%d\n",cpu->ins_completed,cpu->code_memory_size);
-    if (cpu->ins_completed >= cpu->code_memory_size+5) {
-      printf("(apex) >> Simulation Complete\n");
+/*
+ *  APEX CPU simulation loop
+ */
+int APEX_cpu_run(APEX_CPU* cpu, int cycles, int flag)
+{
+  if (cpu->fusion) {
+    fusion_baseline(cpu, cycles);
+  }
+  APEX_cpu_simulate(cpu, cycles, flag);
+  APEX_cpu_print_state(cpu);
+  return 0;
+}
+
+/*
+ *  Simulates up to cycles clock cycles and drains the store buffer.
+ *  Returns 1 if the program completed.
+ */
+int APEX_cpu_simulate(APEX_CPU* cpu, int cycles, int flag)
+{
+  int completed = 0;
+  for(int i=0;i<16;i++){
+     cpu->dup_regs[i]=0;
+  }
+  cpu->debug = flag != 0;
+  
+  /* Counted on the clock, loop extrapolation moves it forward */
+  int start = cpu->clock;
+  if (cpu->steady) {
+    cpu->steady->budget = start + cycles;
+  }
+  while(cpu->clock - start < cycles){
+    if(APEX_cpu_cycle(cpu)){
+      completed = 1;
       break;
     }
-    cpu->clock++;
   }    
+  lsq_flush(cpu);
+  if (cpu->series) {
+    series_sample(cpu, completed ? cpu->clock + 1 : cpu->clock);
+  }
+  if (cpu->telemetry) {
+    telemetry_update(cpu, completed ? TELEMETRY_DONE : TELEMETRY_STOPPED);
+  }
+  /* What is printed after the run follows the display output */
+  if (cpu->logger) {
+    logger_drain(cpu->logger);
+  }
+  return completed;
+}
+
+/*
+ *  Prints the register file, data memory and enabled statistics at the
+ *  end of a run
+ */
+void APEX_cpu_print_state(APEX_CPU* cpu)
+{
   cpu->data_memory[4096]=0;
+  APEX_cpu_show_state(cpu);
+}
+
+/*
+ *  Prints the register file, data memory and enabled statistics without
+ *  changing the cpu, also in the middle of a run
+ */
+void APEX_cpu_show_state(APEX_CPU* cpu)
+{
     printf("\n================State of architectural register file=============\n");
   for(int i=0;i<=15;i++){
     if(cpu->regs_valid[i]){
@@ -616,7 +1439,7 @@ int APEX_cpu_run(APEX_CPU* cpu, int cycles, int flag)
   printf("=================================================================\n\n");
   
   printf("================State of Data Memory=============\n");
-  for(int i=0;i<=4096;i++)
+  for(int i=0;i<4096;i++)
   {
     if(cpu->data_memory[i] != 0){
       printf("|\tMEM[%d]\t|\tDataValue = %d\t|\n",i,cpu->data_memory[i]);
@@ -624,26 +1447,74 @@ int APEX_cpu_run(APEX_CPU* cpu, int cycles, int flag)
   }
   printf("=================================================");
   printf("\nOther data memories are 0.\n");
-  return 0;
+  if (cpu->lsq_size) {
+    lsq_print_stats(cpu);
+  }
+  if (cpu->dram.channels) {
+    dram_print(cpu);
+  }
+  if (cpu->profile) {
+    profile_print(cpu);
+  }
+  if (cpu->steady) {
+    steady_print(cpu);
+  }
+  if (cpu->fusion) {
+    fusion_print(cpu);
+  }
+  if (cpu->loops_retired) {
+    loop_print(cpu);
+  }
+  if (is_vector_program(cpu)) {
+    vector_print(cpu);
+  }
+}
+
+/*
+ *  Prints the latch of every stage as the next cycle finds it. The Fetch
+ *  latch keeps the last instruction fetched, so the next fetch is shown
+ *  by its pc instead.
+ */
+void APEX_cpu_print_stages(APEX_CPU* cpu)
+{
+  char name[32];
+  for (int i = cpu->wb; i >= DRF; --i) {
+    if (i == cpu->wb) {
+      strcpy(name, "Writeback");
+    }
+    else if (i == DRF) {
+      strcpy(name, "Decode/RF");
+    }
+    else {
+      stage_name(cpu, i, name);
+    }
+    print_stage_content(cpu, name, &cpu->stage[i]);
+  }
+  printf("%-15s: (I%d):(%d)\n", "Next fetch", get_code_index(cpu->pc), cpu->pc);
 }
 
 int stageScoreBoard(APEX_CPU* cpu){
-  cpu->stage[F].busy=0;
-  cpu->stage[DRF].busy=0;
-  cpu->stage[EX1].busy=0;
-  cpu->stage[EX2].busy=0;
-  cpu->stage[MEM1].busy=0;
-  cpu->stage[MEM2].busy=0;
-  cpu->stage[WB].busy=0;
+  for (int i = 0; i < cpu->num_stages; ++i) {
+    cpu->stage[i].busy=0;
+  }
   return 0;
 }
 bool shouldStall(APEX_CPU* cpu){
+  /* A fused ADDL supplies the base register of its load or store */
+  CPU_Stage* stage = &cpu->stage[DRF];
+  if(stage->fused == OP_ADDL){
+    return !cpu->regs_valid[stage->fused_rs1] || (compare_opcode(stage->opcode,"STORE") && stage->rs1 != stage->fused_rd && !cpu->regs_valid[stage->rs1]);
+  }
+  /* A LOOP from the loop buffer has its count from fetch */
+  if(stage->counted){
+    return false;
+  }
   if(compare_opcode(cpu->stage[DRF].opcode,"STR")){
     if(cpu->regs_valid[cpu->stage[DRF].rs1] && cpu->regs_valid[cpu->stage[DRF].rs2] && cpu->regs_valid[cpu->stage[DRF].rs3]){
       return false;
     }
   }
-  else if(compare_opcode(cpu->stage[DRF].opcode,"ADDL") || compare_opcode(cpu->stage[DRF].opcode,"SUBL") || compare_opcode(cpu->stage[DRF].opcode,"LOAD") || compare_opcode(cpu->stage[DRF].opcode,"JUMP")){
+  else if(compare_opcode(cpu->stage[DRF].opcode,"ADDL") || compare_opcode(cpu->stage[DRF].opcode,"SUBL") || compare_opcode(cpu->stage[DRF].opcode,"LOAD") || compare_opcode(cpu->stage[DRF].opcode,"JUMP") || compare_opcode(cpu->stage[DRF].opcode,"LOOP") || compare_opcode(cpu->stage[DRF].opcode,"VLOAD")){
     if(cpu->regs_valid[cpu->stage[DRF].rs1]){
       return false;
     }
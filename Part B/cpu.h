@@ -1,4 +1,5 @@
 #include <stdbool.h>
+#include <stddef.h>
 #ifndef _APEX_CPU_H_
 #define _APEX_CPU_H_
 /**
@@ -10,16 +11,62 @@
  *  State University of New York, Binghamton
  */
 
+/* Fixed front of the pipeline; execute, memory and writeback stages
+ * follow and are laid out by the pipeline configuration */
 enum
 {
   F,
   DRF,
-  EX1,
-  EX2,
-  MEM1,
-  MEM2,
-  WB,
-  NUM_STAGES
+  EX1
+};
+
+#define MAX_STAGES 16
+
+/* Numeric opcode, NOP is 0 so that a zeroed latch is a bubble */
+enum
+{
+  OP_NOP,
+  OP_MOVC,
+  OP_ADD,
+  OP_ADDL,
+  OP_SUB,
+  OP_SUBL,
+  OP_MUL,
+  OP_AND,
+  OP_OR,
+  OP_EXOR,
+  OP_LOAD,
+  OP_LDR,
+  OP_STORE,
+  OP_STR,
+  OP_BZ,
+  OP_BNZ,
+  OP_JUMP,
+  OP_HALT,
+  OP_LOOP,
+  OP_VLOAD,
+  OP_VSTORE,
+  OP_VADD,
+  OP_VSUB,
+  OP_VMUL,
+  OP_VAND,
+  OP_VOR,
+  NUM_OPCODES
+};
+
+/* Vector unit: NUM_VREGS registers of VECTOR_LANES 32-bit lanes. Vn is
+ * entry VREG_BASE + n of the register scoreboard, so hazards, forwarding
+ * and flushes track vector and integer registers alike */
+#define VECTOR_LANES 4
+#define NUM_VREGS 8
+#define VREG_BASE 16
+
+/* Pipeline events reported to an embedding program */
+enum
+{
+  APEX_EVENT_COMMIT,	// Instruction retired in writeback
+  APEX_EVENT_STALL,	// Instruction held in its stage this cycle
+  APEX_EVENT_FLUSH	// Taken branch squashed the younger instructions
 };
 
 /* Format of an APEX instruction  */
@@ -49,10 +96,96 @@ typedef struct CPU_Stage
   int buffer;		// Latch to hold some value
   int mem_address;	// Computed Memory Address
   int mem_address_value; // Value at the computed memory address
+  int seq;		    // Fetch order of the instruction
+  int tid;		    // Hardware thread of the instruction
+  int elapsed;		    // Cycles already spent in a multi-cycle stage
+  int fused;		    // Opcode of the instruction fused into the latch, OP_NOP if none
+  int fused_pc;		    // PC of the fused instruction
+  int fused_rd;		    // Destination of a fused ADDL
+  int fused_rs1;	    // Source of a fused ADDL
+  int fused_imm;	    // Literal of a fused ADDL, offset of a fused branch
+  int fused_value;	    // Result of a fused ADDL
+  int predicted;	    // LOOP fetched from the loop buffer, see loop.h
+  int counted;		    // LOOP whose count register fetch supplied in rs1_value
+  int vbuffer[VECTOR_LANES]; // Vector result, or the lanes a VSTORE writes
   int busy;		    // Flag to indicate, stage is performing some action
   int stalled;		// Flag to indicate, stage is stalled
 } CPU_Stage;
 
+/* Entry of the store buffer in the load/store queue */
+typedef struct Store_Buffer_Entry
+{
+  int address;		    // Data memory address
+  int value;		    // Value to be written
+} Store_Buffer_Entry;
+
+#define MAX_STORE_BUFFER 64
+
+#define MAX_LOOP_BUFFER 64
+
+/* Loop buffer of fetch, holds the body of the last LOOP taken and the LOOP */
+typedef struct Loop_Buffer
+{
+  APEX_Instruction body[MAX_LOOP_BUFFER];
+  int head;		    // PC of the first instruction of the body
+  int end;		    // PC of the LOOP
+  int reg;		    // Count register of the LOOP
+  int count;		    // Count register as the next LOOP fetched reads it
+  int counted;		    // The body does not write reg, fetch supplies the count to the LOOP
+  int armed;		    // Fetch reads the body from the buffer and redirects at the LOOP
+} Loop_Buffer;
+
+#define MAX_DRAM_CHANNELS 4
+#define MAX_DRAM_BANKS 16
+#define MAX_DRAM_QUEUE 32
+
+/* Bank of the DRAM model */
+typedef struct DRAM_Bank
+{
+  int open_row;		    // Row in the row buffer, -1 when precharged
+  int ready;		    // Cycle the bank takes its next command
+} DRAM_Bank;
+
+/* Access waiting in the DRAM request queue */
+typedef struct DRAM_Request
+{
+  int address;		    // Data memory address
+  int write;
+  int demand;		    // MEM1 waits for it, otherwise a store buffer drain
+  int arrival;		    // Cycle it was queued
+} DRAM_Request;
+
+/* DRAM behind data memory, see dram.c */
+typedef struct DRAM_Model
+{
+  int channels;		    // 0 for single-cycle memory
+  int banks;		    // Banks per channel
+  int row_words;	    // Words in a row
+  int closed_page;	    // Precharge after every access instead of keeping the row open
+  int tRCD;		    // Activate to column command
+  int tCAS;		    // Column command to data
+  int tRP;		    // Precharge to activate
+  int queue_size;
+  DRAM_Bank bank[MAX_DRAM_CHANNELS][MAX_DRAM_BANKS];
+  int bus_free[MAX_DRAM_CHANNELS];	// Cycle the data bus of a channel is free
+  DRAM_Request queue[MAX_DRAM_QUEUE];	// Oldest first
+  int queued;
+  int scheduled;	    // Clock + 1 of the last cycle the queue was scheduled
+  int waiting;		    // The access in MEM1 is queued or in flight
+  int demand_words;	    // Words of it queued or skipped so far
+  int demand_left;	    // Words of it queued and not issued yet
+  int demand_ready;	    // Cycle the data of its last word arrives
+  int reads;
+  int writes;
+  int row_hits;		    // Accesses to the open row
+  int row_empty;	    // Accesses to a precharged bank
+  int row_conflicts;	    // Accesses that closed another row first
+  long read_latency;	    // Cycles from queueing to data, summed over reads
+  long write_latency;
+  int queue_full_stalls;    // Cycles MEM1 waited for a free queue entry
+  int stall_cycles;	    // Cycles MEM1 waited for the DRAM
+} DRAM_Model;
+
 /* Model of APEX CPU */
 typedef struct APEX_CPU
 {
@@ -66,8 +199,64 @@ typedef struct APEX_CPU
   int regs[32];
   int regs_valid[32];
 
-  /* Array of 5 CPU_stage */
-  CPU_Stage stage[7];
+  /* Pipeline stages, laid out by the configuration */
+  CPU_Stage stage[MAX_STAGES];
+  int num_stages;		// F, DRF, execute, memory and WB stages
+  int mem1;			// Index of the first memory stage
+  int wb;			// Index of the writeback stage
+  int branch_stage;		// Index of the stage that resolves branches
+  int branch_stall;		// Cycles BZ/BNZ wait in DRF after the flag producer leaves EX1
+  int forward[MAX_STAGES];	// Stages whose results are forwarded
+  int latency[NUM_OPCODES];	// Cycles spent in EX1 per opcode
+
+  /* Pipeline control state */
+  int zeroFlag;
+  int haltEncountered;
+  int printedOnce;
+  int branchTaken;
+  int branchEncountered;
+  int flag_seq;		// Youngest instruction past EX1 that sets the zero flag
+  int dup_regs[32];	// Forwarded register values
+  int reg_seq[32];	// Youngest writer of each register past EX1
+  int fetch_seq;	// Instructions fetched
+  int tid;		// Hardware thread whose context is loaded, see smt.c
+  int commit_regs[32];	// Register values of retired instructions
+  int commit_zeroFlag;	// Zero flag of retired instructions
+  int quiet;		// Suppress flush and halt notices
+  int debug;		// Print the stage contents every cycle
+  int stall_stage;	// Stage holding its instruction this cycle, stages before it hold too
+
+  /* Load/store queue, disabled when lsq_size is 0 */
+  int lsq_size;
+  Store_Buffer_Entry store_buffer[MAX_STORE_BUFFER];
+  int sb_head;
+  int sb_count;
+  int store_latency;	// Cycles a drained store holds the data memory port
+  int sb_port_free;	// Clock cycle the port is free of the store being written
+
+  /* Macro-op fusion in decode, disabled when fusion is 0 */
+  int fusion;
+  int fused_branches;	// Compare-and-branch pairs retired
+  int fused_addresses;	// ADDL and load/store pairs retired
+  int fusion_baseline;	// Cycles of the same run without fusion, 0 if not measured
+
+  /* Loop buffer for LOOP bodies, disabled when loop_buffer_size is 0 */
+  int loop_buffer_size;		// Instructions it holds, the LOOP included
+  Loop_Buffer loop;
+  int loop_hits;		// Instructions fetched from the loop buffer
+  int loop_redirects;		// Iterations fetch started at the LOOP, without a flush
+  int loop_mispredicts;		// LOOPs that did not go the way fetch took them
+  int loops_retired;		// LOOP instructions retired
+
+  /* DRAM timing of data memory, disabled when dram.channels is 0 */
+  DRAM_Model dram;
+
+  /* Vector register file, indexed by Vn */
+  int vregs[NUM_VREGS][VECTOR_LANES];	// Values of retired instructions
+  int dup_vregs[NUM_VREGS][VECTOR_LANES];	// Forwarded values
+  int vector_ops;		// VADD/VSUB/VMUL/VAND/VOR retired
+  int vector_loads;		// VLOAD retired
+  int vector_stores;		// VSTORE retired
 
   /* Code Memory where instructions are stored */
   APEX_Instruction* code_memory;
@@ -78,15 +267,76 @@ typedef struct APEX_CPU
 
   /* Some stats */
   int ins_completed;
+  int ins_retired;	// Instructions that reached writeback, HALT once
+  int halt_retired;	// A HALT has reached writeback
+  int lsq_stores;
+  int lsq_loads;
+  int lsq_forwards;
+  int lsq_drains;
+  int lsq_full_stalls;
+  int lsq_port_stalls;	// Cycles a load in MEM1 waited for a store to be written
+  int raw_stalls;	// Cycles DRF waited for a source register
+  int branch_stalls;	// Cycles DRF held a BZ/BNZ for the zero flag, or a HALT behind a branch
+  int hold_stalls;	// Cycles a stage held the pipeline: EX1 latency, full store buffer, bus
+  int flushes;		// Taken branches and jumps
+  int mem_loads;	// LOAD/LDR that read memory or the store buffer
+  int mem_stores;	// STORE/STR that wrote memory or the store buffer
+
+  /* Per-instruction profile, NULL when profiling is off */
+  struct APEX_Profile* profile;
+
+  /* Loop steady-state detector, NULL when extrapolation is off */
+  struct APEX_Steady* steady;
+
+  /* Interval time series, NULL when not recorded */
+  struct APEX_Series* series;
+
+  /* Live telemetry page, NULL when not published */
+  struct APEX_Telemetry* telemetry;
+
+  /* Asynchronous writer of the display output, NULL to print directly */
+  struct APEX_Logger* logger;
+
+  /* Private cache of a multicore core, NULL for a single core */
+  struct APEX_Core* core;
+
+  /* Event hook of the embedding API, NULL when unused */
+  void (*event_hook)(struct APEX_CPU* cpu, int event, CPU_Stage* stage);
+  void* event_data;
 
 } APEX_CPU;
 
 APEX_Instruction* create_code_memory(const char* filename, int* size);
 
+int get_opcode_id(const char* opcode);
+
+const char* get_opcode_name(int id);
+
+APEX_Instruction* create_code_memory_from_buffer(const char* text, size_t length, int* size);
+
 APEX_CPU* APEX_cpu_init(const char* filename);
 
+APEX_CPU* APEX_cpu_init_code(APEX_Instruction* code_memory, int size);
+
+APEX_CPU* APEX_cpu_clone(const APEX_CPU* src);
+
+int APEX_cpu_cycle(APEX_CPU* cpu);
+
 int APEX_cpu_run(APEX_CPU* cpu, int cycles, int flag);
 
+int APEX_cpu_simulate(APEX_CPU* cpu, int cycles, int flag);
+
+void APEX_cpu_print_state(APEX_CPU* cpu);
+
+void APEX_cpu_show_state(APEX_CPU* cpu);
+
+void APEX_cpu_print_stages(APEX_CPU* cpu);
+
+/* Room format_stage_content needs for a line */
+#define APEX_STAGE_LINE 320
+
+int format_stage_content(char* out, const char* name, CPU_Stage* stage);
+
 void APEX_cpu_stop(APEX_CPU* cpu);
 
 int fetch(APEX_CPU* cpu);
@@ -95,11 +345,11 @@ int decode(APEX_CPU* cpu);
 
 int execute1(APEX_CPU* cpu);
 
-int execute2(APEX_CPU* cpu);
+int executeN(APEX_CPU* cpu, int index);
 
 int memory1(APEX_CPU* cpu);
 
-int memory2(APEX_CPU* cpu);
+int memoryN(APEX_CPU* cpu, int index);
 
 int writeback(APEX_CPU* cpu);
 
@@ -108,4 +358,6 @@ int stageScoreBoard(APEX_CPU* cpu);
 bool shouldStall(APEX_CPU* cpu);
 
 bool compare_opcode(char opcode1[128],char opcode2[128]);
+
+int get_code_index(int pc);
 #endif
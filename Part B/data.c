@@ -0,0 +1,90 @@
+/*
+ *  data.c
+ *  Contains the initial data images.
+ *
+ *  The file is mapped private and read-only, so the simulators of a batch
+ *  that start from the same dataset read the same page cache pages and
+ *  none of them reads the file into a buffer of its own. Loading copies
+ *  the words into the data memory of the cpu, which stores then change
+ *  without touching the file or the other simulators.
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "data.h"
+
+/*
+ * Maps the image in filename.
+ * Returns NULL, with a message, if it cannot be read or does not fit data
+ * memory.
+ */
+APEX_Data_Image* data_image_open(const char* filename)
+{
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "APEX_Error : Unable to open %s\n", filename);
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    fprintf(stderr, "APEX_Error : Unable to read %s\n", filename);
+    close(fd);
+    return NULL;
+  }
+  if (st.st_size % sizeof(int) || st.st_size > (off_t)(DATA_IMAGE_WORDS * sizeof(int))) {
+    fprintf(stderr, "APEX_Error : %s must hold whole 4-byte words, at most %d\n", filename, DATA_IMAGE_WORDS);
+    close(fd);
+    return NULL;
+  }
+  APEX_Data_Image* image = calloc(1, sizeof(APEX_Data_Image));
+  if (!image) {
+    close(fd);
+    return NULL;
+  }
+  image->length = st.st_size;
+  image->num_words = st.st_size / sizeof(int);
+  if (image->length) {
+    void* words = mmap(NULL, image->length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (words == MAP_FAILED) {
+      fprintf(stderr, "APEX_Error : Unable to map %s\n", filename);
+      close(fd);
+      free(image);
+      return NULL;
+    }
+    image->words = words;
+  }
+  close(fd);
+  return image;
+}
+
+/*
+ * Sets data memory to the image, words past its end to 0.
+ */
+void data_image_load(const APEX_Data_Image* image, APEX_CPU* cpu)
+{
+  size_t bytes = image->num_words * sizeof(int);
+  if (bytes) {
+    memcpy(cpu->data_memory, image->words, bytes);
+  }
+  memset((char*)cpu->data_memory + bytes, 0, sizeof(cpu->data_memory) - bytes);
+}
+
+void data_image_close(APEX_Data_Image* image)
+{
+  if (!image) {
+    return;
+  }
+  if (image->words) {
+    munmap((void*)image->words, image->length);
+  }
+  free(image);
+}
@@ -0,0 +1,36 @@
+#ifndef _APEX_DATA_H_
+#define _APEX_DATA_H_
+/**
+ *  data.h
+ *  Contains the initial data images: binary files of data memory words
+ *  mapped read-only and copied into a cpu before it runs
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stddef.h>
+
+#include "cpu.h"
+
+/* Words of data memory an image can fill */
+#define DATA_IMAGE_WORDS 4096
+
+/*
+ * A mapped image. Word i is the 32-bit integer, in host byte order, at
+ * byte 4 * i of the file and goes to data memory address i.
+ */
+typedef struct APEX_Data_Image
+{
+  const int* words;		    // Mapping of the file, NULL when empty
+  int num_words;
+  size_t length;		    // Bytes mapped
+} APEX_Data_Image;
+
+APEX_Data_Image* data_image_open(const char* filename);
+
+void data_image_load(const APEX_Data_Image* image, APEX_CPU* cpu);
+
+void data_image_close(APEX_Data_Image* image);
+
+#endif
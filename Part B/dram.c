@@ -0,0 +1,234 @@
+/*
+ *  dram.c
+ *  Contains the DRAM timing model. Consecutive rows of row_words words
+ *  are spread over the channels, then over the banks of a channel, so a
+ *  sequential walk stays in one row before it moves on.
+ *
+ *  An access to the open row of its bank takes tCAS cycles, one to a
+ *  precharged bank tRCD + tCAS and one that has to close another row
+ *  first tRP + tRCD + tCAS. An open-page bank keeps the row open after a
+ *  column command; a closed-page bank precharges right after it and takes
+ *  its next activate tRP cycles later. The data of a channel comes back
+ *  one access per cycle.
+ *
+ *  Every cycle each channel issues at most one queued access to a bank
+ *  that is ready: the oldest row hit, otherwise the oldest access
+ *  (FR-FCFS). The load or store in MEM1 waits in the queue with the
+ *  stores the store buffer drains, and MEM1 holds it until its data
+ *  arrives; the MEM1 cycle itself counts as the first cycle of the
+ *  latency. A VLOAD or VSTORE queues one access per lane, as many as fit,
+ *  and MEM1 holds it until the last lane arrives. Drained stores are
+ *  posted: data memory is written when they are queued and neither MEM1
+ *  nor the store buffer waits for them, so the buffer keeps posting one
+ *  store a cycle until the queue is full.
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dram.h"
+#include "lsq.h"
+
+/*
+ * Default geometry and timing, with the model off.
+ */
+void dram_default(DRAM_Model* dram)
+{
+  memset(dram, 0, sizeof(*dram));
+  dram->banks = 8;
+  dram->row_words = 64;
+  dram->tRCD = 5;
+  dram->tCAS = 5;
+  dram->tRP = 5;
+  dram->queue_size = 8;
+  for (int c = 0; c < MAX_DRAM_CHANNELS; ++c) {
+    for (int b = 0; b < MAX_DRAM_BANKS; ++b) {
+      dram->bank[c][b].open_row = -1;
+    }
+  }
+}
+
+/*
+ * Channel, bank and row of a data memory address.
+ */
+static DRAM_Bank* locate(DRAM_Model* dram, int address, int* channel, int* row)
+{
+  int rows = address / dram->row_words;
+  *channel = rows % dram->channels;
+  *row = rows / dram->channels / dram->banks;
+  return &dram->bank[*channel][rows / dram->channels % dram->banks];
+}
+
+static void enqueue(APEX_CPU* cpu, int address, int write, int demand)
+{
+  DRAM_Request* request = &cpu->dram.queue[cpu->dram.queued++];
+  request->address = address;
+  request->write = write;
+  request->demand = demand;
+  request->arrival = cpu->clock;
+}
+
+/*
+ * Sends request to its bank and returns the cycle its data arrives.
+ */
+static int issue(APEX_CPU* cpu, DRAM_Request* request)
+{
+  DRAM_Model* dram = &cpu->dram;
+  int channel, row;
+  DRAM_Bank* bank = locate(dram, request->address, &channel, &row);
+
+  int column = cpu->clock;
+  if (bank->open_row == row) {
+    dram->row_hits++;
+  }
+  else if (bank->open_row < 0) {
+    dram->row_empty++;
+    column += dram->tRCD;
+  }
+  else {
+    dram->row_conflicts++;
+    column += dram->tRP + dram->tRCD;
+  }
+  int done = column + dram->tCAS;
+  if (done < dram->bus_free[channel]) {
+    done = dram->bus_free[channel];
+  }
+  dram->bus_free[channel] = done + 1;
+
+  if (dram->closed_page) {
+    bank->open_row = -1;
+    bank->ready = column + (dram->tRP > 0 ? dram->tRP : 1);
+  }
+  else {
+    bank->open_row = row;
+    bank->ready = column + 1;
+  }
+
+  if (request->write) {
+    dram->writes++;
+    dram->write_latency += done - request->arrival;
+  }
+  else {
+    dram->reads++;
+    dram->read_latency += done - request->arrival;
+  }
+  return done;
+}
+
+/*
+ * Issues at most one queued access per channel, once per cycle.
+ */
+void dram_schedule(APEX_CPU* cpu)
+{
+  DRAM_Model* dram = &cpu->dram;
+  if (dram->scheduled == cpu->clock + 1) {
+    return;
+  }
+  dram->scheduled = cpu->clock + 1;
+
+  for (int c = 0; c < dram->channels; ++c) {
+    int pick = -1, pick_hit = 0;
+    for (int i = 0; i < dram->queued && !pick_hit; ++i) {
+      int channel, row;
+      DRAM_Bank* bank = locate(dram, dram->queue[i].address, &channel, &row);
+      if (channel != c || bank->ready > cpu->clock) {
+        continue;
+      }
+      if (pick < 0 || bank->open_row == row) {
+        pick = i;
+        pick_hit = bank->open_row == row;
+      }
+    }
+    if (pick < 0) {
+      continue;
+    }
+    DRAM_Request request = dram->queue[pick];
+    memmove(&dram->queue[pick], &dram->queue[pick + 1], sizeof(DRAM_Request) * (dram->queued - pick - 1));
+    dram->queued--;
+    int done = issue(cpu, &request);
+    if (request.demand) {
+      dram->demand_left--;
+      if (done > dram->demand_ready) {
+        dram->demand_ready = done;
+      }
+    }
+  }
+}
+
+/*
+ * Queues the words accesses of the instruction in MEM1 from address up,
+ * or checks on them. Words outside data memory and words a load takes
+ * from the store buffer are not queued.
+ * Returns 1 once all their data has arrived, 0 while MEM1 holds it.
+ */
+int dram_access(APEX_CPU* cpu, int address, int words, int write)
+{
+  DRAM_Model* dram = &cpu->dram;
+  if (!dram->waiting) {
+    dram->waiting = 1;
+    dram->demand_words = 0;
+    dram->demand_left = 0;
+    dram->demand_ready = -1;
+  }
+  while (dram->demand_words < words) {
+    int word = address + dram->demand_words;
+    if (word >= 0 && word < 4096 && (write || !cpu->lsq_size || !lsq_holds(cpu, word))) {
+      if (dram->queued == dram->queue_size) {
+        break;
+      }
+      enqueue(cpu, word, write, 1);
+      dram->demand_left++;
+    }
+    dram->demand_words++;
+  }
+  if (dram->demand_words < words) {
+    dram->queue_full_stalls++;
+  }
+  dram_schedule(cpu);
+  if (dram->demand_words == words && dram->demand_left == 0 && cpu->clock + 1 >= dram->demand_ready) {
+    dram->waiting = 0;
+    return 1;
+  }
+  dram->stall_cycles++;
+  return 0;
+}
+
+/*
+ * Queues a store drained from the store buffer.
+ * Returns false if the queue is full.
+ */
+bool dram_post_write(APEX_CPU* cpu, int address)
+{
+  DRAM_Model* dram = &cpu->dram;
+  if (address < 0 || address >= 4096) {
+    return true;
+  }
+  if (dram->queued == dram->queue_size) {
+    return false;
+  }
+  enqueue(cpu, address, 1, 0);
+  return true;
+}
+
+void dram_print(APEX_CPU* cpu)
+{
+  DRAM_Model* dram = &cpu->dram;
+  int accesses = dram->row_hits + dram->row_empty + dram->row_conflicts;
+  printf("================DRAM=============\n");
+  printf("Geometry             : %d channel(s) x %d banks, %d-word rows, %s page\n", dram->channels, dram->banks, dram->row_words, dram->closed_page ? "closed" : "open");
+  printf("tRCD-tCAS-tRP        : %d-%d-%d\n", dram->tRCD, dram->tCAS, dram->tRP);
+  printf("Reads                : %d\n", dram->reads);
+  printf("Writes               : %d\n", dram->writes);
+  printf("Row hits             : %d (%.1f%%)\n", dram->row_hits, accesses ? 100.0 * dram->row_hits / accesses : 0.0);
+  printf("Row empty            : %d\n", dram->row_empty);
+  printf("Row conflicts        : %d\n", dram->row_conflicts);
+  printf("Average read latency : %.2f cycles\n", dram->reads ? (double)dram->read_latency / dram->reads : 0.0);
+  printf("Average write latency: %.2f cycles\n", dram->writes ? (double)dram->write_latency / dram->writes : 0.0);
+  printf("MEM1 stall cycles    : %d\n", dram->stall_cycles);
+  printf("Queue full stalls    : %d\n", dram->queue_full_stalls);
+  printf("=================================\n");
+}
@@ -0,0 +1,25 @@
+#ifndef _APEX_DRAM_H_
+#define _APEX_DRAM_H_
+/**
+ *  dram.h
+ *  Contains the DRAM timing model behind data memory: channels of banks
+ *  with a row buffer each, scheduled first-ready first-come-first-served
+ *  from a small request queue
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include "cpu.h"
+
+void dram_default(DRAM_Model* dram);
+
+int dram_access(APEX_CPU* cpu, int address, int words, int write);
+
+bool dram_post_write(APEX_CPU* cpu, int address);
+
+void dram_schedule(APEX_CPU* cpu);
+
+void dram_print(APEX_CPU* cpu);
+
+#endif
@@ -0,0 +1,396 @@
+/*
+ *  estimate.c
+ *  Contains the analytical cycle estimator. The program runs once on the
+ *  functional model, and the cycle each dynamic instruction enters DRF
+ *  is computed from the instructions before it instead of simulating
+ *  every stage:
+ *
+ *  - in order, one instruction a cycle, behind the EX1 latency of the one
+ *    before it.
+ *  - a source register is ready in DRF the cycle its producer reaches the
+ *    first stage that forwards it. An instruction that finds one not ready
+ *    stalls until writeback releases DRF: it moves on the first cycle an
+ *    older instruction is in writeback with all its sources ready.
+ *  - BZ/BNZ wait in DRF for branch_stall cycles after the flag producer
+ *    leaves EX1, HALT waits for the branches before it to resolve.
+ *  - a taken branch, jump or LOOP resolves in the branch stage and the
+ *    target is fetched the cycle after, a LOOP the loop buffer predicts
+ *    does not redirect and does not wait for its count register. The
+ *    bubble of the flush reads R0 in DRF and stalls like an instruction.
+ *
+ *  The load/store queue, fusion and the DRAM are not modelled.
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "estimate.h"
+#include "functional.h"
+
+/* Writeback cycles kept for the release of a stalled DRF, a power of two
+ * larger than the instructions in flight */
+#define ESTIMATE_WINDOW 64
+
+/* Timing of a static instruction */
+typedef struct Estimate_Ins
+{
+  int op;		    // Numeric opcode
+  int latency;		    // Cycles in EX1
+  int src[3];		    // Registers read in DRF
+  int num_src;
+  int rd;		    // Register written, -1 if none
+  int forward;		    // Cycles after EX1 until rd is forwarded
+  int sets_flag;	    // Writes the zero flag
+} Estimate_Ins;
+
+static int max(int a, int b)
+{
+  return a > b ? a : b;
+}
+
+static void describe(const APEX_CPU* cpu, const APEX_Instruction* ins, Estimate_Ins* e)
+{
+  int op = get_opcode_id(ins->opcode);
+  e->op = op;
+  e->latency = cpu->latency[op] > 1 ? cpu->latency[op] : 1;
+  e->num_src = 0;
+  e->rd = -1;
+  e->sets_flag = op == OP_ADD || op == OP_ADDL || op == OP_SUB || op == OP_SUBL || op == OP_MUL;
+
+  /* Same groups as shouldStall */
+  switch (op) {
+  case OP_STR:
+    e->src[e->num_src++] = ins->rs3;
+    /* fall through */
+  case OP_ADD: case OP_SUB: case OP_MUL: case OP_AND: case OP_OR: case OP_EXOR: case OP_LDR: case OP_STORE:
+  case OP_VSTORE: case OP_VADD: case OP_VSUB: case OP_VMUL: case OP_VAND: case OP_VOR:
+    e->src[e->num_src++] = ins->rs2;
+    /* fall through */
+  case OP_ADDL: case OP_SUBL: case OP_LOAD: case OP_JUMP: case OP_LOOP: case OP_VLOAD:
+    e->src[e->num_src++] = ins->rs1;
+    break;
+  default:
+    break;
+  }
+
+  switch (op) {
+  case OP_MOVC: case OP_ADD: case OP_ADDL: case OP_SUB: case OP_SUBL: case OP_MUL: case OP_AND: case OP_OR:
+  case OP_EXOR: case OP_LOAD: case OP_LDR: case OP_LOOP:
+  case OP_VLOAD: case OP_VADD: case OP_VSUB: case OP_VMUL: case OP_VAND: case OP_VOR:
+    e->rd = ins->rd;
+    break;
+  default:
+    break;
+  }
+
+  /* A load has no result before MEM1, without forwarding it is ready in WB */
+  int k = (op == OP_LOAD || op == OP_LDR || op == OP_VLOAD) ? cpu->mem1 : EX1;
+  while (k < cpu->wb && !cpu->forward[k]) {
+    k++;
+  }
+  e->forward = k - EX1;
+}
+
+/*
+ * Returns true if the LOOP body of length imm before index does not write
+ * its count register.
+ */
+static int body_counted(const APEX_CPU* cpu, const Estimate_Ins* info, int index, int reg)
+{
+  for (int i = index - cpu->code_memory[index].imm; i < index; ++i) {
+    if (info[i].rd == reg) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/*
+ * Returns the cycle a stalled DRF is released from first on: the oldest
+ * instruction in flight that writes back then or later.
+ */
+static int released(const int* window, long count, int first)
+{
+  long i = count - 1;
+  while (i > 0 && i > count - ESTIMATE_WINDOW && window[(i - 1) & (ESTIMATE_WINDOW - 1)] >= first) {
+    i--;
+  }
+  return window[i & (ESTIMATE_WINDOW - 1)];
+}
+
+/* ins_completed of the cycle model, replayed in cycle order. Writeback
+ * adds the instructions it retires, a branch that redirects fetch sets it
+ * to the index of the next instruction when it resolves, and the run ends
+ * the first cycle it covers the program and the stages behind it */
+typedef struct Estimate_Count
+{
+  long value;			// ins_completed
+  long limit;			// Value that ends the run
+  long retired;			// Writeback cycles of the window applied
+  int reset_at[ESTIMATE_WINDOW];	// Cycles branches resolve
+  int reset_to[ESTIMATE_WINDOW];	// Values they set
+  long resets;
+  long applied;			// Resets applied
+} Estimate_Count;
+
+/*
+ * Applies the writebacks and resets before cycle until.
+ * Returns the cycle the run ends, -1 if it goes on.
+ */
+static int count_until(Estimate_Count* c, const int* window, long count, int until)
+{
+  while (1) {
+    int t = until;
+    if (c->retired < count && window[c->retired & (ESTIMATE_WINDOW - 1)] < t) {
+      t = window[c->retired & (ESTIMATE_WINDOW - 1)];
+    }
+    if (c->applied < c->resets && c->reset_at[c->applied & (ESTIMATE_WINDOW - 1)] < t) {
+      t = c->reset_at[c->applied & (ESTIMATE_WINDOW - 1)];
+    }
+    if (t == until) {
+      return -1;
+    }
+    /* Writeback comes before the branch stage in a cycle */
+    while (c->retired < count && window[c->retired & (ESTIMATE_WINDOW - 1)] == t) {
+      c->value++;
+      c->retired++;
+    }
+    while (c->applied < c->resets && c->reset_at[c->applied & (ESTIMATE_WINDOW - 1)] == t) {
+      c->value = c->reset_to[c->applied & (ESTIMATE_WINDOW - 1)];
+      c->applied++;
+    }
+    if (c->value >= c->limit) {
+      return t;
+    }
+  }
+}
+
+/*
+ * Estimates the cycles cpu takes to run its program, at most cycles.
+ * Returns 0, or 1 if there is no memory for the model.
+ */
+int APEX_estimate(const APEX_CPU* cpu, int cycles, APEX_Estimate* result)
+{
+  APEX_Func_State* st = malloc(sizeof(APEX_Func_State));
+  Estimate_Ins* info = malloc(sizeof(Estimate_Ins) * (cpu->code_memory_size + 1));
+  Estimate_Count* completed = calloc(1, sizeof(Estimate_Count));
+  if (!st || !info || !completed) {
+    free(st);
+    free(info);
+    free(completed);
+    return 1;
+  }
+  for (int i = 0; i < cpu->code_memory_size; ++i) {
+    describe(cpu, &cpu->code_memory[i], &info[i]);
+  }
+  /* Fetching past the end of code memory yields HALT */
+  memset(&info[cpu->code_memory_size], 0, sizeof(Estimate_Ins));
+  info[cpu->code_memory_size].op = OP_HALT;
+  info[cpu->code_memory_size].latency = 1;
+  info[cpu->code_memory_size].rd = -1;
+
+  APEX_func_init(st, cpu);
+  memset(result, 0, sizeof(*result));
+  result->cycles = cycles;
+  completed->limit = cpu->code_memory_size + cpu->num_stages - 2;
+
+  int ready[32];		// Cycle DRF first sees the register valid
+  int release[32];		// First cycle writeback may release DRF for it
+  int window[ESTIMATE_WINDOW];	// Writeback cycles of the youngest instructions
+  long count = 0;
+  for (int i = 0; i < 32; ++i) {
+    ready[i] = release[i] = 0;
+  }
+
+  int wb_distance = cpu->wb - EX1;
+  int flag_ready = 0;		// First cycle BZ/BNZ may leave DRF
+  int halt_ready = 0;		// First cycle HALT may leave DRF
+  int redirect = -2;		// Cycle the last taken branch resolved
+  int decoded = 0;		// Cycle the last instruction left DRF
+  int ex1_done = 0;		// Last cycle of the last instruction in EX1
+  int armed = 0, loop_end = 0, loop_reg = 0, loop_count = 0, loop_counted = 0;
+
+  while (1) {
+    int index = get_code_index(st->pc);
+    if (index < 0 || index > cpu->code_memory_size) {
+      index = cpu->code_memory_size;
+    }
+    Estimate_Ins* ins = &info[index];
+    int predicted = ins->op == OP_LOOP && armed && st->pc == loop_end;
+
+    /* Cycle it is in DRF with EX1 free */
+    int d = max(max(decoded + 1, ex1_done), redirect + 2);
+    if (ins->op == OP_HALT) {
+      result->flag_stalls += max(halt_ready - d, 0);
+      d = max(d, halt_ready);
+    }
+    else if ((ins->op == OP_BZ || ins->op == OP_BNZ) && cpu->branch_stage != DRF) {
+      result->flag_stalls += max(flag_ready - d, 0);
+      d = max(d, flag_ready);
+    }
+    else if (!(predicted && loop_counted)) {
+      int stall = 0, first = d + 1;
+      for (int i = 0; i < ins->num_src; ++i) {
+        stall = stall || ready[ins->src[i]] > d;
+        first = max(first, release[ins->src[i]]);
+      }
+      if (stall) {
+        /* The producer is among the instructions in flight */
+        int r = released(window, count, first);
+        result->raw_stalls += r - d;
+        d = r;
+      }
+    }
+
+    /* Nothing younger retires or resolves before d */
+    int end = count_until(completed, window, count, d < cycles ? d : cycles);
+    if (end >= 0) {
+      result->cycles = end;
+      result->complete = 1;
+      break;
+    }
+    if (d >= cycles) {
+      break;
+    }
+
+    int done = d + ins->latency;
+    int wb = done + wb_distance;
+    result->instructions++;
+    decoded = d;
+    ex1_done = done;
+    if (ins->op == OP_HALT) {
+      /* Fetch stops and code memory ends after HALT, also one fetched
+       * past the end. HALT counts twice, and fetch hands DRF copies of it
+       * that retire one a cycle */
+      completed->limit = get_code_index(st->pc) + 1 + cpu->num_stages - 2;
+      end = count_until(completed, window, count, wb);
+      if (end < 0) {
+        long missing = completed->limit - completed->value - 2;
+        end = wb + (missing > 0 ? (missing + 1) / 2 : 0);
+      }
+      result->cycles = end < cycles ? end : cycles;
+      result->complete = end < cycles;
+      break;
+    }
+    window[count++ & (ESTIMATE_WINDOW - 1)] = wb;
+
+    int zero = st->zeroFlag;
+    int pc = st->pc;
+    APEX_func_step(st, cpu);
+    if (ins->rd >= 0) {
+      ready[ins->rd] = done + ins->forward;
+      release[ins->rd] = ins->forward < wb_distance ? ready[ins->rd] + 1 : ready[ins->rd];
+    }
+    if (ins->sets_flag) {
+      flag_ready = done + cpu->branch_stall;
+    }
+    if (ins->op == OP_BZ || ins->op == OP_BNZ || ins->op == OP_JUMP || ins->op == OP_LOOP) {
+      int resolved = cpu->branch_stage == DRF ? d : done + cpu->branch_stage - EX1;
+      int taken = ins->op == OP_BZ ? !zero : ins->op == OP_BNZ ? zero : ins->op == OP_JUMP ? 1 : st->branch_taken;
+      int flush = taken;
+      halt_ready = cpu->branch_stage == DRF ? 0 : cpu->branch_stage == EX1 ? done + 1 : resolved;
+      if (ins->op == OP_LOOP) {
+        /* Fetch counts the LOOPs it reads from the buffer, see loop.c */
+        int guess = 0;
+        if (predicted) {
+          guess = --loop_count != 0;
+          armed = guess;
+        }
+        flush = taken != guess;
+        if (taken && !guess) {
+          int imm = cpu->code_memory[index].imm;
+          armed = imm >= 0 && imm + 1 <= cpu->loop_buffer_size && index - imm >= 0;
+          loop_end = pc;
+          loop_reg = cpu->code_memory[index].rd;
+          loop_count = st->regs[loop_reg];
+          loop_counted = armed && body_counted(cpu, info, index, loop_reg);
+        }
+        else if (!taken && guess) {
+          armed = 0;
+        }
+      }
+      else if (taken && armed) {
+        /* Fetch read on from the branch until it resolved, and empties the
+         * buffer if it got to the last count of the LOOP */
+        int ahead = (loop_end - pc) / 4;
+        armed = !(ahead >= 1 && ahead <= resolved - d && loop_count == 1);
+        loop_count = st->regs[loop_reg];
+      }
+      if (flush || taken) {
+        long r = completed->resets++ & (ESTIMATE_WINDOW - 1);
+        completed->reset_at[r] = resolved;
+        completed->reset_to[r] = get_code_index(st->pc) - (ins->op == OP_JUMP ? 3 : 0);
+      }
+      if (flush) {
+        redirect = resolved;
+        result->flushes++;
+        /* The bubble the flush leaves in DRF reads R0 like an instruction
+         * and holds fetch while R0 is not ready */
+        if (ready[0] > resolved + 1) {
+          int r = released(window, count, max(resolved + 2, release[0]));
+          result->raw_stalls += r - resolved - 1;
+          redirect = r - 1;
+        }
+      }
+    }
+  }
+  /* The cycle that completes the program counts, the clock stops before it */
+  if (result->complete) {
+    result->cycles++;
+  }
+
+  free(st);
+  free(info);
+  free(completed);
+  return 0;
+}
+
+/*
+ * Estimates the cycles of the program of cpu, then simulates it and
+ * reports the error of the estimate and the time both took.
+ */
+int APEX_estimate_run(APEX_CPU* cpu, int cycles)
+{
+  APEX_Estimate estimate;
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  if (APEX_estimate(cpu, cycles, &estimate)) {
+    fprintf(stderr, "APEX_Error : Unable to allocate the estimator\n");
+    return 1;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double estimate_seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+  APEX_CPU* copy = APEX_cpu_clone(cpu);
+  if (!copy) {
+    fprintf(stderr, "APEX_Error : Unable to copy the cpu\n");
+    return 1;
+  }
+  copy->quiet = 1;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  int completed = APEX_cpu_simulate(copy, cycles, 0);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double simulate_seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  int simulated = completed ? copy->clock + 1 : copy->clock;
+  APEX_cpu_stop(copy);
+
+  int error = estimate.cycles - simulated;
+  printf("\n================Analytical estimate=============\n");
+  printf("Instructions         : %ld\n", estimate.instructions);
+  printf("RAW stall cycles     : %ld\n", estimate.raw_stalls);
+  printf("Branch stall cycles  : %ld\n", estimate.flag_stalls);
+  printf("Flushes              : %ld\n", estimate.flushes);
+  printf("Estimated cycles     : %d%s\n", estimate.cycles, estimate.complete ? "" : " (cycle limit)");
+  printf("Estimate time        : %.6f s\n", estimate_seconds);
+  printf("Simulated cycles     : %d\n", simulated);
+  printf("Simulation time      : %.6f s\n", simulate_seconds);
+  printf("Error                : %+d (%+.2f%%)\n", error, simulated ? 100.0 * error / simulated : 0.0);
+  printf("Speedup              : %.1fx\n", estimate_seconds > 0 ? simulate_seconds / estimate_seconds : 0.0);
+  printf("================================================\n");
+  return 0;
+}
@@ -0,0 +1,29 @@
+#ifndef _APEX_ESTIMATE_H_
+#define _APEX_ESTIMATE_H_
+/**
+ *  estimate.h
+ *  Contains the analytical cycle estimator: one functional pass over the
+ *  program with the timing of the pipeline computed from its dependences
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include "cpu.h"
+
+/* Outcome of an estimate */
+typedef struct APEX_Estimate
+{
+  int cycles;		    // Estimated cycles of the run
+  long instructions;	    // Dynamic instructions, HALT included
+  long raw_stalls;	    // Cycles DRF waits for a source register
+  long flag_stalls;	    // Cycles BZ/BNZ wait for the zero flag, or HALT behind a branch
+  long flushes;		    // Taken branches, jumps and LOOPs that redirect fetch
+  int complete;		    // The program reached HALT within the cycles
+} APEX_Estimate;
+
+int APEX_estimate(const APEX_CPU* cpu, int cycles, APEX_Estimate* result);
+
+int APEX_estimate_run(APEX_CPU* cpu, int cycles);
+
+#endif
@@ -30,13 +30,64 @@ static int get_num_from_string(char* buffer)
   return atoi(str);
 }
 
+/*
+ * Reads register operand Rn, or -1 if there is no register n.
+ */
+static int get_register(char* buffer)
+{
+  int n = get_num_from_string(buffer);
+  return n >= 0 && n < VREG_BASE ? n : -1;
+}
+
+/*
+ * Reads vector register operand Vn as its scoreboard entry VREG_BASE + n,
+ * or -1 if there is no vector register n.
+ */
+static int get_vector_register(char* buffer)
+{
+  int n = get_num_from_string(buffer);
+  return n >= 0 && n < NUM_VREGS ? VREG_BASE + n : -1;
+}
+
+/* Opcode mnemonics indexed by numeric opcode */
+static const char* opcode_names[NUM_OPCODES] = {
+  "NOP", "MOVC", "ADD", "ADDL", "SUB", "SUBL", "MUL", "AND", "OR", "EX-OR",
+  "LOAD", "LDR", "STORE", "STR", "BZ", "BNZ", "JUMP", "HALT", "LOOP",
+  "VLOAD", "VSTORE", "VADD", "VSUB", "VMUL", "VAND", "VOR"
+};
+
+/*
+ * Converts an opcode mnemonic into its numeric opcode.
+ * Unknown mnemonics map to OP_NOP.
+ */
+int get_opcode_id(const char* opcode)
+{
+  for (int i = 0; i < NUM_OPCODES; ++i) {
+    if (strcmp(opcode, opcode_names[i]) == 0) {
+      return i;
+    }
+  }
+  return OP_NOP;
+}
+
+const char* get_opcode_name(int id)
+{
+  if (id < 0 || id >= NUM_OPCODES) {
+    return "NOP";
+  }
+  return opcode_names[id];
+}
+
 /*
  * This function is related to parsing input file
  *
  * Note : you can edit this function to add new instructions
  */
-static void create_APEX_instruction(APEX_Instruction* ins, char* buffer)
+static int create_APEX_instruction(APEX_Instruction* ins, char* buffer)
 {
+  /* Unused fields are read as register 0, code memory may be recycled heap */
+  memset(ins, 0, sizeof(*ins));
+
   char* token = strtok(buffer, ",");
   int token_num = 0;
   char tokens[6][128];
@@ -48,41 +99,68 @@ static void create_APEX_instruction(APEX_Instruction* ins, char* buffer)
 
   strcpy(ins->opcode, tokens[0]);
   if (strcmp(ins->opcode, "MOVC") == 0) {
-    ins->rd = get_num_from_string(tokens[1]);
+    ins->rd = get_register(tokens[1]);
     ins->imm = get_num_from_string(tokens[2]);
   }
   
   else if(strcmp(ins->opcode, "JUMP") == 0){
-    ins->rs1 = get_num_from_string(tokens[1]);
+    ins->rs1 = get_register(tokens[1]);
     ins->imm = get_num_from_string(tokens[2]);
   }
   else if (strcmp(ins->opcode, "BZ") == 0 || strcmp(ins->opcode, "BNZ") == 0) {
     ins->imm = get_num_from_string(tokens[1]);
   }
+
+  /* LOOP,Rc,#n counts Rc down and repeats the n instructions before it */
+  else if (strcmp(ins->opcode, "LOOP") == 0) {
+    ins->rd = get_register(tokens[1]);
+    ins->rs1 = ins->rd;
+    ins->imm = get_num_from_string(tokens[2]);
+  }
   
   else if (strcmp(ins->opcode, "STORE") == 0) {
-    ins->rs1 = get_num_from_string(tokens[1]);
-    ins->rs2 = get_num_from_string(tokens[2]);
+    ins->rs1 = get_register(tokens[1]);
+    ins->rs2 = get_register(tokens[2]);
     ins->imm = get_num_from_string(tokens[3]);
   }
 
   else if (strcmp(ins->opcode, "STR") == 0) {
-    ins->rs1 = get_num_from_string(tokens[1]);
-    ins->rs2 = get_num_from_string(tokens[2]);
-    ins->rs3 = get_num_from_string(tokens[3]);
+    ins->rs1 = get_register(tokens[1]);
+    ins->rs2 = get_register(tokens[2]);
+    ins->rs3 = get_register(tokens[3]);
   }
 
   else if (strcmp(ins->opcode, "LDR") == 0 || strcmp(ins->opcode, "ADD") == 0 || strcmp(ins->opcode, "SUB") == 0 || strcmp(ins->opcode, "MUL") == 0 || strcmp(ins->opcode, "AND") == 0 || strcmp(ins->opcode, "OR") == 0 || strcmp(ins->opcode, "EX-OR") == 0) {
-    ins->rd = get_num_from_string(tokens[1]);
-    ins->rs1 = get_num_from_string(tokens[2]);
-    ins->rs2 = get_num_from_string(tokens[3]);
+    ins->rd = get_register(tokens[1]);
+    ins->rs1 = get_register(tokens[2]);
+    ins->rs2 = get_register(tokens[3]);
   }
 
   else if (strcmp(ins->opcode, "LOAD") == 0 || strcmp(ins->opcode, "ADDL") == 0 || strcmp(ins->opcode, "SUBL") == 0) {
-    ins->rd = get_num_from_string(tokens[1]);
-    ins->rs1 = get_num_from_string(tokens[2]);
+    ins->rd = get_register(tokens[1]);
+    ins->rs1 = get_register(tokens[2]);
+    ins->imm = get_num_from_string(tokens[3]);
+  }
+
+  /* Vector registers Vn are numbered from VREG_BASE */
+  else if (strcmp(ins->opcode, "VLOAD") == 0) {
+    ins->rd = get_vector_register(tokens[1]);
+    ins->rs1 = get_register(tokens[2]);
     ins->imm = get_num_from_string(tokens[3]);
   }
+
+  else if (strcmp(ins->opcode, "VSTORE") == 0) {
+    ins->rs1 = get_vector_register(tokens[1]);
+    ins->rs2 = get_register(tokens[2]);
+    ins->imm = get_num_from_string(tokens[3]);
+  }
+
+  else if (strcmp(ins->opcode, "VADD") == 0 || strcmp(ins->opcode, "VSUB") == 0 || strcmp(ins->opcode, "VMUL") == 0 || strcmp(ins->opcode, "VAND") == 0 || strcmp(ins->opcode, "VOR") == 0) {
+    ins->rd = get_vector_register(tokens[1]);
+    ins->rs1 = get_vector_register(tokens[2]);
+    ins->rs2 = get_vector_register(tokens[3]);
+  }
+  return ins->rd < 0 || ins->rs1 < 0 || ins->rs2 < 0 || ins->rs3 < 0;
 }
 
 /*
@@ -124,7 +202,12 @@ APEX_Instruction* create_code_memory(const char* filename, int* size)
   rewind(fp);
   int current_instruction = 0;
   while ((nread = getline(&line, &len, fp)) != -1) {
-    create_APEX_instruction(&code_memory[current_instruction], line);
+    if (create_APEX_instruction(&code_memory[current_instruction], line)) {
+      fprintf(stderr, "APEX_Error : %s:%d: registers are R0-R%d and V0-V%d\n", filename, current_instruction + 1, VREG_BASE - 1, NUM_VREGS - 1);
+      free(code_memory);
+      code_memory = NULL;
+      break;
+    }
     current_instruction++;
   }
 
@@ -132,3 +215,55 @@ APEX_Instruction* create_code_memory(const char* filename, int* size)
   fclose(fp);
   return code_memory;
 }
+
+/*
+ * Creates code memory from program text held in memory, one instruction
+ * per line as in an input file.
+ */
+APEX_Instruction* create_code_memory_from_buffer(const char* text, size_t length, int* size)
+{
+  if (!text) {
+    return NULL;
+  }
+
+  int code_memory_size = 0;
+  for (size_t i = 0; i < length; ++i) {
+    if (text[i] == '\n' || i + 1 == length) {
+      code_memory_size++;
+    }
+  }
+  *size = code_memory_size;
+  if (!code_memory_size) {
+    return NULL;
+  }
+
+  APEX_Instruction* code_memory = calloc(code_memory_size, sizeof(*code_memory));
+  if (!code_memory) {
+    return NULL;
+  }
+
+  int current_instruction = 0;
+  size_t start = 0;
+  char line[512];
+  while (start < length && current_instruction < code_memory_size) {
+    size_t end = start;
+    while (end < length && text[end] != '\n') {
+      end++;
+    }
+    /* Keep the newline, lines are parsed as getline() returns them */
+    size_t n = end < length ? end - start + 1 : end - start;
+    if (n > sizeof(line) - 1) {
+      n = sizeof(line) - 1;
+    }
+    memcpy(line, text + start, n);
+    line[n] = '\0';
+    if (create_APEX_instruction(&code_memory[current_instruction], line)) {
+      fprintf(stderr, "APEX_Error : <program>:%d: registers are R0-R%d and V0-V%d\n", current_instruction + 1, VREG_BASE - 1, NUM_VREGS - 1);
+      free(code_memory);
+      return NULL;
+    }
+    current_instruction++;
+    start = end + 1;
+  }
+  return code_memory;
+}
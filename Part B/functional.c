@@ -0,0 +1,163 @@
+/*
+ *  functional.c
+ *  Contains the functional APEX model. Each call executes one instruction
+ *  from code memory and updates the architectural state directly.
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "functional.h"
+#include "vector.h"
+
+/*
+ * Copies the architectural state of a freshly initialized cpu into st.
+ */
+void APEX_func_init(APEX_Func_State* st, const APEX_CPU* cpu)
+{
+  st->pc = cpu->pc;
+  memcpy(st->regs, cpu->regs, sizeof(st->regs));
+  memcpy(st->vregs, cpu->vregs, sizeof(st->vregs));
+  memcpy(st->data_memory, cpu->data_memory, sizeof(st->data_memory));
+  st->zeroFlag = cpu->zeroFlag;
+  st->halted = 0;
+  st->retired = 0;
+  st->mem_address = 0;
+  st->branch_taken = 0;
+}
+
+static int valid_address(int address)
+{
+  return address >= 0 && address < 4096;
+}
+
+static void set_zero_flag(APEX_Func_State* st, int result)
+{
+  if(result == 0){
+    st->zeroFlag = 0;
+  }
+  else{
+    st->zeroFlag = 1;
+  }
+}
+
+/*
+ * Executes the instruction at st->pc.
+ * Returns 1 if an instruction was executed, 0 once the program has halted.
+ */
+int APEX_func_step(APEX_Func_State* st, const APEX_CPU* cpu)
+{
+  int index = get_code_index(st->pc);
+  if (st->halted || index < 0 || index >= cpu->code_memory_size) {
+    st->halted = 1;
+    return 0;
+  }
+
+  APEX_Instruction* ins = &cpu->code_memory[index];
+  int next_pc = st->pc + 4;
+  int address = 0;
+
+  if (compare_opcode(ins->opcode, "MOVC")) {
+    st->regs[ins->rd] = ins->imm;
+  }
+  else if (compare_opcode(ins->opcode, "ADD")) {
+    st->regs[ins->rd] = st->regs[ins->rs1] + st->regs[ins->rs2];
+    set_zero_flag(st, st->regs[ins->rd]);
+  }
+  else if (compare_opcode(ins->opcode, "ADDL")) {
+    st->regs[ins->rd] = st->regs[ins->rs1] + ins->imm;
+    set_zero_flag(st, st->regs[ins->rd]);
+  }
+  else if (compare_opcode(ins->opcode, "SUB")) {
+    st->regs[ins->rd] = st->regs[ins->rs1] - st->regs[ins->rs2];
+    set_zero_flag(st, st->regs[ins->rd]);
+  }
+  else if (compare_opcode(ins->opcode, "SUBL")) {
+    st->regs[ins->rd] = st->regs[ins->rs1] - ins->imm;
+    set_zero_flag(st, st->regs[ins->rd]);
+  }
+  else if (compare_opcode(ins->opcode, "MUL")) {
+    st->regs[ins->rd] = st->regs[ins->rs1] * st->regs[ins->rs2];
+    set_zero_flag(st, st->regs[ins->rd]);
+  }
+  else if (compare_opcode(ins->opcode, "AND")) {
+    st->regs[ins->rd] = st->regs[ins->rs1] & st->regs[ins->rs2];
+  }
+  else if (compare_opcode(ins->opcode, "OR")) {
+    st->regs[ins->rd] = st->regs[ins->rs1] | st->regs[ins->rs2];
+  }
+  else if (compare_opcode(ins->opcode, "EX-OR")) {
+    st->regs[ins->rd] = st->regs[ins->rs1] ^ st->regs[ins->rs2];
+  }
+  else if (compare_opcode(ins->opcode, "LOAD") || compare_opcode(ins->opcode, "LDR")) {
+    if (compare_opcode(ins->opcode, "LOAD")) {
+      address = st->regs[ins->rs1] + ins->imm;
+    }
+    else {
+      address = st->regs[ins->rs1] + st->regs[ins->rs2];
+    }
+    if (valid_address(address)) {
+      st->regs[ins->rd] = st->data_memory[address];
+    }
+  }
+  else if (compare_opcode(ins->opcode, "STORE") || compare_opcode(ins->opcode, "STR")) {
+    if (compare_opcode(ins->opcode, "STORE")) {
+      address = st->regs[ins->rs2] + ins->imm;
+    }
+    else {
+      address = st->regs[ins->rs2] + st->regs[ins->rs3];
+    }
+    if (valid_address(address)) {
+      st->data_memory[address] = st->regs[ins->rs1];
+    }
+  }
+  else if (compare_opcode(ins->opcode, "VLOAD")) {
+    address = st->regs[ins->rs1] + ins->imm;
+    for (int i = 0; i < VECTOR_LANES; ++i) {
+      st->vregs[ins->rd - VREG_BASE][i] = valid_address(address + i) ? st->data_memory[address + i] : 0;
+    }
+  }
+  else if (compare_opcode(ins->opcode, "VSTORE")) {
+    address = st->regs[ins->rs2] + ins->imm;
+    for (int i = 0; i < VECTOR_LANES; ++i) {
+      if (valid_address(address + i)) {
+        st->data_memory[address + i] = st->vregs[ins->rs1 - VREG_BASE][i];
+      }
+    }
+  }
+  else if (is_vector_opcode(get_opcode_id(ins->opcode))) {
+    vector_execute(get_opcode_id(ins->opcode), st->vregs[ins->rs1 - VREG_BASE], st->vregs[ins->rs2 - VREG_BASE], st->vregs[ins->rd - VREG_BASE]);
+  }
+  else if (compare_opcode(ins->opcode, "BZ")) {
+    if (!st->zeroFlag) {
+      next_pc = st->pc + ins->imm;
+    }
+  }
+  else if (compare_opcode(ins->opcode, "BNZ")) {
+    if (st->zeroFlag) {
+      next_pc = st->pc + ins->imm;
+    }
+  }
+  else if (compare_opcode(ins->opcode, "JUMP")) {
+    next_pc = st->regs[ins->rs1] + ins->imm;
+  }
+  else if (compare_opcode(ins->opcode, "LOOP")) {
+    st->regs[ins->rd] = st->regs[ins->rs1] - 1;
+    if (st->regs[ins->rd] != 0) {
+      next_pc = st->pc - 4 * ins->imm;
+    }
+  }
+  else if (compare_opcode(ins->opcode, "HALT")) {
+    st->halted = 1;
+  }
+
+  st->branch_taken = (next_pc != st->pc + 4);
+  st->mem_address = address;
+  st->pc = next_pc;
+  st->retired++;
+  return 1;
+}
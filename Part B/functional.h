@@ -0,0 +1,32 @@
+#ifndef _APEX_FUNCTIONAL_H_
+#define _APEX_FUNCTIONAL_H_
+/**
+ *  functional.h
+ *  Contains the functional (instruction-at-a-time) APEX model used to
+ *  fast-forward programs without simulating the pipeline
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include "cpu.h"
+
+/* Architectural state of the functional model */
+typedef struct APEX_Func_State
+{
+  int pc;		    // Program Counter
+  int regs[32];		    // Integer register file
+  int vregs[NUM_VREGS][VECTOR_LANES]; // Vector register file
+  int zeroFlag;		    // 0 when the last arithmetic result was zero
+  int halted;		    // Set once HALT executes or PC leaves code memory
+  long retired;		    // Instructions executed so far
+  int mem_address;	    // Effective address of the last load or store, the first lane of a vector one
+  int branch_taken;	    // 1 if the last instruction redirected the PC
+  int data_memory[4096];    // Data Memory
+} APEX_Func_State;
+
+void APEX_func_init(APEX_Func_State* st, const APEX_CPU* cpu);
+
+int APEX_func_step(APEX_Func_State* st, const APEX_CPU* cpu);
+
+#endif
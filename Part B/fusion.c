@@ -0,0 +1,127 @@
+/*
+ *  fusion.c
+ *  Contains macro-op fusion. When decode first sees an instruction it
+ *  looks at the next one in code memory, which fetch has not read yet,
+ *  and merges the two if they form one of these pairs:
+ *
+ *  - an instruction that sets the zero flag followed by BZ/BNZ. The latch
+ *    holds the compare and carries the branch, which resolves in the
+ *    branch stage on the compare's own result instead of waiting in DRF
+ *    for the zero flag. Not fused when branches resolve in DRF, where the
+ *    flag is already there.
+ *  - ADDL Rx followed by LOAD Ry,Rx,#imm (Ry not Rx) or STORE Rs,Rx,#imm.
+ *    The latch holds the load or store and carries the ADDL, which EX1
+ *    computes first and whose result is the base of the address.
+ *
+ *  The pair takes one slot in every stage and fetch skips the second
+ *  instruction. A fused latch retires both instructions.
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fusion.h"
+
+static bool sets_flag(int op)
+{
+  return op == OP_ADD || op == OP_ADDL || op == OP_SUB || op == OP_SUBL || op == OP_MUL;
+}
+
+/*
+ * Merges the instruction after the one in the DRF latch into it if the two
+ * fuse, and moves the PC past it. Returns 1 if they were fused.
+ */
+int fusion_pair(APEX_CPU* cpu, CPU_Stage* stage)
+{
+  int index = get_code_index(stage->pc);
+  if (stage->fused != OP_NOP || cpu->pc != stage->pc + 4 || index < 0 || index + 1 >= cpu->code_memory_size) {
+    return 0;
+  }
+  APEX_Instruction* next = &cpu->code_memory[index + 1];
+  int op = get_opcode_id(stage->opcode);
+  int next_op = get_opcode_id(next->opcode);
+
+  if (sets_flag(op) && (next_op == OP_BZ || next_op == OP_BNZ) && cpu->branch_stage > DRF) {
+    stage->fused = next_op;
+    stage->fused_pc = stage->pc + 4;
+    stage->fused_imm = next->imm;
+  }
+  else if (op == OP_ADDL && ((next_op == OP_LOAD && next->rs1 == stage->rd && next->rd != stage->rd) ||
+                             (next_op == OP_STORE && next->rs2 == stage->rd))) {
+    /* The load or store takes over the latch */
+    stage->fused = OP_ADDL;
+    stage->fused_pc = stage->pc;
+    stage->fused_rd = stage->rd;
+    stage->fused_rs1 = stage->rs1;
+    stage->fused_imm = stage->imm;
+    stage->pc += 4;
+    strcpy(stage->opcode, next->opcode);
+    stage->rd = next->rd;
+    stage->rs1 = next->rs1;
+    stage->rs2 = next->rs2;
+    stage->rs3 = next->rs3;
+    stage->imm = next->imm;
+  }
+  else {
+    return 0;
+  }
+  cpu->pc += 4;
+  return 1;
+}
+
+/*
+ * Returns the instruction fused into a latch as a latch of its own, for
+ * printing and commit events.
+ */
+CPU_Stage fusion_partner(const CPU_Stage* stage)
+{
+  CPU_Stage partner = *stage;
+  partner.fused = OP_NOP;
+  partner.pc = stage->fused_pc;
+  strcpy(partner.opcode, get_opcode_name(stage->fused));
+  partner.rs2 = partner.rs3 = 0;
+  partner.imm = stage->fused_imm;
+  if (stage->fused == OP_ADDL) {
+    partner.rd = stage->fused_rd;
+    partner.rs1 = stage->fused_rs1;
+    partner.buffer = stage->fused_value;
+  }
+  else {
+    partner.rd = partner.rs1 = 0;
+  }
+  return partner;
+}
+
+/*
+ * Simulates a copy of cpu without fusion for the cycle reduction.
+ */
+void fusion_baseline(APEX_CPU* cpu, int cycles)
+{
+  APEX_CPU* copy = APEX_cpu_clone(cpu);
+  if (!copy) {
+    return;
+  }
+  copy->fusion = 0;
+  copy->quiet = 1;
+  APEX_cpu_simulate(copy, cycles, 0);
+  cpu->fusion_baseline = copy->clock;
+  APEX_cpu_stop(copy);
+}
+
+void fusion_print(APEX_CPU* cpu)
+{
+  printf("================Macro-op fusion=============\n");
+  printf("Compare-branch pairs : %d\n", cpu->fused_branches);
+  printf("Address pairs        : %d\n", cpu->fused_addresses);
+  printf("Cycles               : %d\n", cpu->clock);
+  if (cpu->fusion_baseline > 0) {
+    int saved = cpu->fusion_baseline - cpu->clock;
+    printf("Cycles without fusion: %d\n", cpu->fusion_baseline);
+    printf("Cycle reduction      : %d (%.1f%%)\n", saved, 100.0 * saved / cpu->fusion_baseline);
+  }
+  printf("============================================\n");
+}
@@ -0,0 +1,23 @@
+#ifndef _APEX_FUSION_H_
+#define _APEX_FUSION_H_
+/**
+ *  fusion.h
+ *  Contains macro-op fusion: decode merges a compare with the BZ/BNZ
+ *  behind it, or an ADDL with the load or store addressed by its result,
+ *  into one latch that travels down the pipeline as a single operation
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include "cpu.h"
+
+int fusion_pair(APEX_CPU* cpu, CPU_Stage* stage);
+
+CPU_Stage fusion_partner(const CPU_Stage* stage);
+
+void fusion_baseline(APEX_CPU* cpu, int cycles);
+
+void fusion_print(APEX_CPU* cpu);
+
+#endif
@@ -0,0 +1,531 @@
+/*
+ *  gen.c
+ *  Contains the synthetic workload generator. It writes an APEX assembly
+ *  program with a controlled instruction mix, RAW dependency distances,
+ *  branch frequency and taken rate, loop nesting and memory access
+ *  pattern. The same seed always gives the same program.
+ *
+ *  Registers are split so that every property stays under control:
+ *
+ *    R0..R9    Pool of destinations, written round robin, so a source at
+ *              distance d reads the result of the instruction d earlier
+ *    R10       Zero, used by independent operands and branch conditions
+ *    R11       Base address of the data accessed by LOAD/STORE
+ *    R12..R15  Loop counters, outermost first
+ *
+ *  A branch is emitted as a flag-setting ADDL on R10 followed by BZ or BNZ,
+ *  so its outcome is fixed and the taken rate is exact. Taken branches skip
+ *  forward and never leave the loop body they are in.
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+
+#define POOL_REGS 10
+#define ZERO_REG 10
+#define BASE_REG 11
+#define FIRST_COUNTER 12
+#define MAX_LOOPS 4
+#define MAX_DEPS 16
+#define MAX_SKIP 4
+
+enum
+{
+  MIX_ALU,
+  MIX_MUL,
+  MIX_LOAD,
+  MIX_STORE,
+  NUM_MIX
+};
+
+enum
+{
+  MEM_STRIDE,
+  MEM_RANDOM,
+  MEM_REUSE
+};
+
+/* Generator parameters */
+typedef struct Gen_Params
+{
+  int length;			    // Static instructions in the loop bodies
+  uint64_t seed;
+  int mix[NUM_MIX];		    // Weights of the instruction classes
+  int dep_distance[MAX_DEPS];	    // Dependency distances, 0 is independent
+  int dep_weight[MAX_DEPS];
+  int num_deps;
+  double branch_rate;		    // Fraction of body slots that are branches
+  double taken_rate;		    // Fraction of branches that are taken
+  int loops;			    // Loop nesting depth
+  int iterations;		    // Iterations of every loop
+  int mem_pattern;
+  int mem_param;		    // Stride or reuse distance
+  int mem_base;			    // First data memory address
+  int footprint;		    // Data memory words accessed
+} Gen_Params;
+
+/* Generator state */
+typedef struct Gen_State
+{
+  Gen_Params* params;
+  FILE* out;
+  uint64_t rng;
+  int position;			    // Index of the next instruction
+  int next_dest;		    // Next pool register to write
+  int* writer;			    // Pool register written by each instruction, or -1
+  int max_instructions;
+  int pending[MAX_SKIP * 2];	    // Targets of forward branches not reached yet
+  int num_pending;
+  int accesses;			    // Memory accesses generated so far
+  int* history;			    // Offset of every memory access
+  int next_offset;		    // Next fresh offset for reuse accesses
+  long branches;
+  long taken;
+} Gen_State;
+
+/*
+ * xorshift64*, so that a seed gives the same program on every host
+ */
+static uint64_t next_random(Gen_State* gen)
+{
+  gen->rng ^= gen->rng >> 12;
+  gen->rng ^= gen->rng << 25;
+  gen->rng ^= gen->rng >> 27;
+  return gen->rng * 2685821657736338717ULL;
+}
+
+static int random_below(Gen_State* gen, int bound)
+{
+  return bound > 0 ? (int)(next_random(gen) % (uint64_t)bound) : 0;
+}
+
+static double random_unit(Gen_State* gen)
+{
+  return (next_random(gen) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int pick_weighted(Gen_State* gen, const int* weights, int count)
+{
+  int total = 0;
+  for (int i = 0; i < count; ++i) {
+    total += weights[i];
+  }
+  int choice = random_below(gen, total);
+  for (int i = 0; i < count; ++i) {
+    if (choice < weights[i]) {
+      return i;
+    }
+    choice -= weights[i];
+  }
+  return count - 1;
+}
+
+/*
+ * Writes one instruction and records the pool register it writes.
+ */
+static void emit(Gen_State* gen, int dest, const char* format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  vfprintf(gen->out, format, args);
+  va_end(args);
+  fputc('\n', gen->out);
+  if (gen->position < gen->max_instructions) {
+    gen->writer[gen->position] = dest;
+  }
+  gen->position++;
+}
+
+static int take_dest(Gen_State* gen)
+{
+  int reg = gen->next_dest;
+  gen->next_dest = (gen->next_dest + 1) % POOL_REGS;
+  return reg;
+}
+
+/*
+ * Returns a source register at a distance drawn from the distribution:
+ * the destination of the instruction that many slots back, or of the
+ * nearest older pool writer. Distance 0 gives the zero register.
+ */
+static int pick_source(Gen_State* gen)
+{
+  Gen_Params* params = gen->params;
+  int distance = params->dep_distance[pick_weighted(gen, params->dep_weight, params->num_deps)];
+  if (distance == 0) {
+    return ZERO_REG;
+  }
+  for (int i = gen->position - distance; i >= 0 && i > gen->position - distance - POOL_REGS; --i) {
+    if (gen->writer[i] >= 0) {
+      return gen->writer[i];
+    }
+  }
+  return ZERO_REG;
+}
+
+/*
+ * Returns the data offset of the next LOAD/STORE.
+ */
+static int pick_offset(Gen_State* gen)
+{
+  Gen_Params* params = gen->params;
+  int offset;
+  if (params->mem_pattern == MEM_RANDOM) {
+    offset = random_below(gen, params->footprint);
+  }
+  else if (params->mem_pattern == MEM_REUSE) {
+    /* Touch the word used mem_param accesses ago, a fresh one before that */
+    if (gen->accesses >= params->mem_param) {
+      offset = gen->history[gen->accesses - params->mem_param];
+    }
+    else {
+      offset = gen->next_offset;
+      gen->next_offset = (gen->next_offset + 1) % params->footprint;
+    }
+  }
+  else {
+    offset = (int)(((long)gen->accesses * params->mem_param) % params->footprint);
+  }
+  gen->history[gen->accesses++] = offset;
+  return offset;
+}
+
+static void emit_operation(Gen_State* gen)
+{
+  static const char* alu_ops[] = { "ADD", "SUB", "AND", "OR", "EX-OR", "ADDL", "SUBL" };
+  Gen_Params* params = gen->params;
+
+  switch (pick_weighted(gen, params->mix, NUM_MIX)) {
+    case MIX_MUL: {
+      int rs1 = pick_source(gen);
+      int rs2 = pick_source(gen);
+      int rd = take_dest(gen);
+      emit(gen, rd, "MUL,R%d,R%d,R%d", rd, rs1, rs2);
+      break;
+    }
+    case MIX_LOAD: {
+      int offset = pick_offset(gen);
+      int rd = take_dest(gen);
+      emit(gen, rd, "LOAD,R%d,R%d,#%d", rd, BASE_REG, offset);
+      break;
+    }
+    case MIX_STORE: {
+      int rs1 = pick_source(gen);
+      int offset = pick_offset(gen);
+      emit(gen, -1, "STORE,R%d,R%d,#%d", rs1, BASE_REG, offset);
+      break;
+    }
+    default: {
+      const char* op = alu_ops[random_below(gen, 7)];
+      int rs1 = pick_source(gen);
+      if (op[3] == 'L') {
+        int imm = random_below(gen, 16);
+        int rd = take_dest(gen);
+        emit(gen, rd, "%s,R%d,R%d,#%d", op, rd, rs1, imm);
+      }
+      else {
+        int rs2 = pick_source(gen);
+        int rd = take_dest(gen);
+        emit(gen, rd, "%s,R%d,R%d,R%d", op, rd, rs1, rs2);
+      }
+      break;
+    }
+  }
+}
+
+static bool is_pending_target(Gen_State* gen, int position)
+{
+  for (int i = 0; i < gen->num_pending; ++i) {
+    if (gen->pending[i] == position) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * Emits count straight-line slots with branches spread among them.
+ */
+static void emit_body(Gen_State* gen, int count)
+{
+  Gen_Params* params = gen->params;
+  int end = gen->position + count;
+
+  while (gen->position < end) {
+    int remaining = end - gen->position;
+
+    /* Drop the targets that have been reached */
+    int kept = 0;
+    for (int i = 0; i < gen->num_pending; ++i) {
+      if (gen->pending[i] > gen->position) {
+        gen->pending[kept++] = gen->pending[i];
+      }
+    }
+    gen->num_pending = kept;
+
+    /* A branch needs its flag setter, itself and one skipped slot, and a
+     * forward branch must not land between a setter and its branch */
+    if (remaining >= 3 && gen->num_pending < MAX_SKIP * 2 && !is_pending_target(gen, gen->position + 1) && random_unit(gen) < params->branch_rate) {
+      int skip = 1 + random_below(gen, MAX_SKIP);
+      if (skip > remaining - 2) {
+        skip = remaining - 2;
+      }
+      bool taken = random_unit(gen) < params->taken_rate;
+      bool bz = random_below(gen, 2);
+      /* Result zero clears zeroFlag: BZ is taken, BNZ is not */
+      int value = (taken == bz) ? 0 : 1;
+      int rd = take_dest(gen);
+      emit(gen, rd, "ADDL,R%d,R%d,#%d", rd, ZERO_REG, value);
+      emit(gen, -1, "%s,#%d", bz ? "BZ" : "BNZ", 4 * (skip + 1));
+      gen->pending[gen->num_pending++] = gen->position + skip;
+      gen->branches++;
+      gen->taken += taken;
+      continue;
+    }
+    emit_operation(gen);
+  }
+}
+
+/*
+ * Emits loop level depth and the loops nested in it.
+ */
+static void emit_loop(Gen_State* gen, int depth, int per_level)
+{
+  Gen_Params* params = gen->params;
+  if (depth == params->loops) {
+    emit_body(gen, params->length - per_level * params->loops);
+    return;
+  }
+  int counter = FIRST_COUNTER + depth;
+  emit(gen, -1, "MOVC,R%d,#%d", counter, params->iterations);
+  int head = gen->position;
+  emit_body(gen, per_level);
+  emit_loop(gen, depth + 1, per_level);
+  emit(gen, -1, "SUBL,R%d,R%d,#1", counter, counter);
+  emit(gen, -1, "BNZ,#%d", -4 * (gen->position - head));
+}
+
+static void generate(Gen_State* gen)
+{
+  Gen_Params* params = gen->params;
+
+  emit(gen, -1, "MOVC,R%d,#0", ZERO_REG);
+  emit(gen, -1, "MOVC,R%d,#%d", BASE_REG, params->mem_base);
+  for (int i = 0; i < POOL_REGS; ++i) {
+    emit(gen, i, "MOVC,R%d,#%d", i, i + 1);
+  }
+  emit_loop(gen, 0, params->length / (params->loops + 1));
+  emit(gen, -1, "HALT,,");
+}
+
+/*
+ * Parses "key:weight,key:weight" into distances and weights.
+ */
+static int parse_deps(Gen_Params* params, const char* value)
+{
+  params->num_deps = 0;
+  while (*value) {
+    int distance, weight, used;
+    if (sscanf(value, "%d:%d%n", &distance, &weight, &used) != 2 || distance < 0 || distance > POOL_REGS || weight < 0 || params->num_deps == MAX_DEPS) {
+      return 1;
+    }
+    params->dep_distance[params->num_deps] = distance;
+    params->dep_weight[params->num_deps++] = weight;
+    value += used;
+    if (*value == ',') {
+      value++;
+    }
+  }
+  return params->num_deps == 0;
+}
+
+static int parse_mix(Gen_Params* params, const char* value)
+{
+  static const char* names[NUM_MIX] = { "alu", "mul", "load", "store" };
+  memset(params->mix, 0, sizeof(params->mix));
+  while (*value) {
+    char name[16];
+    int weight, used;
+    if (sscanf(value, "%15[a-z]:%d%n", name, &weight, &used) != 2 || weight < 0) {
+      return 1;
+    }
+    int i;
+    for (i = 0; i < NUM_MIX && strcmp(name, names[i]); ++i);
+    if (i == NUM_MIX) {
+      return 1;
+    }
+    params->mix[i] = weight;
+    value += used;
+    if (*value == ',') {
+      value++;
+    }
+  }
+  return params->mix[MIX_ALU] + params->mix[MIX_MUL] + params->mix[MIX_LOAD] + params->mix[MIX_STORE] == 0;
+}
+
+static int parse_mem(Gen_Params* params, const char* value)
+{
+  if (strcmp(value, "random") == 0) {
+    params->mem_pattern = MEM_RANDOM;
+    return 0;
+  }
+  if (sscanf(value, "stride:%d", &params->mem_param) == 1) {
+    params->mem_pattern = MEM_STRIDE;
+    return params->mem_param < 0;
+  }
+  if (sscanf(value, "reuse:%d", &params->mem_param) == 1) {
+    params->mem_pattern = MEM_REUSE;
+    return params->mem_param < 1;
+  }
+  return 1;
+}
+
+/*
+ *  Applies a --name=value option.
+ *  Returns 0 if the option is recognized and valid.
+ */
+static int apply_option(Gen_Params* params, const char* arg, const char** output)
+{
+  const char* value = strchr(arg, '=');
+  if (!value) {
+    return 1;
+  }
+  value++;
+
+  if (strncmp(arg, "--length=", 9) == 0) {
+    params->length = atoi(value);
+    return params->length < 1;
+  }
+  if (strncmp(arg, "--seed=", 7) == 0) {
+    params->seed = strtoull(value, NULL, 0);
+    return 0;
+  }
+  if (strncmp(arg, "--mix=", 6) == 0) {
+    return parse_mix(params, value);
+  }
+  if (strncmp(arg, "--deps=", 7) == 0) {
+    return parse_deps(params, value);
+  }
+  if (strncmp(arg, "--branches=", 11) == 0) {
+    params->branch_rate = atof(value);
+    return params->branch_rate < 0 || params->branch_rate > 1;
+  }
+  if (strncmp(arg, "--taken=", 8) == 0) {
+    params->taken_rate = atof(value);
+    return params->taken_rate < 0 || params->taken_rate > 1;
+  }
+  if (strncmp(arg, "--loops=", 8) == 0) {
+    params->loops = atoi(value);
+    return params->loops < 0 || params->loops > MAX_LOOPS;
+  }
+  if (strncmp(arg, "--iterations=", 13) == 0) {
+    params->iterations = atoi(value);
+    return params->iterations < 1;
+  }
+  if (strncmp(arg, "--mem=", 6) == 0) {
+    return parse_mem(params, value);
+  }
+  if (strncmp(arg, "--base=", 7) == 0) {
+    params->mem_base = atoi(value);
+    return params->mem_base < 0;
+  }
+  if (strncmp(arg, "--footprint=", 12) == 0) {
+    params->footprint = atoi(value);
+    return params->footprint < 1;
+  }
+  if (strncmp(arg, "--output=", 9) == 0) {
+    *output = value;
+    return 0;
+  }
+  return 1;
+}
+
+static void usage(const char* name)
+{
+  fprintf(stderr, "APEX_Help : Usage %s [options]\n", name);
+  fprintf(stderr, "APEX_Help :   --length=N             static body instructions (default 100)\n");
+  fprintf(stderr, "APEX_Help :   --seed=S               random seed (default 1)\n");
+  fprintf(stderr, "APEX_Help :   --mix=alu:W,mul:W,load:W,store:W\n");
+  fprintf(stderr, "APEX_Help :   --deps=D:W,...         RAW distance weights, D 0..%d, 0 is independent\n", POOL_REGS);
+  fprintf(stderr, "APEX_Help :   --branches=P --taken=P branch slots and taken fraction\n");
+  fprintf(stderr, "APEX_Help :   --loops=D --iterations=N  loop nesting 0..%d\n", MAX_LOOPS);
+  fprintf(stderr, "APEX_Help :   --mem=stride:S|random|reuse:D --base=A --footprint=W\n");
+  fprintf(stderr, "APEX_Help :   --output=file          default stdout\n");
+}
+
+int main(int argc, char const* argv[])
+{
+  Gen_Params params;
+  memset(&params, 0, sizeof(params));
+  params.length = 100;
+  params.seed = 1;
+  params.mix[MIX_ALU] = 50;
+  params.mix[MIX_MUL] = 10;
+  params.mix[MIX_LOAD] = 20;
+  params.mix[MIX_STORE] = 20;
+  parse_deps(&params, "0:30,1:30,2:20,3:10,5:10");
+  params.branch_rate = 0.1;
+  params.taken_rate = 0.5;
+  params.loops = 1;
+  params.iterations = 10;
+  params.mem_pattern = MEM_STRIDE;
+  params.mem_param = 1;
+  params.mem_base = 1000;
+  params.footprint = 256;
+
+  const char* output = NULL;
+  for (int i = 1; i < argc; ++i) {
+    if (apply_option(&params, argv[i], &output)) {
+      fprintf(stderr, "APEX_Error : Invalid option %s\n", argv[i]);
+      usage(argv[0]);
+      exit(1);
+    }
+  }
+  if (params.mem_base + params.footprint > 4096) {
+    fprintf(stderr, "APEX_Error : Data accesses must stay below address 4096\n");
+    exit(1);
+  }
+  if (params.length < 3 * (params.loops + 1)) {
+    params.length = 3 * (params.loops + 1);
+  }
+
+  Gen_State gen;
+  memset(&gen, 0, sizeof(gen));
+  gen.params = &params;
+  gen.rng = params.seed ? params.seed : 0x9E3779B97F4A7C15ULL;
+  gen.max_instructions = params.length + 4 * MAX_LOOPS + POOL_REGS + 4;
+  gen.writer = malloc(sizeof(int) * gen.max_instructions);
+  gen.history = malloc(sizeof(int) * (params.length + 1));
+  if (!gen.writer || !gen.history) {
+    fprintf(stderr, "APEX_Error : Out of memory\n");
+    exit(1);
+  }
+  gen.out = output ? fopen(output, "w") : stdout;
+  if (!gen.out) {
+    fprintf(stderr, "APEX_Error : Unable to open %s\n", output);
+    exit(1);
+  }
+
+  generate(&gen);
+
+  long dynamic = params.length - (long)(params.length / (params.loops + 1)) * params.loops;
+  for (int i = 0; i < params.loops; ++i) {
+    dynamic = (dynamic + params.length / (params.loops + 1) + 2) * params.iterations + 1;
+  }
+  fprintf(stderr, "APEX_Gen : %d instructions, %ld branches (%ld taken), about %ld executed\n",
+          gen.position, gen.branches, gen.taken, dynamic + POOL_REGS + 3);
+
+  if (output) {
+    fclose(gen.out);
+  }
+  free(gen.writer);
+  free(gen.history);
+  return 0;
+}
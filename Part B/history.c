@@ -0,0 +1,272 @@
+/*
+ *  history.c
+ *  Contains the execution history.
+ *
+ *  After every cycle the cpu is compared with the state recorded before it,
+ *  skipping the 256-byte blocks that did not change. The words that did
+ *  change are kept as runs of XOR deltas in a ring of 32-bit words:
+ *
+ *    length | run header | deltas ... | run header | deltas ... | length
+ *
+ *  A run header holds the word offset in the cpu in its high half and the
+ *  number of words in its low half; length counts every word of the record,
+ *  so the ring can be walked both ways. Applying a record to either state
+ *  of its cycle gives the other, so the same deltas step backwards from the
+ *  current state and forwards from an older one. A cycle costs the latches
+ *  that moved, the registers and memory words written and the control
+ *  state that changed, not the size of the cpu.
+ *
+ *  When the ring is full the oldest records are dropped. A copy of the
+ *  whole cpu, a keyframe, is taken every 1/16 of the ring, so a seek far
+ *  back starts at the keyframe before its target and replays forward.
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "history.h"
+
+#define CPU_WORDS (sizeof(APEX_CPU) / sizeof(uint32_t))
+#define BLOCK_WORDS 64
+
+/* Run headers need the offset and length of a run to fit in 16 bits */
+typedef char History_Offsets_Fit[CPU_WORDS < 65536 ? 1 : -1];
+
+static uint32_t ring_get(APEX_History* history, uint64_t position)
+{
+  return history->ring[position & (history->capacity - 1)];
+}
+
+static History_Keyframe* keyframe(APEX_History* history, int i)
+{
+  return &history->keyframes[(history->first_keyframe + i) % (HISTORY_KEYFRAMES + 1)];
+}
+
+static void take_keyframe(APEX_History* history)
+{
+  if (history->num_keyframes == HISTORY_KEYFRAMES + 1) {
+    history->first_keyframe = (history->first_keyframe + 1) % (HISTORY_KEYFRAMES + 1);
+    history->num_keyframes--;
+  }
+  History_Keyframe* k = keyframe(history, history->num_keyframes++);
+  k->step = history->step;
+  k->position = history->position;
+  k->state = history->last;
+  history->keyframe_due = history->head + history->capacity / HISTORY_KEYFRAMES;
+}
+
+/*
+ * Drops the keyframes outside oldest..newest.
+ */
+static void drop_keyframes(APEX_History* history)
+{
+  while (history->num_keyframes && keyframe(history, 0)->step < history->oldest) {
+    history->first_keyframe = (history->first_keyframe + 1) % (HISTORY_KEYFRAMES + 1);
+    history->num_keyframes--;
+  }
+  while (history->num_keyframes && keyframe(history, history->num_keyframes - 1)->step > history->newest) {
+    history->num_keyframes--;
+  }
+}
+
+/*
+ * Starts the history over at the state of cpu.
+ */
+void history_reset(APEX_History* history, const APEX_CPU* cpu)
+{
+  history->tail = history->head = history->position = 0;
+  history->oldest = history->newest = history->step = 0;
+  history->start_clock = cpu->clock;
+  history->done = 0;
+  history->last = *cpu;
+  history->first_keyframe = 0;
+  history->num_keyframes = 0;
+  history->deltas = 0;
+  history->delta_words = 0;
+  take_keyframe(history);
+}
+
+/*
+ * Creates a history of about bytes of deltas starting at the state of cpu.
+ * Returns NULL if out of memory.
+ */
+APEX_History* history_create(const APEX_CPU* cpu, size_t bytes)
+{
+  APEX_History* history = calloc(1, sizeof(APEX_History));
+  if (!history) {
+    return NULL;
+  }
+  /* A power of two, and a record never holds more than every word of the
+   * cpu twice */
+  history->capacity = 1;
+  while (history->capacity * 2 <= bytes / sizeof(uint32_t) || history->capacity < 4 * CPU_WORDS) {
+    history->capacity *= 2;
+  }
+  history->ring = malloc(history->capacity * sizeof(uint32_t));
+  history->delta = malloc((2 * CPU_WORDS + 2) * sizeof(uint32_t));
+  if (!history->ring || !history->delta) {
+    history_free(history);
+    return NULL;
+  }
+  history_reset(history, cpu);
+  return history;
+}
+
+void history_free(APEX_History* history)
+{
+  if (!history) {
+    return;
+  }
+  free(history->ring);
+  free(history->delta);
+  free(history);
+}
+
+/*
+ * Builds the record of the changes from the last state to cpu in delta,
+ * makes cpu the last state and returns the words of the record.
+ */
+static uint32_t build_delta(APEX_History* history, const APEX_CPU* cpu)
+{
+  const uint32_t* now = (const uint32_t*)cpu;
+  uint32_t* last = (uint32_t*)&history->last;
+  uint32_t* delta = history->delta;
+  uint32_t n = 1;
+  uint32_t run = 0, next = 0;
+  for (uint32_t block = 0; block < CPU_WORDS; block += BLOCK_WORDS) {
+    uint32_t end = block + BLOCK_WORDS < CPU_WORDS ? block + BLOCK_WORDS : CPU_WORDS;
+    if (memcmp(now + block, last + block, (end - block) * sizeof(uint32_t)) == 0) {
+      continue;
+    }
+    for (uint32_t w = block; w < end; ++w) {
+      uint32_t x = now[w] ^ last[w];
+      if (!x) {
+        continue;
+      }
+      if (!run || w != next) {
+        run = n++;
+        delta[run] = w << 16;
+      }
+      delta[n++] = x;
+      delta[run]++;
+      next = w + 1;
+      last[w] = now[w];
+    }
+  }
+  delta[0] = n + 1;
+  delta[n] = n + 1;
+  return n + 1;
+}
+
+/*
+ * Applies the record at position to the last state.
+ */
+static void apply(APEX_History* history, uint64_t position, uint32_t length)
+{
+  uint32_t* last = (uint32_t*)&history->last;
+  uint64_t end = position + length - 1;
+  for (uint64_t i = position + 1; i < end;) {
+    uint32_t header = ring_get(history, i++);
+    uint32_t offset = header >> 16;
+    uint32_t count = header & 0xffff;
+    for (uint32_t j = 0; j < count; ++j) {
+      last[offset + j] ^= ring_get(history, i++);
+    }
+  }
+}
+
+/*
+ * Records the cycle that took the last state to cpu; done is set if it
+ * completed the program. Recording after a seek back drops the cycles that
+ * were recorded after the current one.
+ */
+void history_record(APEX_History* history, const APEX_CPU* cpu, int done)
+{
+  if (history->step < history->newest) {
+    history->head = history->position;
+    history->newest = history->step;
+    drop_keyframes(history);
+    if (history->num_keyframes) {
+      history->keyframe_due = keyframe(history, history->num_keyframes - 1)->position + history->capacity / HISTORY_KEYFRAMES;
+    }
+  }
+
+  uint32_t length = build_delta(history, cpu);
+  while (history->capacity - (history->head - history->tail) < length) {
+    history->tail += ring_get(history, history->tail);
+    history->oldest++;
+  }
+  for (uint32_t i = 0; i < length; ++i) {
+    history->ring[(history->head + i) & (history->capacity - 1)] = history->delta[i];
+  }
+  history->head += length;
+  history->position = history->head;
+  history->step++;
+  history->newest = history->step;
+  history->done = done;
+  history->deltas++;
+  history->delta_words += length;
+  drop_keyframes(history);
+  if (history->head >= history->keyframe_due || history->num_keyframes == 0) {
+    take_keyframe(history);
+  }
+}
+
+/*
+ * Rebuilds in cpu the state of step, clamped to the steps kept, from the
+ * current state or the keyframe before it, whichever is closer. Changes
+ * made to cpu since the last cycle recorded are dropped.
+ * Returns the step reached.
+ */
+long history_seek(APEX_History* history, APEX_CPU* cpu, long step)
+{
+  if (step < history->oldest) {
+    step = history->oldest;
+  }
+  if (step > history->newest) {
+    step = history->newest;
+  }
+
+  long distance = history->step > step ? history->step - step : step - history->step;
+  for (int i = history->num_keyframes - 1; i >= 0; --i) {
+    History_Keyframe* k = keyframe(history, i);
+    if (k->step <= step) {
+      if (step - k->step < distance) {
+        history->last = k->state;
+        history->step = k->step;
+        history->position = k->position;
+      }
+      break;
+    }
+  }
+
+  while (history->step > step) {
+    uint32_t length = ring_get(history, history->position - 1);
+    history->position -= length;
+    apply(history, history->position, length);
+    history->step--;
+  }
+  while (history->step < step) {
+    uint32_t length = ring_get(history, history->position);
+    apply(history, history->position, length);
+    history->position += length;
+    history->step++;
+  }
+  *cpu = history->last;
+  return step;
+}
+
+void history_print(APEX_History* history)
+{
+  printf("================Execution History=============\n");
+  printf("Cycles recorded      : %ld\n", history->deltas);
+  printf("Cycles kept          : %d .. %d\n", history->start_clock + (int)history->oldest, history->start_clock + (int)history->newest);
+  printf("Average delta        : %.1f bytes per cycle\n", history->deltas ? (double)history->delta_words * sizeof(uint32_t) / history->deltas : 0.0);
+  printf("Ring                 : %.1f of %.1f MB\n", (double)(history->head - history->tail) * sizeof(uint32_t) / (1 << 20), (double)history->capacity * sizeof(uint32_t) / (1 << 20));
+  printf("Keyframes            : %d of %zu bytes\n", history->num_keyframes, sizeof(APEX_CPU));
+  printf("==============================================\n");
+}
@@ -0,0 +1,62 @@
+#ifndef _APEX_HISTORY_H_
+#define _APEX_HISTORY_H_
+/**
+ *  history.h
+ *  Contains the execution history: the state changes of every recent cycle
+ *  kept as deltas in a bounded ring with periodic keyframes, so that a
+ *  simulation can go back to any cycle still in the ring
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdint.h>
+
+#include "cpu.h"
+
+/* Keyframes spread over the ring, a seek replays at most the deltas
+ * between two of them */
+#define HISTORY_KEYFRAMES 16
+
+typedef struct History_Keyframe
+{
+  long step;			    // Cycles after the history started
+  uint64_t position;		    // Ring position of the delta of the next cycle
+  APEX_CPU state;
+} History_Keyframe;
+
+typedef struct APEX_History
+{
+  uint32_t* ring;		    // Deltas, see history.c
+  uint64_t capacity;		    // Words in ring
+  uint64_t tail;		    // Ring position of the oldest delta, counted from the start
+  uint64_t head;		    // Ring position after the newest delta
+  uint64_t position;		    // Ring position after the delta of the current state
+  uint64_t keyframe_due;	    // head at which the next keyframe is taken
+  long oldest;			    // Step of the oldest state it can go back to
+  long newest;			    // Step of the newest state recorded
+  long step;			    // Step of the current state
+  int start_clock;		    // Clock of step 0
+  int done;			    // The newest state completed the program
+  APEX_CPU last;		    // The current state, as recorded
+  uint32_t* delta;		    // Delta being built
+  History_Keyframe keyframes[HISTORY_KEYFRAMES + 1];
+  int first_keyframe;
+  int num_keyframes;
+  long deltas;			    // Cycles recorded
+  uint64_t delta_words;		    // Words of the deltas recorded
+} APEX_History;
+
+APEX_History* history_create(const APEX_CPU* cpu, size_t bytes);
+
+void history_free(APEX_History* history);
+
+void history_reset(APEX_History* history, const APEX_CPU* cpu);
+
+void history_record(APEX_History* history, const APEX_CPU* cpu, int done);
+
+long history_seek(APEX_History* history, APEX_CPU* cpu, long step);
+
+void history_print(APEX_History* history);
+
+#endif
@@ -0,0 +1,308 @@
+/*
+ *  interval.c
+ *  Contains the parallel interval simulation driver. The program is first
+ *  run on the functional model to take architectural checkpoints every K
+ *  instructions; each interval is then simulated cycle-accurately on its
+ *  own thread, starting a short warm-up before the interval boundary.
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "functional.h"
+#include "interval.h"
+
+/* Work shared by all interval threads */
+typedef struct Interval_Pool
+{
+  const APEX_CPU* proto;
+  APEX_Checkpoint* checkpoints;
+  APEX_Interval* intervals;
+  int num_intervals;
+  int cycles;
+  int next;
+  pthread_mutex_t lock;
+} Interval_Pool;
+
+static double elapsed_seconds(struct timespec* start)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*
+ * Records the architectural state of the functional model. Only data
+ * memory words that differ from the initial image are kept.
+ */
+static int take_checkpoint(APEX_Checkpoint* ckpt, const APEX_Func_State* st, const APEX_CPU* proto)
+{
+  int count = 0;
+  for (int i = 0; i < 4096; ++i) {
+    if (st->data_memory[i] != proto->data_memory[i]) {
+      count++;
+    }
+  }
+
+  ckpt->position = st->retired;
+  ckpt->pc = st->pc;
+  ckpt->zeroFlag = st->zeroFlag;
+  memcpy(ckpt->regs, st->regs, sizeof(ckpt->regs));
+  memcpy(ckpt->vregs, st->vregs, sizeof(ckpt->vregs));
+  ckpt->dirty_count = 0;
+  ckpt->dirty_address = malloc(sizeof(int) * (count + 1));
+  ckpt->dirty_value = malloc(sizeof(int) * (count + 1));
+  if (!ckpt->dirty_address || !ckpt->dirty_value) {
+    return -1;
+  }
+
+  for (int i = 0; i < 4096; ++i) {
+    if (st->data_memory[i] != proto->data_memory[i]) {
+      ckpt->dirty_address[ckpt->dirty_count] = i;
+      ckpt->dirty_value[ckpt->dirty_count] = st->data_memory[i];
+      ckpt->dirty_count++;
+    }
+  }
+  return 0;
+}
+
+/*
+ * Loads a checkpoint into a cpu that has not been simulated yet.
+ */
+static void restore_checkpoint(APEX_CPU* cpu, const APEX_Checkpoint* ckpt)
+{
+  cpu->pc = ckpt->pc;
+  cpu->zeroFlag = ckpt->zeroFlag;
+  cpu->commit_zeroFlag = ckpt->zeroFlag;
+  memcpy(cpu->regs, ckpt->regs, sizeof(cpu->regs));
+  memcpy(cpu->dup_regs, ckpt->regs, sizeof(cpu->dup_regs));
+  memcpy(cpu->commit_regs, ckpt->regs, sizeof(cpu->commit_regs));
+  memcpy(cpu->vregs, ckpt->vregs, sizeof(cpu->vregs));
+  memcpy(cpu->dup_vregs, ckpt->vregs, sizeof(cpu->dup_vregs));
+  for (int i = 0; i < ckpt->dirty_count; ++i) {
+    cpu->data_memory[ckpt->dirty_address[i]] = ckpt->dirty_value[i];
+  }
+  cpu->ins_completed = get_code_index(ckpt->pc);
+}
+
+/*
+ * Simulates one interval cycle-accurately. Cycles are counted from the
+ * retirement of the last warm-up instruction to the retirement of the last
+ * instruction of the interval (or the end of the program).
+ */
+static void simulate_interval(Interval_Pool* pool, int k)
+{
+  APEX_Interval* iv = &pool->intervals[k];
+  APEX_CPU* cpu = APEX_cpu_clone(pool->proto);
+  if (!cpu) {
+    iv->cycles = -1;
+    return;
+  }
+  cpu->quiet = 1;
+  restore_checkpoint(cpu, &pool->checkpoints[k]);
+
+  int start_cycle = 0, elapsed = 0, done = 0;
+  int measuring = (iv->warmup == 0);
+  while (!done && elapsed < pool->cycles) {
+    done = APEX_cpu_cycle(cpu);
+    elapsed++;
+    if (!measuring && cpu->ins_retired >= iv->warmup) {
+      measuring = 1;
+      start_cycle = elapsed;
+    }
+    if (measuring && k != pool->num_intervals - 1 && cpu->ins_retired >= iv->warmup + iv->length) {
+      break;
+    }
+  }
+  iv->cycles = elapsed - start_cycle;
+  iv->retired = cpu->ins_retired - iv->warmup;
+  APEX_cpu_stop(cpu);
+}
+
+static void* interval_worker(void* arg)
+{
+  Interval_Pool* pool = arg;
+  for (;;) {
+    pthread_mutex_lock(&pool->lock);
+    int k = pool->next++;
+    pthread_mutex_unlock(&pool->lock);
+    if (k >= pool->num_intervals) {
+      break;
+    }
+    simulate_interval(pool, k);
+  }
+  return NULL;
+}
+
+/*
+ * Runs the full cycle-accurate model on one thread for reference.
+ * Sets *completed if the program ended within the cycles.
+ */
+static int sequential_cycles(const APEX_CPU* proto, int cycles, int* completed)
+{
+  *completed = 0;
+  APEX_CPU* cpu = APEX_cpu_clone(proto);
+  if (!cpu) {
+    return -1;
+  }
+  cpu->quiet = 1;
+  int elapsed = 0;
+  while (elapsed < cycles) {
+    elapsed++;
+    if (APEX_cpu_cycle(cpu)) {
+      *completed = 1;
+      break;
+    }
+  }
+  APEX_cpu_stop(cpu);
+  return elapsed;
+}
+
+/*
+ *  Parallel interval simulation of an initialized (not yet run) cpu.
+ *  interval is the number of instructions per interval, threads the number
+ *  of host threads (0 selects one per online processor).
+ */
+int APEX_interval_run(APEX_CPU* cpu, int cycles, int interval, int threads)
+{
+  if (interval <= 0) {
+    interval = 1000;
+  }
+  if (threads <= 0) {
+    threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads <= 0) {
+      threads = 1;
+    }
+  }
+  int warmup = interval / 10 > 16 ? interval / 10 : 16;
+  cpu->debug = 0;
+
+  /* Functional pass: one checkpoint at the warm-up start of every interval */
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  APEX_Func_State* st = malloc(sizeof(*st));
+  int capacity = 16, num_intervals = 0;
+  APEX_Checkpoint* checkpoints = malloc(sizeof(APEX_Checkpoint) * capacity);
+  if (!st || !checkpoints) {
+    free(st);
+    free(checkpoints);
+    return -1;
+  }
+  APEX_func_init(st, cpu);
+
+  /* No run of cycles cycles retires more: one latch reaches writeback per
+   * cycle, two instructions when fused */
+  long max_instructions = (long)cycles * (cpu->fusion ? 2 : 1);
+  for (;;) {
+    long boundary = (long)num_intervals * interval;
+    long ckpt_position = boundary > warmup ? boundary - warmup : 0;
+    while (st->retired < ckpt_position && st->retired < max_instructions && APEX_func_step(st, cpu)) {
+    }
+    if (st->halted || st->retired >= max_instructions) {
+      break;
+    }
+    if (num_intervals == capacity) {
+      capacity *= 2;
+      checkpoints = realloc(checkpoints, sizeof(APEX_Checkpoint) * capacity);
+      if (!checkpoints) {
+        free(st);
+        return -1;
+      }
+    }
+    if (take_checkpoint(&checkpoints[num_intervals], st, cpu)) {
+      free(st);
+      return -1;
+    }
+    num_intervals++;
+    while (st->retired < boundary && st->retired < max_instructions && APEX_func_step(st, cpu)) {
+    }
+    /* The program ended inside the warm-up, the interval would be empty */
+    if (boundary > 0 && st->retired <= boundary && st->halted) {
+      num_intervals--;
+      free(checkpoints[num_intervals].dirty_address);
+      free(checkpoints[num_intervals].dirty_value);
+      break;
+    }
+  }
+  long total_instructions = st->retired;
+  free(st);
+  double functional_time = elapsed_seconds(&start);
+
+  APEX_Interval* intervals = calloc(num_intervals ? num_intervals : 1, sizeof(APEX_Interval));
+  for (int k = 0; k < num_intervals; ++k) {
+    long boundary = (long)k * interval;
+    intervals[k].start = boundary;
+    intervals[k].warmup = boundary - checkpoints[k].position;
+    intervals[k].length = total_instructions - boundary < interval ? total_instructions - boundary : interval;
+  }
+
+  /* Detailed pass: intervals are handed out to the worker threads */
+  Interval_Pool pool;
+  pool.proto = cpu;
+  pool.checkpoints = checkpoints;
+  pool.intervals = intervals;
+  pool.num_intervals = num_intervals;
+  pool.cycles = cycles;
+  pool.next = 0;
+  pthread_mutex_init(&pool.lock, NULL);
+
+  if (threads > num_intervals && num_intervals > 0) {
+    threads = num_intervals;
+  }
+  pthread_t* workers = malloc(sizeof(pthread_t) * threads);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int t = 0; t < threads; ++t) {
+    pthread_create(&workers[t], NULL, interval_worker, &pool);
+  }
+  for (int t = 0; t < threads; ++t) {
+    pthread_join(workers[t], NULL);
+  }
+  double parallel_time = elapsed_seconds(&start);
+  pthread_mutex_destroy(&pool.lock);
+  free(workers);
+
+  /* Reference run on a single thread to report the stitching error */
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  int completed;
+  int reference = sequential_cycles(cpu, cycles, &completed);
+  double sequential_time = elapsed_seconds(&start);
+
+  long total_cycles = 0, total_retired = 0;
+  printf("\n================Interval Simulation=============\n");
+  printf("%-9s %-12s %-12s %-9s %-9s %-9s\n", "interval", "start", "instructions", "warmup", "cycles", "IPC");
+  for (int k = 0; k < num_intervals; ++k) {
+    APEX_Interval* iv = &intervals[k];
+    printf("%-9d %-12ld %-12d %-9ld %-9d %-9.3f\n", k, iv->start, iv->retired, iv->warmup, iv->cycles,
+           iv->cycles > 0 ? (double)iv->retired / iv->cycles : 0.0);
+    total_cycles += iv->cycles;
+    total_retired += iv->retired;
+  }
+  printf("=================================================\n");
+  printf("Intervals            : %d of %d instructions, %d threads\n", num_intervals, interval, threads);
+  printf("Instructions         : %ld functional, %ld retired\n", total_instructions, total_retired);
+  printf("Stitched cycles      : %ld\n", total_cycles);
+  printf("Sequential cycles    : %d%s\n", reference, completed ? "" : " (cycle limit)");
+  /* Intervals are cut by instructions, a run cut by the cycles retired fewer */
+  if (reference > 0 && completed) {
+    printf("Error                : %.2f%%\n", 100.0 * (total_cycles - reference) / reference);
+  }
+  printf("Functional pass time : %.6f s\n", functional_time);
+  printf("Parallel pass time   : %.6f s\n", parallel_time);
+  printf("Sequential time      : %.6f s\n", sequential_time);
+
+  for (int k = 0; k < num_intervals; ++k) {
+    free(checkpoints[k].dirty_address);
+    free(checkpoints[k].dirty_value);
+  }
+  free(checkpoints);
+  free(intervals);
+  return 0;
+}
@@ -0,0 +1,38 @@
+#ifndef _APEX_INTERVAL_H_
+#define _APEX_INTERVAL_H_
+/**
+ *  interval.h
+ *  Contains the parallel interval simulation driver
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include "cpu.h"
+
+/* Architectural checkpoint taken by the functional model */
+typedef struct APEX_Checkpoint
+{
+  long position;	    // Instructions executed before this checkpoint
+  int pc;		    // Program Counter
+  int regs[32];		    // Integer register file
+  int vregs[NUM_VREGS][VECTOR_LANES]; // Vector register file
+  int zeroFlag;		    // Zero flag
+  int dirty_count;	    // Number of data memory words that differ from the initial image
+  int* dirty_address;	    // Addresses of those words
+  int* dirty_value;	    // Values of those words
+} APEX_Checkpoint;
+
+/* Result of one cycle-accurate interval */
+typedef struct APEX_Interval
+{
+  long start;		    // First instruction of the interval
+  long length;		    // Instructions measured
+  long warmup;		    // Instructions simulated before measuring
+  int cycles;		    // Cycles spent on the measured instructions
+  int retired;		    // Instructions retired while measuring
+} APEX_Interval;
+
+int APEX_interval_run(APEX_CPU* cpu, int cycles, int interval, int threads);
+
+#endif
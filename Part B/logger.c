@@ -0,0 +1,196 @@
+/*
+ *  logger.c
+ *  Contains the asynchronous writer of the display output.
+ *
+ *  With a logger the simulation does not print: it copies the latch of
+ *  every stage, the notices and the cycle headers into a ring of records
+ *  and goes on. A writer thread takes the records in order, formats them
+ *  exactly as they would have been printed and writes them out a block at
+ *  a time, gzip-compressed when the file name ends in .gz. The simulation
+ *  waits only when the ring is full.
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+
+#include "logger.h"
+
+static void pause_briefly(void)
+{
+  struct timespec delay = { 0, 50000 };
+  nanosleep(&delay, NULL);
+}
+
+static void write_block(APEX_Logger* logger)
+{
+  if (logger->length == 0) {
+    return;
+  }
+  if (logger->gz) {
+    gzwrite(logger->gz, logger->block, logger->length);
+  }
+  else {
+    fwrite(logger->block, 1, logger->length, logger->fp);
+  }
+  logger->length = 0;
+}
+
+static void format_record(APEX_Logger* logger, Logger_Record* record)
+{
+  char* out = logger->block + logger->length;
+  switch (record->kind) {
+  case LOGGER_STAGE:
+    logger->length += format_stage_content(out, record->name, &record->stage);
+    break;
+  case LOGGER_CYCLE:
+    logger->length += sprintf(out, "--------------------------------\nClock Cycle #: %d\n--------------------------------\n", record->cycle);
+    break;
+  default:
+    logger->length += sprintf(out, "%s", record->text);
+    break;
+  }
+}
+
+static void* logger_writer(void* arg)
+{
+  APEX_Logger* logger = arg;
+  while (1) {
+    uint64_t tail = logger->tail;
+    uint64_t head = __atomic_load_n(&logger->head, __ATOMIC_ACQUIRE);
+    if (tail == head) {
+      /* Idle: hand what is formatted to the output */
+      write_block(logger);
+      if (logger->fp) {
+        fflush(logger->fp);
+      }
+      __atomic_store_n(&logger->written, tail, __ATOMIC_RELEASE);
+      if (__atomic_load_n(&logger->done, __ATOMIC_ACQUIRE)) {
+        break;
+      }
+      pause_briefly();
+      continue;
+    }
+    for (; tail != head; ++tail) {
+      if (LOGGER_BLOCK - logger->length < APEX_STAGE_LINE) {
+        write_block(logger);
+      }
+      format_record(logger, &logger->ring[tail & (LOGGER_RING - 1)]);
+    }
+    __atomic_store_n(&logger->tail, tail, __ATOMIC_RELEASE);
+  }
+  return NULL;
+}
+
+/*
+ * Starts a writer to filename, stdout if NULL.
+ * Returns NULL if the file cannot be opened.
+ */
+APEX_Logger* logger_create(const char* filename)
+{
+  APEX_Logger* logger = calloc(1, sizeof(APEX_Logger));
+  if (!logger) {
+    return NULL;
+  }
+  size_t length = filename ? strlen(filename) : 0;
+  if (length > 3 && strcmp(filename + length - 3, ".gz") == 0) {
+    /* Fast compression keeps up with the simulation */
+    logger->gz = gzopen(filename, "wb1");
+  }
+  else if (filename) {
+    logger->fp = fopen(filename, "w");
+    logger->close = 1;
+  }
+  else {
+    logger->fp = stdout;
+  }
+  if ((!logger->fp && !logger->gz) || pthread_create(&logger->writer, NULL, logger_writer, logger)) {
+    if (logger->gz) {
+      gzclose(logger->gz);
+    }
+    if (logger->fp && logger->close) {
+      fclose(logger->fp);
+    }
+    free(logger);
+    return NULL;
+  }
+  return logger;
+}
+
+/*
+ * Writes out every record queued and stops the writer.
+ */
+void logger_free(APEX_Logger* logger)
+{
+  if (!logger) {
+    return;
+  }
+  __atomic_store_n(&logger->done, 1, __ATOMIC_RELEASE);
+  pthread_join(logger->writer, NULL);
+  if (logger->gz) {
+    gzclose(logger->gz);
+  }
+  if (logger->fp && logger->close) {
+    fclose(logger->fp);
+  }
+  free(logger);
+}
+
+/*
+ * Returns the next free record, waiting for the writer if the ring is full.
+ */
+static Logger_Record* next_record(APEX_Logger* logger)
+{
+  while (logger->head - __atomic_load_n(&logger->tail, __ATOMIC_ACQUIRE) == LOGGER_RING) {
+    logger->full_waits++;
+    sched_yield();
+  }
+  return &logger->ring[logger->head & (LOGGER_RING - 1)];
+}
+
+static void publish(APEX_Logger* logger)
+{
+  __atomic_store_n(&logger->head, logger->head + 1, __ATOMIC_RELEASE);
+}
+
+void logger_stage(APEX_Logger* logger, const char* name, CPU_Stage* stage)
+{
+  Logger_Record* record = next_record(logger);
+  record->kind = LOGGER_STAGE;
+  strncpy(record->name, name, sizeof(record->name) - 1);
+  record->name[sizeof(record->name) - 1] = '\0';
+  record->stage = *stage;
+  publish(logger);
+}
+
+void logger_text(APEX_Logger* logger, const char* text)
+{
+  Logger_Record* record = next_record(logger);
+  record->kind = LOGGER_TEXT;
+  record->text = text;
+  publish(logger);
+}
+
+void logger_cycle(APEX_Logger* logger, int cycle)
+{
+  Logger_Record* record = next_record(logger);
+  record->kind = LOGGER_CYCLE;
+  record->cycle = cycle;
+  publish(logger);
+}
+
+/*
+ * Waits until every record queued has been written out.
+ */
+void logger_drain(APEX_Logger* logger)
+{
+  while (__atomic_load_n(&logger->written, __ATOMIC_ACQUIRE) != logger->head) {
+    pause_briefly();
+  }
+}
@@ -0,0 +1,73 @@
+#ifndef _APEX_LOGGER_H_
+#define _APEX_LOGGER_H_
+/**
+ *  logger.h
+ *  Contains the asynchronous writer of the display output: the simulation
+ *  queues what it would print and a writer thread formats and writes it
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cpu.h"
+
+/* Records in the ring, a power of two */
+#define LOGGER_RING 4096
+
+/* Bytes the writer formats before it writes them out */
+#define LOGGER_BLOCK (64 * 1024)
+
+/* Kind of a record */
+enum
+{
+  LOGGER_STAGE,			    // Latch of a stage, printed by print_stage_content
+  LOGGER_TEXT,			    // Notice, a string literal
+  LOGGER_CYCLE			    // Clock cycle header
+};
+
+typedef struct Logger_Record
+{
+  int kind;
+  int cycle;			    // Clock cycle of LOGGER_CYCLE
+  const char* text;		    // Notice of LOGGER_TEXT
+  char name[48];		    // Stage label of LOGGER_STAGE
+  CPU_Stage stage;		    // Latch of LOGGER_STAGE
+} Logger_Record;
+
+/*
+ * Single-producer single-consumer ring. The simulation only writes head
+ * and the writer only writes tail, each published with a release store.
+ */
+typedef struct APEX_Logger
+{
+  Logger_Record ring[LOGGER_RING];
+  uint64_t head;		    // Records queued
+  uint64_t tail;		    // Records formatted
+  uint64_t written;		    // Records written out
+  int done;			    // Set when the writer should finish
+  long full_waits;		    // Times the simulation waited for a free record
+  FILE* fp;			    // Output, NULL when compressed
+  void* gz;			    // gzip output of a .gz file
+  int close;			    // fp was opened by the logger
+  char block[LOGGER_BLOCK];
+  int length;			    // Bytes in block
+  pthread_t writer;
+} APEX_Logger;
+
+APEX_Logger* logger_create(const char* filename);
+
+void logger_free(APEX_Logger* logger);
+
+void logger_stage(APEX_Logger* logger, const char* name, CPU_Stage* stage);
+
+void logger_text(APEX_Logger* logger, const char* text);
+
+void logger_cycle(APEX_Logger* logger, int cycle);
+
+void logger_drain(APEX_Logger* logger);
+
+#endif
@@ -0,0 +1,151 @@
+/*
+ *  loop.c
+ *  Contains the loop buffer of fetch for the LOOP instruction.
+ *
+ *  LOOP Rc,#n closes a counted loop whose body is the n instructions before
+ *  it: it decrements Rc and goes back to the first of them while Rc is not
+ *  zero. It writes Rc but not the zero flag.
+ *
+ *  The first time a LOOP is taken and its body fits, the body and the LOOP
+ *  are copied into the loop buffer. From then on fetch reads them from the
+ *  buffer and, at the LOOP, counts Rc down itself: it goes straight back to
+ *  the head while the count lasts and falls through on the last iteration,
+ *  so no iteration pays a flush. If the body does not write Rc, fetch also
+ *  hands the count to the LOOP, which then does not wait in DRF for the
+ *  LOOP before it. The LOOP still resolves in the branch stage, and only
+ *  flushes if the body changed Rc and fetch went the wrong way. A taken branch or jump squashes LOOPs fetch has counted, so the
+ *  count is taken again from the youngest LOOP left.
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "loop.h"
+
+/*
+ * Returns true if the instruction may write the count register
+ */
+static bool writes_count(APEX_Instruction* ins, int reg)
+{
+  int op = get_opcode_id(ins->opcode);
+  return ins->rd == reg && op != OP_STORE && op != OP_STR && op != OP_BZ && op != OP_BNZ && op != OP_JUMP && op != OP_HALT && op != OP_VSTORE;
+}
+
+/*
+ * Returns the buffered instruction at pc, NULL if fetch reads it from code
+ * memory.
+ */
+APEX_Instruction* loop_lookup(APEX_CPU* cpu, int pc)
+{
+  Loop_Buffer* loop = &cpu->loop;
+  if (!loop->armed || pc < loop->head || pc > loop->end) {
+    return NULL;
+  }
+  return &loop->body[(pc - loop->head) / 4];
+}
+
+/*
+ * Returns the PC fetched after the instruction in the fetch latch, which
+ * moves on to DRF this cycle.
+ */
+int loop_next_pc(APEX_CPU* cpu, CPU_Stage* stage)
+{
+  Loop_Buffer* loop = &cpu->loop;
+  stage->predicted = LOOP_NOT_PREDICTED;
+  stage->counted = 0;
+  if (!loop_lookup(cpu, stage->pc)) {
+    return stage->pc + 4;
+  }
+  cpu->loop_hits++;
+  if (stage->pc != loop->end) {
+    return stage->pc + 4;
+  }
+  if (loop->counted) {
+    stage->counted = 1;
+    stage->rs1_value = loop->count;
+  }
+  loop->count--;
+  if (loop->count == 0) {
+    stage->predicted = LOOP_PREDICTED_EXIT;
+    loop->armed = 0;
+    return stage->pc + 4;
+  }
+  stage->predicted = LOOP_PREDICTED_TAKEN;
+  return loop->head;
+}
+
+/*
+ * Updates the loop buffer with the outcome of a LOOP in the branch stage.
+ */
+void loop_resolve(APEX_CPU* cpu, CPU_Stage* stage)
+{
+  Loop_Buffer* loop = &cpu->loop;
+  int taken = stage->buffer != 0;
+  if (stage->predicted != LOOP_NOT_PREDICTED && taken != (stage->predicted == LOOP_PREDICTED_TAKEN)) {
+    cpu->loop_mispredicts++;
+  }
+  if (!taken) {
+    /* Fetch went back to the head for an iteration that is not run */
+    if (stage->predicted == LOOP_PREDICTED_TAKEN) {
+      loop->armed = 0;
+    }
+    return;
+  }
+  if (stage->predicted == LOOP_PREDICTED_TAKEN) {
+    return;
+  }
+
+  /* Fetch is redirected to the head now, the next LOOP it fetches reads
+   * the count this one wrote */
+  int length = stage->imm + 1;
+  int head = get_code_index(stage->pc) - stage->imm;
+  if (stage->imm < 0 || length > cpu->loop_buffer_size || head < 0) {
+    loop->armed = 0;
+    return;
+  }
+  memcpy(loop->body, &cpu->code_memory[head], sizeof(APEX_Instruction) * length);
+  loop->head = stage->pc - 4 * stage->imm;
+  loop->end = stage->pc;
+  loop->reg = stage->rd;
+  loop->count = stage->buffer;
+  loop->counted = 1;
+  for (int i = 0; i < stage->imm; ++i) {
+    loop->counted = loop->counted && !writes_count(&loop->body[i], loop->reg);
+  }
+  loop->armed = 1;
+}
+
+/*
+ * Takes the count again after a taken branch or jump squashed the
+ * instructions behind the branch stage.
+ */
+void loop_flush(APEX_CPU* cpu)
+{
+  Loop_Buffer* loop = &cpu->loop;
+  if (!loop->armed) {
+    return;
+  }
+  /* stage[branch_stage + 1] still holds a copy of the next one */
+  loop->count = cpu->commit_regs[loop->reg];
+  for (int i = cpu->wb; i > cpu->branch_stage + 1; --i) {
+    CPU_Stage* stage = &cpu->stage[i];
+    if (stage->tid == cpu->tid && stage->pc == loop->end && compare_opcode(stage->opcode, "LOOP")) {
+      loop->count = stage->buffer;
+    }
+  }
+}
+
+void loop_print(APEX_CPU* cpu)
+{
+  printf("================Loop buffer=============\n");
+  printf("Buffer size          : %d\n", cpu->loop_buffer_size);
+  printf("LOOPs retired        : %d\n", cpu->loops_retired);
+  printf("Buffered iterations  : %d\n", cpu->loop_redirects);
+  printf("Loop buffer hits     : %d\n", cpu->loop_hits);
+  printf("Mispredicted LOOPs   : %d\n", cpu->loop_mispredicts);
+  printf("========================================\n");
+}
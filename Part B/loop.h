@@ -0,0 +1,33 @@
+#ifndef _APEX_LOOP_H_
+#define _APEX_LOOP_H_
+/**
+ *  loop.h
+ *  Contains the loop buffer of fetch: once a LOOP has been taken its body
+ *  is fetched from the buffer and every further iteration starts without
+ *  a flush
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include "cpu.h"
+
+/* Prediction fetch made for a LOOP, kept in CPU_Stage.predicted */
+enum
+{
+  LOOP_NOT_PREDICTED,		    // Not fetched from the loop buffer
+  LOOP_PREDICTED_TAKEN,		    // Fetch went back to the head
+  LOOP_PREDICTED_EXIT		    // Fetch fell through on the last iteration
+};
+
+APEX_Instruction* loop_lookup(APEX_CPU* cpu, int pc);
+
+int loop_next_pc(APEX_CPU* cpu, CPU_Stage* stage);
+
+void loop_resolve(APEX_CPU* cpu, CPU_Stage* stage);
+
+void loop_flush(APEX_CPU* cpu);
+
+void loop_print(APEX_CPU* cpu);
+
+#endif
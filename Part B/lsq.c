@@ -0,0 +1,147 @@
+/*
+ *  lsq.c
+ *  Contains the load/store queue. Stores leave MEM1 into a FIFO store
+ *  buffer. Writing a buffered store to data memory holds the memory port
+ *  for store_latency cycles; the oldest store starts its write once the
+ *  port is free and MEM1 is not loading, so stores issued faster than that
+ *  queue up. With the DRAM model the buffer instead posts its oldest
+ *  store to the memory controller queue, one a cycle while the queue has
+ *  room. Loads search the buffer from the youngest entry and take the
+ *  value of the newest matching store; a load that misses it waits for
+ *  the port.
+ *
+ *  All APEX accesses are single words and store addresses are computed in
+ *  EX1, so an older store always has a known, non-overlapping address by
+ *  the time a younger load reaches MEM1. The structural stalls left are a
+ *  full store buffer and a load waiting for the port.
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lsq.h"
+#include "dram.h"
+
+/*
+ * Appends a store to the buffer. Returns false if the buffer is full.
+ */
+bool lsq_store(APEX_CPU* cpu, int address, int value)
+{
+  if (cpu->sb_count == cpu->lsq_size) {
+    cpu->lsq_full_stalls++;
+    return false;
+  }
+  int tail = (cpu->sb_head + cpu->sb_count) % MAX_STORE_BUFFER;
+  cpu->store_buffer[tail].address = address;
+  cpu->store_buffer[tail].value = value;
+  cpu->sb_count++;
+  cpu->lsq_stores++;
+  return true;
+}
+
+/*
+ * Looks for the youngest buffered store to address.
+ * Returns true and sets *value if the load can be forwarded.
+ */
+bool lsq_forward(APEX_CPU* cpu, int address, int* value)
+{
+  cpu->lsq_loads++;
+  for (int i = cpu->sb_count - 1; i >= 0; --i) {
+    Store_Buffer_Entry* entry = &cpu->store_buffer[(cpu->sb_head + i) % MAX_STORE_BUFFER];
+    if (entry->address == address) {
+      *value = entry->value;
+      cpu->lsq_forwards++;
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * Returns true if a buffered store writes address, without counting a load.
+ */
+bool lsq_holds(APEX_CPU* cpu, int address)
+{
+  for (int i = 0; i < cpu->sb_count; ++i) {
+    if (cpu->store_buffer[(cpu->sb_head + i) % MAX_STORE_BUFFER].address == address) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void write_oldest(APEX_CPU* cpu)
+{
+  Store_Buffer_Entry* entry = &cpu->store_buffer[cpu->sb_head];
+  if (entry->address >= 0 && entry->address < 4096) {
+    cpu->data_memory[entry->address] = entry->value;
+  }
+  cpu->sb_head = (cpu->sb_head + 1) % MAX_STORE_BUFFER;
+  cpu->sb_count--;
+  cpu->lsq_drains++;
+}
+
+/*
+ * Returns true if a load of words words at address in MEM1 has to wait
+ * for the store being written, counting the stall.
+ */
+bool lsq_port_wait(APEX_CPU* cpu, int address, int words)
+{
+  if (cpu->dram.channels || cpu->clock >= cpu->sb_port_free) {
+    return false;
+  }
+  for (int i = 0; i < words; ++i) {
+    if (!lsq_holds(cpu, address + i)) {
+      cpu->lsq_port_stalls++;
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * Starts writing the oldest buffered store to data memory once the last
+ * write is done. With the DRAM model it is queued there instead whenever
+ * the queue has room.
+ */
+void lsq_drain(APEX_CPU* cpu)
+{
+  if (cpu->sb_count == 0 || cpu->clock < cpu->sb_port_free) {
+    return;
+  }
+  if (cpu->dram.channels) {
+    if (dram_post_write(cpu, cpu->store_buffer[cpu->sb_head].address)) {
+      write_oldest(cpu);
+    }
+    return;
+  }
+  write_oldest(cpu);
+  cpu->sb_port_free = cpu->clock + cpu->store_latency;
+}
+
+/*
+ * Writes every buffered store to data memory.
+ */
+void lsq_flush(APEX_CPU* cpu)
+{
+  while (cpu->sb_count) {
+    write_oldest(cpu);
+  }
+}
+
+void lsq_print_stats(APEX_CPU* cpu)
+{
+  printf("================Load/Store Queue=============\n");
+  printf("Store buffer entries : %d\n", cpu->lsq_size);
+  printf("Stores buffered      : %d\n", cpu->lsq_stores);
+  printf("Stores drained       : %d\n", cpu->lsq_drains);
+  printf("Loads                : %d\n", cpu->lsq_loads);
+  printf("Loads forwarded      : %d\n", cpu->lsq_forwards);
+  printf("Store buffer stalls  : %d\n", cpu->lsq_full_stalls);
+  printf("Memory port stalls   : %d\n", cpu->lsq_port_stalls);
+  printf("=============================================\n");
+}
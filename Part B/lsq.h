@@ -0,0 +1,28 @@
+#ifndef _APEX_LSQ_H_
+#define _APEX_LSQ_H_
+/**
+ *  lsq.h
+ *  Contains the load/store queue: a store buffer that drains to data
+ *  memory in the background and forwards to younger loads
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include "cpu.h"
+
+bool lsq_store(APEX_CPU* cpu, int address, int value);
+
+bool lsq_forward(APEX_CPU* cpu, int address, int* value);
+
+bool lsq_holds(APEX_CPU* cpu, int address);
+
+bool lsq_port_wait(APEX_CPU* cpu, int address, int words);
+
+void lsq_drain(APEX_CPU* cpu);
+
+void lsq_flush(APEX_CPU* cpu);
+
+void lsq_print_stats(APEX_CPU* cpu);
+
+#endif
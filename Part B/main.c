@@ -9,15 +9,180 @@
 #include <stdlib.h>
 #include <string.h>
 #include "cpu.h"
+#include "interval.h"
+#include "trace.h"
+#include "config.h"
+#include "profile.h"
+#include "cache.h"
+#include "steady.h"
+#include "series.h"
+#include "telemetry.h"
+#include "multicore.h"
+#include "smt.h"
+#include "vector.h"
+#include "estimate.h"
+#include "logger.h"
+#include "data.h"
+#include "history.h"
 
 int simluate(APEX_CPU* cpu,int cycles);
 int display(APEX_CPU* cpu,int cycles);
 int get_num_from_string(char* buffer);
+int multicore(APEX_CPU* cpu,int cycles,const char** files,int num_files);
+int smt(APEX_CPU* cpu,int cycles,const char** files,int num_files);
+int debug(APEX_CPU* cpu,int cycles);
+
+/* Result cache directory, NULL when caching is off */
+static const char* cache_dir;
+static long cache_limit = 64L << 20;
+
+/* Multicore interconnect */
+static int coherence = APEX_COHERENCE_MSI;
+static int bus_latency = 20;
+static int quantum;
+
+/* Interval time series, NULL when not recorded */
+static const char* series_file;
+static int series_interval = 1000;
+
+/* Live telemetry page, NULL when not published */
+static const char* telemetry_file;
+static int telemetry_interval = 100000;
+
+/* Display output written by a thread of its own, stdout when NULL */
+static int logging;
+static const char* log_file;
+
+/* Execution history of debug mode, in MB */
+static int history_mb = 64;
+
+/* Multithreading fetch policy */
+static int fetch_policy = APEX_FETCH_RR;
+
+/*
+ *  Applies a --name[=value] option to the cpu.
+ *  Returns 0 if the option is recognized.
+ */
+static int apply_option(APEX_CPU* cpu, const char* arg)
+{
+  const char* value = strchr(arg, '=');
+  value = value ? value + 1 : NULL;
+
+  if (strcmp(arg, "--lsq") == 0 || strncmp(arg, "--lsq=", 6) == 0) {
+    cpu->lsq_size = value ? atoi(value) : 8;
+    if (cpu->lsq_size < 1 || cpu->lsq_size > MAX_STORE_BUFFER) {
+      fprintf(stderr, "APEX_Error : Store buffer size must be 1..%d\n", MAX_STORE_BUFFER);
+      return 1;
+    }
+    return 0;
+  }
+  if (strncmp(arg, "--config=", 9) == 0) {
+    if (APEX_config_load(cpu, value)) {
+      return 1;
+    }
+    APEX_config_print(cpu);
+    return 0;
+  }
+  if (strncmp(arg, "--cache-limit=", 14) == 0) {
+    cache_limit = atol(value) << 20;
+    return 0;
+  }
+  if (strcmp(arg, "--cache") == 0 || strncmp(arg, "--cache=", 8) == 0) {
+    cache_dir = value ? value : ".apex_cache";
+    return 0;
+  }
+  if (strcmp(arg, "--profile") == 0) {
+    if (!cpu->profile) {
+      cpu->profile = profile_create(cpu);
+    }
+    return 0;
+  }
+  if (strcmp(arg, "--bus") == 0) {
+    coherence = APEX_COHERENCE_BUS;
+    return 0;
+  }
+  if (strncmp(arg, "--bus-latency=", 14) == 0) {
+    bus_latency = atoi(value);
+    return 0;
+  }
+  if (strncmp(arg, "--quantum=", 10) == 0) {
+    quantum = atoi(value);
+    return 0;
+  }
+  if (strcmp(arg, "--fetch=rr") == 0) {
+    fetch_policy = APEX_FETCH_RR;
+    return 0;
+  }
+  if (strcmp(arg, "--fetch=icount") == 0) {
+    fetch_policy = APEX_FETCH_ICOUNT;
+    return 0;
+  }
+  if (strncmp(arg, "--series=", 9) == 0) {
+    series_file = value;
+    return 0;
+  }
+  if (strncmp(arg, "--series-interval=", 18) == 0) {
+    series_interval = atoi(value);
+    if (series_interval < 1) {
+      fprintf(stderr, "APEX_Error : Series interval must be at least 1 cycle\n");
+      return 1;
+    }
+    return 0;
+  }
+  if (strncmp(arg, "--telemetry=", 12) == 0) {
+    telemetry_file = value;
+    return 0;
+  }
+  if (strncmp(arg, "--telemetry-interval=", 21) == 0) {
+    telemetry_interval = atoi(value);
+    if (telemetry_interval < 1) {
+      fprintf(stderr, "APEX_Error : Telemetry interval must be at least 1 cycle\n");
+      return 1;
+    }
+    return 0;
+  }
+  if (strcmp(arg, "--log") == 0 || strncmp(arg, "--log=", 6) == 0) {
+    logging = 1;
+    log_file = value;
+    return 0;
+  }
+  if (strncmp(arg, "--data=", 7) == 0) {
+    APEX_Data_Image* image = data_image_open(value);
+    if (!image) {
+      return 1;
+    }
+    data_image_load(image, cpu);
+    data_image_close(image);
+    return 0;
+  }
+  if (strncmp(arg, "--history=", 10) == 0) {
+    history_mb = atoi(value);
+    if (history_mb < 1) {
+      fprintf(stderr, "APEX_Error : History must be at least 1 MB\n");
+      return 1;
+    }
+    return 0;
+  }
+  if (strcmp(arg, "--fusion") == 0) {
+    cpu->fusion = 1;
+    return 0;
+  }
+  if (strcmp(arg, "--steady") == 0) {
+    if (!cpu->steady) {
+      cpu->steady = steady_create(cpu);
+    }
+    return 0;
+  }
+  fprintf(stderr, "APEX_Error : Unknown option %s\n", arg);
+  return 1;
+}
 
 int main(int argc, char const* argv[])
 {
-  if (argc != 4) {
-    fprintf(stderr, "APEX_Help : Usage %s <input_file>\n", argv[0]);
+  if (argc < 4) {
+    fprintf(stderr, "APEX_Help : Usage %s <input_file> <simulate|display|intervals|record|replay|multicore|smt|estimate|debug> <cycles> [mode arguments] [options]\n", argv[0]);
+    fprintf(stderr, "APEX_Help : intervals [interval_size] [threads], record <trace_file>, replay <trace_file>, multicore [input_file ...], smt [input_file ...]\n");
+    fprintf(stderr, "APEX_Help : Options --lsq[=entries] --config=<pipeline_file> --profile --cache[=dir] --cache-limit=<MB> --steady --bus --bus-latency=<cycles> --quantum=<cycles> --fetch=<rr|icount> --series=<csv_file> --series-interval=<cycles> --telemetry=<file> --telemetry-interval=<cycles> --fusion --log[=file] --data=<image_file> --history=<MB>\n");
     exit(1);
   }
   APEX_CPU* cpu = APEX_cpu_init(argv[1]);
@@ -29,7 +194,116 @@ int main(int argc, char const* argv[])
     fprintf(stderr, "APEX_Error : Unable to initialize CPU\n");
     exit(1);
   }
-  if(strcmp(argv[2],"simulate")){
+
+
+  /* Options start with --, everything else is a mode argument */
+  const char* extra[APEX_MAX_CORES];
+  int num_extra = 0;
+  for (int i = 4; i < argc; ++i) {
+    if (strncmp(argv[i], "--", 2) == 0) {
+      if (apply_option(cpu, argv[i])) {
+        APEX_cpu_stop(cpu);
+        exit(1);
+      }
+    }
+    else if (num_extra < APEX_MAX_CORES) {
+      extra[num_extra++] = argv[i];
+    }
+  }
+
+  if (series_file) {
+    cpu->series = series_create(series_file, series_interval);
+    if (!cpu->series) {
+      fprintf(stderr, "APEX_Error : Unable to open %s\n", series_file);
+      APEX_cpu_stop(cpu);
+      exit(1);
+    }
+  }
+  /* Loop extrapolation replays single instructions, not fused pairs */
+  if (cpu->fusion && cpu->steady) {
+    fprintf(stderr, "APEX_Warning : Loop extrapolation is off with fusion\n");
+    steady_free(cpu->steady);
+    cpu->steady = NULL;
+  }
+  /* Nor does it carry the open rows of the DRAM into the skipped iterations */
+  if (cpu->dram.channels && cpu->steady) {
+    fprintf(stderr, "APEX_Warning : Loop extrapolation is off with the DRAM model\n");
+    steady_free(cpu->steady);
+    cpu->steady = NULL;
+  }
+  if (telemetry_file) {
+    cpu->telemetry = telemetry_create(telemetry_file, telemetry_interval, argv[1]);
+    if (!cpu->telemetry) {
+      fprintf(stderr, "APEX_Error : Unable to map %s\n", telemetry_file);
+      APEX_cpu_stop(cpu);
+      exit(1);
+    }
+  }
+
+  if (logging) {
+    if (strcmp(argv[2],"simulate") && strcmp(argv[2],"display")) {
+      fprintf(stderr, "APEX_Warning : --log applies to simulate and display\n");
+    }
+    else if (!(cpu->logger = logger_create(log_file))) {
+      fprintf(stderr, "APEX_Error : Unable to open %s\n", log_file ? log_file : "stdout");
+      APEX_cpu_stop(cpu);
+      exit(1);
+    }
+  }
+
+  if(strcmp(argv[2],"intervals") == 0){
+    int interval = num_extra > 0 ? atoi(extra[0]) : 0;
+    int threads = num_extra > 1 ? atoi(extra[1]) : 0;
+    APEX_interval_run(cpu,cycles,interval,threads);
+  }
+  else if(strcmp(argv[2],"record") == 0 || strcmp(argv[2],"replay") == 0){
+    if (num_extra < 1) {
+      fprintf(stderr, "APEX_Error : %s needs a trace file\n", argv[2]);
+    }
+    else if (strcmp(argv[2],"record") == 0) {
+      APEX_trace_record(cpu,extra[0],cycles);
+    }
+    else {
+      if (cpu->lsq_size) {
+        fprintf(stderr, "APEX_Warning : Replay does not model the load/store queue\n");
+      }
+      if (cpu->fusion) {
+        fprintf(stderr, "APEX_Warning : Replay does not model fusion\n");
+      }
+      if (cpu->dram.channels) {
+        fprintf(stderr, "APEX_Warning : Replay does not model the DRAM\n");
+      }
+      for (int i = 0; i < cpu->code_memory_size; ++i) {
+        if (cpu->loop_buffer_size && compare_opcode(cpu->code_memory[i].opcode, "LOOP")) {
+          fprintf(stderr, "APEX_Warning : Replay does not model the loop buffer, LOOPs flush when taken\n");
+          break;
+        }
+      }
+      APEX_trace_replay(cpu,extra[0],cycles);
+    }
+  }
+  else if(strcmp(argv[2],"multicore") == 0){
+    multicore(cpu,cycles,extra,num_extra);
+  }
+  else if(strcmp(argv[2],"smt") == 0){
+    smt(cpu,cycles,extra,num_extra);
+  }
+  else if(strcmp(argv[2],"estimate") == 0){
+    if (cpu->lsq_size) {
+      fprintf(stderr, "APEX_Warning : The estimate does not model the load/store queue\n");
+    }
+    if (cpu->fusion) {
+      fprintf(stderr, "APEX_Warning : The estimate does not model fusion\n");
+    }
+    if (cpu->dram.channels) {
+      fprintf(stderr, "APEX_Warning : The estimate does not model the DRAM\n");
+    }
+    APEX_estimate_run(cpu,cycles);
+  }
+  else if(strcmp(argv[2],"debug") == 0){
+    debug(cpu,cycles);
+  }
+  else if(strcmp(argv[2],"simulate")){
     simluate(cpu,cycles);
   }
   else if(strcmp(argv[2],"display")){
@@ -49,6 +323,186 @@ int simluate(APEX_CPU* cpu,int cycles){
 }
 
 int display(APEX_CPU* cpu,int cycles){
+  /* A profile, time series, fusion or DRAM report needs the simulation itself */
+  if(cache_dir && !cpu->profile && !cpu->steady && !cpu->series && !cpu->fusion && !cpu->dram.channels){
+    APEX_cache_run(cpu,cycles,cache_dir,cache_limit);
+    return 0;
+  }
+  /* Skipped iterations print no flush notices, so none are printed */
+  if(cpu->steady){
+    cpu->quiet = 1;
+    if(APEX_cpu_simulate(cpu,cycles,0)){
+      printf("(apex) >> Simulation Complete\n");
+    }
+    APEX_cpu_print_state(cpu);
+    return 0;
+  }
   APEX_cpu_run(cpu,cycles,0);
   return 0;
-}
\ No newline at end of file
+}
+/*
+ *  Runs cpu as core 0 and one more core per input file, all with the
+ *  pipeline of core 0.
+ */
+int multicore(APEX_CPU* cpu,int cycles,const char** files,int num_files){
+  APEX_CPU* cpus[APEX_MAX_CORES];
+  int num_cores = 1;
+  cpus[0] = cpu;
+  if (cpu->lsq_size) {
+    fprintf(stderr, "APEX_Warning : Multicore does not model the load/store queue\n");
+    cpu->lsq_size = 0;
+  }
+  if (cpu->dram.channels) {
+    fprintf(stderr, "APEX_Warning : Multicore does not model the DRAM, memory is behind the bus\n");
+    cpu->dram.channels = 0;
+  }
+  if (num_files >= APEX_MAX_CORES) {
+    fprintf(stderr, "APEX_Error : At most %d cores are supported\n", APEX_MAX_CORES);
+    return 1;
+  }
+  for (int i = 0; i < num_files; ++i) {
+    APEX_CPU* core = APEX_cpu_init(files[i]);
+    if (!core) {
+      fprintf(stderr, "APEX_Error : Unable to initialize core for %s\n", files[i]);
+      break;
+    }
+    core->num_stages = cpu->num_stages;
+    core->mem1 = cpu->mem1;
+    core->wb = cpu->wb;
+    core->branch_stage = cpu->branch_stage;
+    core->branch_stall = cpu->branch_stall;
+    core->fusion = cpu->fusion;
+    core->loop_buffer_size = cpu->loop_buffer_size;
+    memcpy(core->forward, cpu->forward, sizeof(core->forward));
+    memcpy(core->latency, cpu->latency, sizeof(core->latency));
+    cpus[num_cores++] = core;
+  }
+  /* The caches move single words, vector accesses are not modelled */
+  bool vectors = false;
+  for (int i = 0; i < num_cores; ++i) {
+    vectors = vectors || is_vector_program(cpus[i]);
+  }
+  if (vectors) {
+    fprintf(stderr, "APEX_Error : Multicore does not model vector instructions\n");
+  }
+  if (num_cores == num_files + 1 && !vectors) {
+    APEX_multicore_run(cpus,num_cores,cycles,coherence,quantum,bus_latency);
+  }
+  for (int i = 1; i < num_cores; ++i) {
+    APEX_cpu_stop(cpus[i]);
+  }
+  return 0;
+}
+/*
+ *  Runs the program of cpu as thread 0 and one more thread per input file,
+ *  all on the pipeline of cpu.
+ */
+int smt(APEX_CPU* cpu,int cycles,const char** files,int num_files){
+  APEX_CPU* cpus[APEX_MAX_THREADS];
+  int num_threads = 1;
+  cpus[0] = cpu;
+  if (cpu->lsq_size) {
+    fprintf(stderr, "APEX_Warning : Multithreading does not model the load/store queue\n");
+    cpu->lsq_size = 0;
+  }
+  if (cpu->profile || cpu->steady || cpu->series) {
+    fprintf(stderr, "APEX_Warning : Profiling, loop extrapolation and the time series are off with multithreading\n");
+    profile_free(cpu->profile);
+    steady_free(cpu->steady);
+    series_free(cpu->series);
+    cpu->profile = NULL;
+    cpu->steady = NULL;
+    cpu->series = NULL;
+  }
+  if (num_files >= APEX_MAX_THREADS) {
+    fprintf(stderr, "APEX_Error : At most %d threads are supported\n", APEX_MAX_THREADS);
+    return 1;
+  }
+  for (int i = 0; i < num_files; ++i) {
+    APEX_CPU* thread = APEX_cpu_init(files[i]);
+    if (!thread) {
+      fprintf(stderr, "APEX_Error : Unable to initialize thread for %s\n", files[i]);
+      break;
+    }
+    cpus[num_threads++] = thread;
+  }
+  if (num_threads == num_files + 1) {
+    APEX_smt_run(cpus,num_threads,cycles,fetch_policy);
+  }
+  for (int i = 1; i < num_threads; ++i) {
+    APEX_cpu_stop(cpus[i]);
+  }
+  return 0;
+}
+/*
+ *  Reads commands from stdin and moves the cpu forwards by simulating and
+ *  backwards through its execution history, up to cycles cycles.
+ */
+int debug(APEX_CPU* cpu,int cycles){
+  /* Skipped iterations would leave no history behind */
+  if (cpu->steady) {
+    fprintf(stderr, "APEX_Warning : Loop extrapolation is off in debug mode\n");
+    steady_free(cpu->steady);
+    cpu->steady = NULL;
+  }
+  APEX_History* history = history_create(cpu, (size_t)history_mb << 20);
+  if (!history) {
+    fprintf(stderr, "APEX_Error : Unable to allocate the history\n");
+    return 1;
+  }
+  printf("(apex) step [n], back [n], goto <cycle>, run, stages, state, history, quit\n");
+  char line[128];
+  int done = 0;
+  printf("(apex) ");
+  fflush(stdout);
+  while (fgets(line, sizeof(line), stdin)) {
+    char command[16];
+    int n = 1;
+    int args = sscanf(line, "%15s %d", command, &n);
+    if (args < 1) {
+      command[0] = '\0';
+    }
+    if (strcmp(command, "step") == 0 || strcmp(command, "run") == 0) {
+      /* run goes on quietly until HALT or the cycle limit */
+      int run = strcmp(command, "run") == 0;
+      cpu->debug = !run;
+      for (int i = 0; (run || i < n) && !done && history->start_clock + history->step < cycles; ++i) {
+        done = APEX_cpu_cycle(cpu);
+        history_record(history, cpu, done);
+      }
+      cpu->debug = 1;
+      printf("(apex) >> Cycle %ld%s\n", history->start_clock + history->step, done ? ", simulation complete" : "");
+    }
+    else if (strcmp(command, "back") == 0 || strcmp(command, "goto") == 0) {
+      if (strcmp(command, "goto") == 0 && args < 2) {
+        printf("(apex) >> goto needs a cycle\n");
+      }
+      else {
+        long step = strcmp(command, "back") == 0 ? history->step - n : n - history->start_clock;
+        history_seek(history, cpu, step);
+        done = history->done && history->step == history->newest;
+        printf("(apex) >> Cycle %ld, history holds %ld .. %ld\n", history->start_clock + history->step, history->start_clock + history->oldest, history->start_clock + history->newest);
+        APEX_cpu_print_stages(cpu);
+      }
+    }
+    else if (strcmp(command, "stages") == 0) {
+      APEX_cpu_print_stages(cpu);
+    }
+    else if (strcmp(command, "state") == 0) {
+      APEX_cpu_show_state(cpu);
+    }
+    else if (strcmp(command, "history") == 0) {
+      history_print(history);
+    }
+    else if (strcmp(command, "quit") == 0) {
+      break;
+    }
+    else if (command[0]) {
+      printf("(apex) >> Unknown command %s\n", command);
+    }
+    printf("(apex) ");
+    fflush(stdout);
+  }
+  history_free(history);
+  return 0;
+}
@@ -0,0 +1,381 @@
+/*
+ *  multicore.c
+ *  Contains the multicore driver. Every core runs its own program on its
+ *  own host thread. The threads simulate in quanta of a fixed number of
+ *  cycles and meet at a barrier after each quantum.
+ *
+ *  A load or store that needs the bus holds its core in MEM1 and posts a
+ *  request. At the barrier one thread serves the posted requests in order of
+ *  request cycle and core, applies the MSI transitions (or the access
+ *  itself on the atomic bus) and gives each requester the cycle its bus
+ *  transaction completes. Between barriers a core only touches its own
+ *  cache, so the result does not depend on how the host schedules the
+ *  threads. With a quantum no longer than the bus latency, no transaction
+ *  completes before the barrier that serves it, and the timing is that of
+ *  the modelled bus.
+ *
+ *  The private caches hold the whole data memory, only cold and coherence
+ *  misses go to the bus.
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "multicore.h"
+#include "telemetry.h"
+
+/* State shared by all core threads */
+typedef struct Multicore
+{
+  APEX_CPU** cpus;
+  APEX_Core* cores;
+  int num_cores;
+  int protocol;
+  int latency;
+  int quantum;
+  int cycles;
+  int quantum_end;		    // Cores simulate up to this clock
+  int finished;
+  int done[APEX_MAX_CORES];
+  int memory[4096];		    // Shared data memory
+  pthread_barrier_t barrier;
+
+  /* Interconnect statistics */
+  int bus_free;			    // Cycle the bus is free again
+  long transactions;
+  long busy_cycles;
+  long writebacks;		    // Modified lines written to memory
+  long invalidations;
+  long quanta;
+} Multicore;
+
+typedef struct Core_Thread
+{
+  Multicore* mc;
+  int id;
+} Core_Thread;
+
+/*
+ * Checks whether the load or store in MEM1 may access the core's cache this
+ * cycle, and posts a bus request if it may not.
+ * Returns 1 if the access may go ahead.
+ */
+int core_access(APEX_CPU* cpu, CPU_Stage* stage)
+{
+  APEX_Core* core = cpu->core;
+  int write = compare_opcode(stage->opcode, "STORE") || compare_opcode(stage->opcode, "STR");
+  int address = stage->mem_address;
+  if (address < 0 || address >= 4096) {
+    return 1;
+  }
+  int line = address / CORE_LINE_WORDS;
+
+  if (core->granted) {
+    if (cpu->clock < core->ready_cycle) {
+      core->stall_cycles++;
+      return 0;
+    }
+    core->granted = 0;
+  }
+  else if (core->pending) {
+    core->stall_cycles++;
+    return 0;
+  }
+  else if (core->protocol == APEX_COHERENCE_BUS || core->state[line] == LINE_INVALID || (write && core->state[line] == LINE_SHARED)) {
+    if (write && core->protocol == APEX_COHERENCE_MSI && core->state[line] == LINE_SHARED) {
+      core->upgrades++;
+    }
+    else if (write) {
+      core->write_misses++;
+    }
+    else {
+      core->read_misses++;
+    }
+    core->pending = 1;
+    core->line = line;
+    core->write = write;
+    core->address = address;
+    core->value = stage->rs1_value;
+    core->request_cycle = cpu->clock;
+    core->stall_cycles++;
+    return 0;
+  }
+  else {
+    core->hits++;
+  }
+
+  if (write) {
+    core->stores++;
+  }
+  else {
+    core->loads++;
+  }
+  return 1;
+}
+
+static void write_line(Multicore* mc, int owner, int line)
+{
+  memcpy(&mc->memory[line * CORE_LINE_WORDS], &mc->cpus[owner]->data_memory[line * CORE_LINE_WORDS], sizeof(int) * CORE_LINE_WORDS);
+  mc->writebacks++;
+}
+
+static void read_line(Multicore* mc, int reader, int line)
+{
+  memcpy(&mc->cpus[reader]->data_memory[line * CORE_LINE_WORDS], &mc->memory[line * CORE_LINE_WORDS], sizeof(int) * CORE_LINE_WORDS);
+}
+
+/*
+ * Applies the MSI transitions of a request. Returns 0 if the line is held
+ * for another core that has not used its grant yet.
+ */
+static int serve_msi(Multicore* mc, APEX_Core* core)
+{
+  int line = core->line;
+  for (int i = 0; i < mc->num_cores; ++i) {
+    APEX_Core* other = &mc->cores[i];
+    if (other != core && other->granted && other->line == line) {
+      return 0;
+    }
+  }
+
+  for (int i = 0; i < mc->num_cores; ++i) {
+    APEX_Core* other = &mc->cores[i];
+    if (other == core || other->state[line] == LINE_INVALID) {
+      continue;
+    }
+    if (other->state[line] == LINE_MODIFIED) {
+      write_line(mc, i, line);
+      other->state[line] = LINE_SHARED;
+    }
+    if (core->write) {
+      other->state[line] = LINE_INVALID;
+      other->invalidations++;
+      mc->invalidations++;
+    }
+  }
+  if (core->state[line] == LINE_INVALID) {
+    read_line(mc, core->id, line);
+  }
+  core->state[line] = core->write ? LINE_MODIFIED : LINE_SHARED;
+  return 1;
+}
+
+/*
+ * Serves the posted requests in bus order. Runs on one thread while the
+ * others wait at the barrier.
+ */
+static void serve_requests(Multicore* mc)
+{
+  APEX_Core* order[APEX_MAX_CORES];
+  int count = 0;
+  for (int i = 0; i < mc->num_cores; ++i) {
+    APEX_Core* core = &mc->cores[i];
+    if (!core->pending) {
+      continue;
+    }
+    int j = count++;
+    while (j > 0 && order[j - 1]->request_cycle > core->request_cycle) {
+      order[j] = order[j - 1];
+      j--;
+    }
+    order[j] = core;
+  }
+
+  for (int k = 0; k < count; ++k) {
+    APEX_Core* core = order[k];
+    if (core->protocol == APEX_COHERENCE_MSI) {
+      if (!serve_msi(mc, core)) {
+        continue;
+      }
+    }
+    else if (core->write) {
+      mc->memory[core->address] = core->value;
+    }
+    else {
+      mc->cpus[core->id]->data_memory[core->address] = mc->memory[core->address];
+    }
+
+    int start = mc->bus_free > core->request_cycle ? mc->bus_free : core->request_cycle;
+    mc->bus_free = start + mc->latency;
+    mc->transactions++;
+    mc->busy_cycles += mc->latency;
+    core->pending = 0;
+    core->granted = 1;
+    core->ready_cycle = mc->bus_free;
+  }
+}
+
+static void* core_thread(void* arg)
+{
+  Core_Thread* t = arg;
+  Multicore* mc = t->mc;
+  APEX_CPU* cpu = mc->cpus[t->id];
+
+  while (!mc->finished) {
+    while (!mc->done[t->id] && cpu->clock < mc->quantum_end) {
+      mc->done[t->id] = APEX_cpu_cycle(cpu);
+    }
+
+    if (pthread_barrier_wait(&mc->barrier) == PTHREAD_BARRIER_SERIAL_THREAD) {
+      serve_requests(mc);
+      mc->quanta++;
+      int all_done = 1;
+      for (int i = 0; i < mc->num_cores; ++i) {
+        all_done = all_done && mc->done[i];
+      }
+      if (all_done || mc->quantum_end >= mc->cycles) {
+        mc->finished = 1;
+      }
+      mc->quantum_end = mc->quantum_end + mc->quantum < mc->cycles ? mc->quantum_end + mc->quantum : mc->cycles;
+    }
+    pthread_barrier_wait(&mc->barrier);
+  }
+  return NULL;
+}
+
+static double elapsed_seconds(struct timespec* start)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void print_results(Multicore* mc, double seconds)
+{
+  long total_cycles = 0;
+  for (int i = 0; i < mc->num_cores; ++i) {
+    APEX_CPU* cpu = mc->cpus[i];
+    printf("\n================Core %d register file=============\n", i);
+    for (int r = 0; r <= 15; ++r) {
+      printf("|\tREG[%d]\t|\tValue = %d\t|\n", r, cpu->commit_regs[r]);
+    }
+    printf("=================================================\n");
+  }
+
+  printf("\n================State of Shared Data Memory=============\n");
+  for (int i = 0; i < 4096; ++i) {
+    if (mc->memory[i] != 0) {
+      printf("|\tMEM[%d]\t|\tDataValue = %d\t|\n", i, mc->memory[i]);
+    }
+  }
+  printf("=================================================");
+  printf("\nOther data memories are 0.\n");
+
+  printf("\n================Multicore=============\n");
+  printf("%-5s %-9s %-9s %-6s %-8s %-8s %-8s %-8s %-8s %-8s %-8s %-8s %-8s\n", "core", "cycles", "retired", "IPC", "halted", "loads",
+         "stores", "hits", "rd_miss", "wr_miss", "upgrade", "inval", "stalls");
+  for (int i = 0; i < mc->num_cores; ++i) {
+    APEX_CPU* cpu = mc->cpus[i];
+    APEX_Core* core = &mc->cores[i];
+    int cycles = cpu->clock + mc->done[i];
+    total_cycles += cycles;
+    printf("%-5d %-9d %-9d %-6.3f %-8s %-8ld %-8ld %-8ld %-8ld %-8ld %-8ld %-8ld %-8ld\n", i, cycles, cpu->ins_retired,
+           cycles > 0 ? (double)cpu->ins_retired / cycles : 0.0, mc->done[i] ? "yes" : "no", core->loads, core->stores, core->hits,
+           core->read_misses, core->write_misses, core->upgrades, core->invalidations, core->stall_cycles);
+  }
+  printf("======================================\n");
+  printf("Interconnect         : %s, %d cycles per transaction\n", mc->protocol == APEX_COHERENCE_MSI ? "MSI caches" : "atomic bus",
+         mc->latency);
+  printf("Bus transactions     : %ld\n", mc->transactions);
+  printf("Bus busy cycles      : %ld\n", mc->busy_cycles);
+  printf("Invalidations        : %ld\n", mc->invalidations);
+  printf("Writebacks           : %ld\n", mc->writebacks);
+  printf("Quanta               : %ld of %d cycles, %d threads\n", mc->quanta, mc->quantum, mc->num_cores);
+  printf("Host time            : %.6f s\n", seconds);
+  if (seconds > 0) {
+    printf("Simulated cycles/s   : %.0f\n", total_cycles / seconds);
+  }
+}
+
+/*
+ *  Simulates num_cores initialized cpus against a shared data memory for up
+ *  to cycles cycles each. quantum is the number of cycles between barriers,
+ *  latency the cycles of a bus transaction.
+ */
+int APEX_multicore_run(APEX_CPU** cpus, int num_cores, int cycles, int protocol, int quantum, int latency)
+{
+  if (num_cores < 1 || num_cores > APEX_MAX_CORES) {
+    fprintf(stderr, "APEX_Error : Between 1 and %d cores are supported\n", APEX_MAX_CORES);
+    return -1;
+  }
+  if (latency < 1) {
+    latency = 1;
+  }
+  if (quantum < 1) {
+    quantum = latency;
+  }
+  if (quantum > latency) {
+    fprintf(stderr, "APEX_Warning : Quantum longer than the bus latency, bus timing is approximate\n");
+  }
+  Multicore* mc = calloc(1, sizeof(*mc));
+  APEX_Core* cores = calloc(num_cores, sizeof(APEX_Core));
+  Core_Thread* threads = malloc(sizeof(Core_Thread) * num_cores);
+  pthread_t* workers = malloc(sizeof(pthread_t) * num_cores);
+  if (!mc || !cores || !threads || !workers) {
+    free(mc);
+    free(cores);
+    free(threads);
+    free(workers);
+    return -1;
+  }
+  mc->cpus = cpus;
+  mc->cores = cores;
+  mc->num_cores = num_cores;
+  mc->protocol = protocol;
+  mc->latency = latency;
+  mc->quantum = quantum;
+  mc->cycles = cycles;
+  mc->quantum_end = quantum < cycles ? quantum : cycles;
+  memcpy(mc->memory, cpus[0]->data_memory, sizeof(mc->memory));
+
+  for (int i = 0; i < num_cores; ++i) {
+    cores[i].id = i;
+    cores[i].protocol = protocol;
+    cpus[i]->core = &cores[i];
+    cpus[i]->quiet = 1;
+    cpus[i]->debug = 0;
+  }
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  pthread_barrier_init(&mc->barrier, NULL, num_cores);
+  for (int i = 0; i < num_cores; ++i) {
+    threads[i].mc = mc;
+    threads[i].id = i;
+    pthread_create(&workers[i], NULL, core_thread, &threads[i]);
+  }
+  for (int i = 0; i < num_cores; ++i) {
+    pthread_join(workers[i], NULL);
+  }
+  pthread_barrier_destroy(&mc->barrier);
+  double seconds = elapsed_seconds(&start);
+
+  /* Modified lines are written back at the end */
+  for (int i = 0; i < num_cores; ++i) {
+    for (int line = 0; line < CORE_LINES; ++line) {
+      if (cores[i].state[line] == LINE_MODIFIED) {
+        write_line(mc, i, line);
+        cores[i].state[line] = LINE_SHARED;
+      }
+    }
+  }
+  if (cpus[0]->telemetry) {
+    telemetry_update(cpus[0], mc->done[0] ? TELEMETRY_DONE : TELEMETRY_STOPPED);
+  }
+  print_results(mc, seconds);
+
+  for (int i = 0; i < num_cores; ++i) {
+    cpus[i]->core = NULL;
+  }
+  free(mc);
+  free(cores);
+  free(threads);
+  free(workers);
+  return 0;
+}
@@ -0,0 +1,66 @@
+#ifndef _APEX_MULTICORE_H_
+#define _APEX_MULTICORE_H_
+/**
+ *  multicore.h
+ *  Contains the multicore driver: APEX cores with private MSI caches or
+ *  an atomic shared bus in front of one shared data memory
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include "cpu.h"
+
+#define APEX_MAX_CORES 16
+#define CORE_LINE_WORDS 4
+#define CORE_LINES (4096 / CORE_LINE_WORDS)
+
+/* Interconnect */
+enum
+{
+  APEX_COHERENCE_MSI,	    // Private caches kept coherent by MSI
+  APEX_COHERENCE_BUS	    // Every load and store is a bus transaction
+};
+
+/* State of a line in a private cache */
+enum
+{
+  LINE_INVALID,
+  LINE_SHARED,
+  LINE_MODIFIED
+};
+
+/* Private cache and outstanding bus request of one core. The data of the
+ * cached lines lives in the data memory of the core's cpu. */
+typedef struct APEX_Core
+{
+  int id;
+  int protocol;
+  unsigned char state[CORE_LINES];
+
+  /* Posted by MEM1, served at the next quantum barrier */
+  int pending;			    // Waiting for the bus
+  int granted;			    // Served, usable from ready_cycle on
+  int line;
+  int write;
+  int address;
+  int value;			    // Store data on the atomic bus
+  int request_cycle;
+  int ready_cycle;
+
+  /* Statistics */
+  long loads;
+  long stores;
+  long hits;
+  long read_misses;
+  long write_misses;
+  long upgrades;		    // Stores to a shared line
+  long invalidations;		    // Lines taken away by other cores
+  long stall_cycles;		    // Cycles MEM1 waited for the bus
+} APEX_Core;
+
+int core_access(APEX_CPU* cpu, CPU_Stage* stage);
+
+int APEX_multicore_run(APEX_CPU** cpus, int num_cores, int cycles, int protocol, int quantum, int latency);
+
+#endif
@@ -0,0 +1,366 @@
+/*
+ *  phases.c
+ *  Contains the phase detector for interval time series written with
+ *  --series. Every record becomes a point of per-cycle rates (IPC, stall
+ *  cycles by cause, flushes, loads, stores), each rate scaled to unit
+ *  variance. The points are clustered with k-means weighted by the cycles
+ *  they cover, starting from farthest-first centers so runs repeat. Without
+ *  --phases the number of phases grows while one more cuts the spread by
+ *  at least a fifth, until the spread left is under 5% of the run's.
+ *
+ *  For each phase it prints its share of the run, its mean rates and the
+ *  record closest to its center, a representative sampling window. Runs of
+ *  records whose IPC is below --slow times the overall IPC are listed as
+ *  slow regions with their main stall cause.
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define NUM_RATES 7
+#define MAX_PHASES 8
+#define MAX_RUNS 40
+#define MAX_SLOW 5
+
+static const char* rate_names[NUM_RATES] = { "IPC", "raw", "branch", "hold", "flush", "loads", "stores" };
+
+/* One record of the series */
+typedef struct Phase_Record
+{
+  long start;
+  long cycles;
+  double rate[NUM_RATES];	    // Per cycle
+  double point[NUM_RATES];	    // Scaled rates
+  int phase;
+} Phase_Record;
+
+typedef struct Phase_Set
+{
+  Phase_Record* records;
+  int count;
+  long cycles;
+  double center[MAX_PHASES][NUM_RATES];
+  int phases;
+} Phase_Set;
+
+static int read_series(const char* filename, Phase_Set* set)
+{
+  FILE* file = fopen(filename, "r");
+  if (!file) {
+    return 1;
+  }
+  char line[512];
+  int capacity = 1024;
+  set->records = malloc(sizeof(Phase_Record) * capacity);
+  while (set->records && fgets(line, sizeof(line), file)) {
+    long start, cycles, retired, counts[6];
+    double ipc;
+    if (sscanf(line, "%ld,%ld,%ld,%lf,%ld,%ld,%ld,%ld,%ld,%ld", &start, &cycles, &retired, &ipc, &counts[0], &counts[1], &counts[2],
+               &counts[3], &counts[4], &counts[5]) != 10 || cycles <= 0) {
+      continue;
+    }
+    if (set->count == capacity) {
+      capacity *= 2;
+      Phase_Record* records = realloc(set->records, sizeof(Phase_Record) * capacity);
+      if (!records) {
+        break;
+      }
+      set->records = records;
+    }
+    Phase_Record* r = &set->records[set->count++];
+    memset(r, 0, sizeof(*r));
+    r->start = start;
+    r->cycles = cycles;
+    r->rate[0] = (double)retired / cycles;
+    for (int i = 0; i < 6; ++i) {
+      r->rate[i + 1] = (double)counts[i] / cycles;
+    }
+    set->cycles += cycles;
+  }
+  fclose(file);
+  return !set->records;
+}
+
+/* Scales every rate to unit variance over the run */
+static void scale(Phase_Set* set)
+{
+  for (int k = 0; k < NUM_RATES; ++k) {
+    double mean = 0, variance = 0;
+    for (int i = 0; i < set->count; ++i) {
+      mean += set->records[i].rate[k] * set->records[i].cycles;
+    }
+    mean /= set->cycles;
+    for (int i = 0; i < set->count; ++i) {
+      double d = set->records[i].rate[k] - mean;
+      variance += d * d * set->records[i].cycles;
+    }
+    double deviation = sqrt(variance / set->cycles);
+    for (int i = 0; i < set->count; ++i) {
+      set->records[i].point[k] = deviation > 1e-12 ? (set->records[i].rate[k] - mean) / deviation : 0;
+    }
+  }
+}
+
+static double distance(const double* a, const double* b)
+{
+  double sum = 0;
+  for (int k = 0; k < NUM_RATES; ++k) {
+    sum += (a[k] - b[k]) * (a[k] - b[k]);
+  }
+  return sum;
+}
+
+/*
+ * Clusters the records into phases groups. Returns the weighted sum of
+ * squared distances to the centers.
+ */
+static double cluster(Phase_Set* set, int phases)
+{
+  Phase_Record* r = set->records;
+  set->phases = phases;
+
+  /* Farthest-first centers, from the first record, weighted by cycles */
+  memcpy(set->center[0], r[0].point, sizeof(r[0].point));
+  for (int c = 1; c < phases; ++c) {
+    int far = 0;
+    double far_distance = -1;
+    for (int i = 0; i < set->count; ++i) {
+      double nearest = distance(r[i].point, set->center[0]);
+      for (int k = 1; k < c; ++k) {
+        double d = distance(r[i].point, set->center[k]);
+        nearest = d < nearest ? d : nearest;
+      }
+      if (nearest * r[i].cycles > far_distance) {
+        far = i;
+        far_distance = nearest * r[i].cycles;
+      }
+    }
+    memcpy(set->center[c], r[far].point, sizeof(r[far].point));
+  }
+
+  double spread = 0;
+  for (int iteration = 0; iteration < 100; ++iteration) {
+    int moved = 0;
+    spread = 0;
+    for (int i = 0; i < set->count; ++i) {
+      int best = 0;
+      double best_distance = distance(r[i].point, set->center[0]);
+      for (int c = 1; c < phases; ++c) {
+        double d = distance(r[i].point, set->center[c]);
+        if (d < best_distance) {
+          best = c;
+          best_distance = d;
+        }
+      }
+      moved |= r[i].phase != best;
+      r[i].phase = best;
+      spread += best_distance * r[i].cycles;
+    }
+    if (!moved && iteration > 0) {
+      break;
+    }
+    for (int c = 0; c < phases; ++c) {
+      double sum[NUM_RATES] = {0};
+      long weight = 0;
+      for (int i = 0; i < set->count; ++i) {
+        if (r[i].phase == c) {
+          for (int k = 0; k < NUM_RATES; ++k) {
+            sum[k] += r[i].point[k] * r[i].cycles;
+          }
+          weight += r[i].cycles;
+        }
+      }
+      for (int k = 0; k < NUM_RATES && weight > 0; ++k) {
+        set->center[c][k] = sum[k] / weight;
+      }
+    }
+  }
+  return spread;
+}
+
+static void print_phases(Phase_Set* set)
+{
+  Phase_Record* r = set->records;
+  printf("%-6s %-7s %-9s", "phase", "share", "records");
+  for (int k = 0; k < NUM_RATES; ++k) {
+    printf(" %-7s", rate_names[k]);
+  }
+  printf(" %s\n", "representative");
+
+  for (int c = 0; c < set->phases; ++c) {
+    double sum[NUM_RATES] = {0};
+    long cycles = 0;
+    int records = 0, representative = -1;
+    double best = 0;
+    for (int i = 0; i < set->count; ++i) {
+      if (r[i].phase != c) {
+        continue;
+      }
+      for (int k = 0; k < NUM_RATES; ++k) {
+        sum[k] += r[i].rate[k] * r[i].cycles;
+      }
+      cycles += r[i].cycles;
+      records++;
+      double d = distance(r[i].point, set->center[c]);
+      if (representative < 0 || d < best) {
+        representative = i;
+        best = d;
+      }
+    }
+    if (!records) {
+      continue;
+    }
+    printf("%-6c %5.1f%%  %-9d", 'A' + c, 100.0 * cycles / set->cycles, records);
+    for (int k = 0; k < NUM_RATES; ++k) {
+      printf(" %-7.3f", sum[k] / cycles);
+    }
+    printf(" cycles %ld-%ld\n", r[representative].start, r[representative].start + r[representative].cycles - 1);
+  }
+
+  printf("Timeline : ");
+  int runs = 0;
+  for (int i = 0; i < set->count && runs < MAX_RUNS; ++runs) {
+    int j = i;
+    while (j < set->count && r[j].phase == r[i].phase) {
+      j++;
+    }
+    printf("%s%c x%d", runs ? ", " : "", 'A' + r[i].phase, j - i);
+    i = j;
+  }
+  printf("%s\n", runs == MAX_RUNS ? ", ..." : "");
+}
+
+/* Runs of records below slow times the overall IPC, longest first */
+static void print_slow(Phase_Set* set, double slow)
+{
+  Phase_Record* r = set->records;
+  double retired = 0;
+  for (int i = 0; i < set->count; ++i) {
+    retired += r[i].rate[0] * r[i].cycles;
+  }
+  double limit = slow * retired / set->cycles;
+
+  long found_start[MAX_SLOW], found_cycles[MAX_SLOW];
+  double found_ipc[MAX_SLOW];
+  int found_cause[MAX_SLOW], found = 0;
+  for (int i = 0; i < set->count;) {
+    if (r[i].rate[0] >= limit) {
+      i++;
+      continue;
+    }
+    double sum[NUM_RATES] = {0};
+    long cycles = 0;
+    int j = i;
+    for (; j < set->count && r[j].rate[0] < limit; ++j) {
+      for (int k = 0; k < NUM_RATES; ++k) {
+        sum[k] += r[j].rate[k] * r[j].cycles;
+      }
+      cycles += r[j].cycles;
+    }
+    int cause = 1;
+    for (int k = 2; k <= 3; ++k) {
+      cause = sum[k] > sum[cause] ? k : cause;
+    }
+
+    /* Keep the longest runs */
+    int slot = found < MAX_SLOW ? found++ : -1;
+    if (slot < 0) {
+      slot = 0;
+      for (int k = 1; k < MAX_SLOW; ++k) {
+        slot = found_cycles[k] < found_cycles[slot] ? k : slot;
+      }
+      if (found_cycles[slot] >= cycles) {
+        slot = -1;
+      }
+    }
+    if (slot >= 0) {
+      found_start[slot] = r[i].start;
+      found_cycles[slot] = cycles;
+      found_ipc[slot] = sum[0] / cycles;
+      found_cause[slot] = cause;
+    }
+    i = j;
+  }
+
+  printf("Slow regions (IPC below %.3f) : %s\n", limit, found ? "" : "none");
+  for (int n = 0; n < found; ++n) {
+    int longest = n;
+    for (int k = n + 1; k < found; ++k) {
+      longest = found_cycles[k] > found_cycles[longest] ? k : longest;
+    }
+    long start = found_start[longest], cycles = found_cycles[longest];
+    double ipc = found_ipc[longest];
+    int cause = found_cause[longest];
+    found_start[longest] = found_start[n];
+    found_cycles[longest] = found_cycles[n];
+    found_ipc[longest] = found_ipc[n];
+    found_cause[longest] = found_cause[n];
+    printf("  cycles %ld-%ld  IPC %.3f  mostly %s stalls\n", start, start + cycles - 1, ipc, rate_names[cause]);
+  }
+}
+
+static void usage(const char* name)
+{
+  fprintf(stderr, "APEX_Help : Usage %s <series_file> [options]\n", name);
+  fprintf(stderr, "APEX_Help :   --phases=K             number of phases 1..%d (default: chosen from the data)\n", MAX_PHASES);
+  fprintf(stderr, "APEX_Help :   --slow=F               slow regions run below F times the overall IPC (default 0.5)\n");
+}
+
+int main(int argc, char const* argv[])
+{
+  int phases = 0;
+  double slow = 0.5;
+  if (argc < 2) {
+    usage(argv[0]);
+    exit(1);
+  }
+  for (int i = 2; i < argc; ++i) {
+    if (strncmp(argv[i], "--phases=", 9) == 0 && atoi(argv[i] + 9) >= 1 && atoi(argv[i] + 9) <= MAX_PHASES) {
+      phases = atoi(argv[i] + 9);
+    }
+    else if (strncmp(argv[i], "--slow=", 7) == 0) {
+      slow = atof(argv[i] + 7);
+    }
+    else {
+      fprintf(stderr, "APEX_Error : Invalid option %s\n", argv[i]);
+      usage(argv[0]);
+      exit(1);
+    }
+  }
+
+  Phase_Set set;
+  memset(&set, 0, sizeof(set));
+  if (read_series(argv[1], &set) || set.count == 0) {
+    fprintf(stderr, "APEX_Error : No records in %s\n", argv[1]);
+    exit(1);
+  }
+  scale(&set);
+
+  if (!phases) {
+    double spread = cluster(&set, 1), total = spread;
+    phases = 1;
+    while (phases < MAX_PHASES && phases < set.count && spread > 0.05 * total) {
+      double next = cluster(&set, phases + 1);
+      if (next > 0.8 * spread) {
+        break;
+      }
+      spread = next;
+      phases++;
+    }
+  }
+  if (phases > set.count) {
+    phases = set.count;
+  }
+  cluster(&set, phases);
+
+  printf("APEX_Phases : %d records, %ld cycles, %d phases\n", set.count, set.cycles, phases);
+  print_phases(&set);
+  print_slow(&set, slow);
+  free(set.records);
+  return 0;
+}
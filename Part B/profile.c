@@ -0,0 +1,326 @@
+/*
+ *  profile.c
+ *  Contains the per-instruction profiler. Every cycle the pipeline latches
+ *  are sampled and the cycle is charged to the static instructions in them:
+ *
+ *    RAW     cycles DRF holds an instruction for an operand, charged to the
+ *            waiting instruction and to the youngest in-flight producer
+ *    Ctrl    cycles DRF holds a branch, or a HALT behind an unresolved
+ *            branch, charged to the branch
+ *    Hold    cycles the instruction holds the stages behind it (multi-cycle
+ *            EX1 operations, full store buffer)
+ *    Flush   pipeline slots squashed by a taken branch
+ *
+ *  The stall cost of an instruction is what it costs the instructions
+ *  around it: RAW cycles caused, Ctrl, Hold and Flush. The cost of a
+ *  sample is a scan of the latches, so the profiler can stay on.
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "profile.h"
+
+APEX_Profile* profile_create(APEX_CPU* cpu)
+{
+  APEX_Profile* profile = calloc(1, sizeof(*profile));
+  if (!profile) {
+    return NULL;
+  }
+  profile->size = cpu->code_memory_size;
+  profile->producer = -1;
+  profile->branch = -1;
+  profile->entries = calloc(profile->size ? profile->size : 1, sizeof(APEX_Profile_Entry));
+  if (!profile->entries) {
+    free(profile);
+    return NULL;
+  }
+  return profile;
+}
+
+void profile_free(APEX_Profile* profile)
+{
+  if (profile) {
+    free(profile->entries);
+    free(profile);
+  }
+}
+
+/*
+ * Returns the profile entry of the instruction in a latch, or NULL for
+ * bubbles and latches that have not been filled yet.
+ */
+static APEX_Profile_Entry* latch_entry(APEX_CPU* cpu, CPU_Stage* stage)
+{
+  if (stage->busy || stage->pc == 0 || compare_opcode(stage->opcode, "NOP")) {
+    return NULL;
+  }
+  int index = get_code_index(stage->pc);
+  if (index < 0 || index >= cpu->profile->size) {
+    return NULL;
+  }
+  return &cpu->profile->entries[index];
+}
+
+/*
+ * Returns true if the DRF instruction reads register reg, following the
+ * operand sets checked by shouldStall().
+ */
+static bool reads_register(CPU_Stage* stage, int reg)
+{
+  switch (get_opcode_id(stage->opcode)) {
+    case OP_MOVC:
+    case OP_BZ:
+    case OP_BNZ:
+    case OP_HALT:
+    case OP_NOP:
+      return false;
+    case OP_ADDL:
+    case OP_SUBL:
+    case OP_LOAD:
+    case OP_JUMP:
+    case OP_LOOP:
+    case OP_VLOAD:
+      return stage->rs1 == reg;
+    case OP_STR:
+      return stage->rs1 == reg || stage->rs2 == reg || stage->rs3 == reg;
+    default:
+      return stage->rs1 == reg || stage->rs2 == reg;
+  }
+}
+
+/*
+ * Returns the code index of the youngest in-flight instruction whose result
+ * the DRF instruction reads, or -1.
+ */
+static int find_producer(APEX_CPU* cpu)
+{
+  CPU_Stage* consumer = &cpu->stage[DRF];
+  for (int i = EX1; i <= cpu->wb; ++i) {
+    CPU_Stage* stage = &cpu->stage[i];
+    int op = get_opcode_id(stage->opcode);
+    if (op == OP_NOP || op == OP_STORE || op == OP_STR || op == OP_BZ || op == OP_BNZ || op == OP_JUMP || op == OP_HALT || op == OP_VSTORE) {
+      continue;
+    }
+    if (latch_entry(cpu, stage) && reads_register(consumer, stage->rd)) {
+      return get_code_index(stage->pc);
+    }
+  }
+  return -1;
+}
+
+/*
+ * Returns the code index of the branch that holds DRF: the DRF instruction
+ * itself, or the unresolved branch a HALT waits behind. -1 if none.
+ */
+static int find_branch(APEX_CPU* cpu)
+{
+  for (int i = DRF; i <= cpu->branch_stage; ++i) {
+    CPU_Stage* stage = &cpu->stage[i];
+    int op = get_opcode_id(stage->opcode);
+    if ((op == OP_BZ || op == OP_BNZ || op == OP_JUMP || op == OP_LOOP) && latch_entry(cpu, stage)) {
+      return get_code_index(stage->pc);
+    }
+  }
+  return -1;
+}
+
+/*
+ * Samples the latches before the stages run. Each latch holds the
+ * instruction its stage works on this cycle.
+ */
+void profile_begin_cycle(APEX_CPU* cpu)
+{
+  APEX_Profile* profile = cpu->profile;
+  for (int i = DRF; i <= cpu->wb; ++i) {
+    APEX_Profile_Entry* entry = latch_entry(cpu, &cpu->stage[i]);
+    /* After HALT the fetch latch keeps feeding copies of it, count it once */
+    if (entry && !compare_opcode(cpu->stage[i].opcode, "HALT")) {
+      entry->stage_cycles[i]++;
+    }
+  }
+
+  CPU_Stage* wb = &cpu->stage[cpu->wb];
+  APEX_Profile_Entry* entry = latch_entry(cpu, wb);
+  if (entry && !wb->stalled) {
+    if (compare_opcode(wb->opcode, "HALT")) {
+      entry->executions = 1;
+    }
+    else {
+      entry->executions++;
+    }
+  }
+  profile->producer = find_producer(cpu);
+  profile->branch = find_branch(cpu);
+}
+
+/*
+ * Charges the stalls of the cycle once the stages have run.
+ */
+void profile_end_cycle(APEX_CPU* cpu)
+{
+  APEX_Profile* profile = cpu->profile;
+  APEX_Profile_Entry* fetched = latch_entry(cpu, &cpu->stage[F]);
+  if (fetched && !compare_opcode(cpu->stage[F].opcode, "HALT")) {
+    fetched->stage_cycles[F]++;
+  }
+
+  APEX_Profile_Entry* waiting = latch_entry(cpu, &cpu->stage[DRF]);
+  if (waiting && cpu->stage[DRF].stalled) {
+    waiting->raw_waits++;
+    if (profile->producer >= 0) {
+      profile->entries[profile->producer].raw_caused++;
+    }
+  }
+  if (waiting && cpu->branchEncountered && profile->branch >= 0) {
+    profile->entries[profile->branch].ctrl_stalls++;
+  }
+  if (cpu->stall_stage) {
+    APEX_Profile_Entry* holder = latch_entry(cpu, &cpu->stage[cpu->stall_stage]);
+    if (holder) {
+      holder->holds++;
+    }
+  }
+}
+
+/*
+ * Records a taken branch at pc that squashed the given number of slots.
+ */
+void profile_flush(APEX_CPU* cpu, int pc, int bubbles)
+{
+  int index = get_code_index(pc);
+  if (index < 0 || index >= cpu->profile->size) {
+    return;
+  }
+  cpu->profile->entries[index].flushes++;
+  cpu->profile->entries[index].flush_bubbles += bubbles;
+}
+
+static long stall_cost(APEX_Profile_Entry* entry)
+{
+  return entry->raw_caused + entry->ctrl_stalls + entry->holds + entry->flush_bubbles;
+}
+
+/* Profile being sorted, qsort() has no context argument */
+static APEX_Profile* sort_profile;
+
+static int by_stall_cost(const void* a, const void* b)
+{
+  int ia = *(const int*)a;
+  int ib = *(const int*)b;
+  long ca = stall_cost(&sort_profile->entries[ia]);
+  long cb = stall_cost(&sort_profile->entries[ib]);
+  if (ca != cb) {
+    return ca < cb ? 1 : -1;
+  }
+  return ia - ib;
+}
+
+static void format_instruction(APEX_Instruction* ins, char* text)
+{
+  switch (get_opcode_id(ins->opcode)) {
+    case OP_STORE:
+      sprintf(text, "%s R%d,R%d,#%d", ins->opcode, ins->rs1, ins->rs2, ins->imm);
+      break;
+    case OP_STR:
+      sprintf(text, "%s R%d,R%d,R%d", ins->opcode, ins->rs1, ins->rs2, ins->rs3);
+      break;
+    case OP_LOAD:
+    case OP_ADDL:
+    case OP_SUBL:
+      sprintf(text, "%s R%d,R%d,#%d", ins->opcode, ins->rd, ins->rs1, ins->imm);
+      break;
+    case OP_MOVC:
+      sprintf(text, "%s R%d,#%d", ins->opcode, ins->rd, ins->imm);
+      break;
+    case OP_JUMP:
+    case OP_LOOP:
+      sprintf(text, "%s R%d,#%d", ins->opcode, ins->rs1, ins->imm);
+      break;
+    case OP_BZ:
+    case OP_BNZ:
+      sprintf(text, "%s #%d", ins->opcode, ins->imm);
+      break;
+    case OP_VLOAD:
+      sprintf(text, "%s V%d,R%d,#%d", ins->opcode, ins->rd - VREG_BASE, ins->rs1, ins->imm);
+      break;
+    case OP_VSTORE:
+      sprintf(text, "%s V%d,R%d,#%d", ins->opcode, ins->rs1 - VREG_BASE, ins->rs2, ins->imm);
+      break;
+    case OP_VADD:
+    case OP_VSUB:
+    case OP_VMUL:
+    case OP_VAND:
+    case OP_VOR:
+      sprintf(text, "%s V%d,V%d,V%d", ins->opcode, ins->rd - VREG_BASE, ins->rs1 - VREG_BASE, ins->rs2 - VREG_BASE);
+      break;
+    case OP_HALT:
+    case OP_NOP:
+      sprintf(text, "%s", ins->opcode);
+      break;
+    default:
+      sprintf(text, "%s R%d,R%d,R%d", ins->opcode, ins->rd, ins->rs1, ins->rs2);
+      break;
+  }
+}
+
+/*
+ * Prints code memory annotated with the profile, costliest first.
+ */
+void profile_print(APEX_CPU* cpu)
+{
+  APEX_Profile* profile = cpu->profile;
+  int* order = malloc(sizeof(int) * (profile->size ? profile->size : 1));
+  if (!order) {
+    return;
+  }
+  long total_cost = 0;
+  for (int i = 0; i < profile->size; ++i) {
+    order[i] = i;
+    total_cost += stall_cost(&profile->entries[i]);
+  }
+  sort_profile = profile;
+  qsort(order, profile->size, sizeof(int), by_stall_cost);
+
+  printf("\n================Profile (sorted by stall cost)=============\n");
+  printf("Cycles %d, stall cost %ld\n", cpu->clock, total_cost);
+  printf("%6s %-6s %-20s %8s", "Cost%", "PC", "Instruction", "Exec");
+  for (int s = 0; s < cpu->num_stages; ++s) {
+    char name[16];
+    if (s == F) {
+      strcpy(name, "F");
+    }
+    else if (s == DRF) {
+      strcpy(name, "DRF");
+    }
+    else if (s == cpu->wb) {
+      strcpy(name, "WB");
+    }
+    else if (s >= cpu->mem1) {
+      sprintf(name, "MEM%d", s - cpu->mem1 + 1);
+    }
+    else {
+      sprintf(name, "EX%d", s - EX1 + 1);
+    }
+    printf(" %7s", name);
+  }
+  printf(" %7s %7s %7s %7s %7s\n", "RAWwait", "RAWcaus", "Ctrl", "Hold", "Flush");
+
+  for (int i = 0; i < profile->size; ++i) {
+    APEX_Profile_Entry* entry = &profile->entries[order[i]];
+    char text[160];
+    format_instruction(&cpu->code_memory[order[i]], text);
+    long cost = stall_cost(entry);
+    printf("%5.1f%% %-6d %-20s %8ld", total_cost ? 100.0 * cost / total_cost : 0.0, 4000 + 4 * order[i], text, entry->executions);
+    for (int s = 0; s < cpu->num_stages; ++s) {
+      printf(" %7ld", entry->stage_cycles[s]);
+    }
+    printf(" %7ld %7ld %7ld %7ld %7ld\n", entry->raw_waits, entry->raw_caused, entry->ctrl_stalls, entry->holds, entry->flush_bubbles);
+  }
+  printf("===========================================================\n");
+  free(order);
+}
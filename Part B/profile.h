@@ -0,0 +1,47 @@
+#ifndef _APEX_PROFILE_H_
+#define _APEX_PROFILE_H_
+/**
+ *  profile.h
+ *  Contains the per-instruction profiler: execution counts, stage
+ *  occupancy and stall cycles attributed to static instructions
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include "cpu.h"
+
+/* Counters of one static instruction of code memory */
+typedef struct APEX_Profile_Entry
+{
+  long executions;		    // Times the instruction reached writeback
+  long stage_cycles[MAX_STAGES];    // Cycles spent in every stage
+  long raw_waits;		    // Cycles held in DRF waiting for an operand
+  long raw_caused;		    // Cycles other instructions waited for this result
+  long ctrl_stalls;		    // Cycles DRF was held behind this branch
+  long holds;			    // Cycles the pipeline was held by this instruction
+  long flushes;			    // Taken branches
+  long flush_bubbles;		    // Pipeline slots squashed by taken branches
+} APEX_Profile_Entry;
+
+typedef struct APEX_Profile
+{
+  int size;			    // Instructions in code memory
+  int producer;			    // Code index of the result DRF waits for
+  int branch;			    // Code index of the branch DRF waits behind
+  APEX_Profile_Entry* entries;
+} APEX_Profile;
+
+APEX_Profile* profile_create(APEX_CPU* cpu);
+
+void profile_free(APEX_Profile* profile);
+
+void profile_begin_cycle(APEX_CPU* cpu);
+
+void profile_end_cycle(APEX_CPU* cpu);
+
+void profile_flush(APEX_CPU* cpu, int pc, int bubbles);
+
+void profile_print(APEX_CPU* cpu);
+
+#endif
@@ -0,0 +1,583 @@
+/*
+ *  sched.c
+ *  Contains the static instruction scheduler. It splits a program into
+ *  basic blocks, builds the dependency DAG of each block and list-schedules
+ *  it so that consumers issue as far behind their producers as the
+ *  configured pipeline needs, then writes the reordered program with its
+ *  branch offsets remapped.
+ *
+ *  Issue timing follows the decode rules of cpu.c: a source is ready once
+ *  its producer has spent its EX1 latency and reached the first stage that
+ *  forwards it (MEM1 or later for loads), or writeback; BZ/BNZ also wait
+ *  branch_stall cycles after the flag producer leaves EX1 unless branches
+ *  resolve in DRF. Registers, the zero flag and memory (stores against
+ *  every other access) order the DAG; the last flag setter of a block stays
+ *  the last one.
+ *
+ *  Block leaders are the program start, branch and LOOP targets, the
+ *  instructions after branches, LOOP and HALT, and the possible targets of
+ *  JUMP (MOVC constants plus JUMP offsets). Branches, LOOP, JUMP and HALT
+ *  stay last in their block, so every leader keeps its address. A block keeps its order if the
+ *  schedule does not lower its modelled stalls.
+ *
+ *  Both programs are simulated afterwards. The report gives the stall
+ *  cycles of the issue model, weighted by how often each instruction
+ *  executed, next to the simulated cycles.
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "cpu.h"
+#include "config.h"
+#include "apex.h"
+
+#define SCHED_FLAG 32		    // Zero flag, scheduled as register 32
+#define SCHED_RESOURCES 33
+#define SCHED_MAX_CYCLES 10000000
+
+/* Scheduling state of a program */
+typedef struct Sched
+{
+  APEX_CPU* cpu;		    // Pipeline shape only
+  APEX_Instruction* code;
+  int size;
+  bool* leader;
+  int* order;			    // Original index of the instruction at each position
+  long* executions;		    // Executions of each original instruction
+  int blocks;
+  int reordered;		    // Blocks whose order changed
+} Sched;
+
+static bool is_terminator(int op)
+{
+  return op == OP_BZ || op == OP_BNZ || op == OP_JUMP || op == OP_LOOP || op == OP_HALT;
+}
+
+static bool is_memory(int op)
+{
+  return op == OP_LOAD || op == OP_LDR || op == OP_STORE || op == OP_STR || op == OP_VLOAD || op == OP_VSTORE;
+}
+
+static bool is_store(int op)
+{
+  return op == OP_STORE || op == OP_STR || op == OP_VSTORE;
+}
+
+/*
+ * Collects the registers read by ins, the zero flag as SCHED_FLAG.
+ * Returns their number.
+ */
+static int sources(const APEX_Instruction* ins, int* regs)
+{
+  switch (get_opcode_id(ins->opcode)) {
+  case OP_ADD: case OP_SUB: case OP_MUL: case OP_AND: case OP_OR: case OP_EXOR: case OP_LDR: case OP_STORE:
+  case OP_VSTORE: case OP_VADD: case OP_VSUB: case OP_VMUL: case OP_VAND: case OP_VOR:
+    regs[0] = ins->rs1;
+    regs[1] = ins->rs2;
+    return 2;
+  case OP_STR:
+    regs[0] = ins->rs1;
+    regs[1] = ins->rs2;
+    regs[2] = ins->rs3;
+    return 3;
+  case OP_ADDL: case OP_SUBL: case OP_LOAD: case OP_JUMP: case OP_LOOP: case OP_VLOAD:
+    regs[0] = ins->rs1;
+    return 1;
+  case OP_BZ: case OP_BNZ:
+    regs[0] = SCHED_FLAG;
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+/*
+ * Collects the register and flag written by ins. Returns their number.
+ */
+static int destinations(const APEX_Instruction* ins, int* regs)
+{
+  switch (get_opcode_id(ins->opcode)) {
+  case OP_ADD: case OP_ADDL: case OP_SUB: case OP_SUBL: case OP_MUL:
+    regs[0] = ins->rd;
+    regs[1] = SCHED_FLAG;
+    return 2;
+  case OP_MOVC: case OP_AND: case OP_OR: case OP_EXOR: case OP_LOAD: case OP_LDR: case OP_LOOP:
+  case OP_VLOAD: case OP_VADD: case OP_VSUB: case OP_VMUL: case OP_VAND: case OP_VOR:
+    regs[0] = ins->rd;
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+static int ex1_cycles(const APEX_CPU* cpu, int op)
+{
+  return cpu->latency[op] > 1 ? cpu->latency[op] : 1;
+}
+
+/*
+ * Cycles after the producer issues from DRF until a consumer of reg may
+ * issue without stalling.
+ */
+static int ready_delay(const APEX_CPU* cpu, int op, int reg)
+{
+  int latency = ex1_cycles(cpu, op);
+  if (reg == SCHED_FLAG) {
+    return cpu->branch_stage == DRF ? latency : latency + cpu->branch_stall;
+  }
+  int k = (op == OP_LOAD || op == OP_LDR || op == OP_VLOAD) ? cpu->mem1 : EX1;
+  while (k < cpu->wb && !cpu->forward[k]) {
+    k++;
+  }
+  return latency + k - EX1;
+}
+
+/*
+ * Issues ins at *clock or once its sources are ready, whichever is later.
+ * ready holds the cycle each register and the flag become ready.
+ * Returns the stall cycles.
+ */
+static int model_issue(const APEX_CPU* cpu, const APEX_Instruction* ins, int* ready, int* clock)
+{
+  int regs[3];
+  int op = get_opcode_id(ins->opcode);
+  int t = *clock;
+  for (int i = sources(ins, regs) - 1; i >= 0; --i) {
+    t = ready[regs[i]] > t ? ready[regs[i]] : t;
+  }
+  for (int i = destinations(ins, regs) - 1; i >= 0; --i) {
+    ready[regs[i]] = t + ready_delay(cpu, op, regs[i]);
+  }
+  int stall = t - *clock;
+  *clock = t + ex1_cycles(cpu, op);
+  return stall;
+}
+
+/*
+ * Marks the first instruction of every basic block.
+ */
+static void find_leaders(Sched* s)
+{
+  s->leader[0] = true;
+  for (int i = 0; i < s->size; ++i) {
+    APEX_Instruction* ins = &s->code[i];
+    int op = get_opcode_id(ins->opcode);
+    if (is_terminator(op) && i + 1 < s->size) {
+      s->leader[i + 1] = true;
+    }
+    if (op == OP_BZ || op == OP_BNZ || op == OP_LOOP) {
+      int target = op == OP_LOOP ? i - ins->imm : i + ins->imm / 4;
+      if (target >= 0 && target < s->size) {
+        s->leader[target] = true;
+      }
+    }
+    if (op != OP_JUMP) {
+      continue;
+    }
+    /* The register of a JUMP is not known, any constant may be its base */
+    for (int k = 0; k < s->size; ++k) {
+      if (get_opcode_id(s->code[k].opcode) == OP_MOVC) {
+        int target = get_code_index(s->code[k].imm + ins->imm);
+        if (target >= 0 && target < s->size && (s->code[k].imm + ins->imm) % 4 == 0) {
+          s->leader[target] = true;
+        }
+      }
+    }
+  }
+}
+
+static bool shares(const int* a, int na, const int* b, int nb)
+{
+  for (int i = 0; i < na; ++i) {
+    for (int k = 0; k < nb; ++k) {
+      if (a[i] == b[k]) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+/*
+ * Builds the DAG of the n instructions at first. distance[j * n + i] is
+ * the minimum issue distance from j to i, 0 if i does not depend on j.
+ */
+static void build_dag(Sched* s, int first, int n, int* distance)
+{
+  const APEX_CPU* cpu = s->cpu;
+  int last_setter = -1;
+  memset(distance, 0, sizeof(int) * n * n);
+  for (int i = 0; i < n; ++i) {
+    int regs[2];
+    if (destinations(&s->code[first + i], regs) == 2) {
+      last_setter = i;
+    }
+  }
+
+  for (int i = 0; i < n; ++i) {
+    APEX_Instruction* ins = &s->code[first + i];
+    int op = get_opcode_id(ins->opcode);
+    int src[3], dst[2];
+    int nsrc = sources(ins, src), ndst = destinations(ins, dst);
+    for (int j = 0; j < i; ++j) {
+      APEX_Instruction* prev = &s->code[first + j];
+      int prev_op = get_opcode_id(prev->opcode);
+      int psrc[3], pdst[2];
+      int npsrc = sources(prev, psrc), npdst = destinations(prev, pdst);
+      int d = 0;
+
+      /* Read after write, timed by the producer */
+      for (int a = 0; a < npdst; ++a) {
+        for (int b = 0; b < nsrc; ++b) {
+          if (pdst[a] == src[b]) {
+            int delay = ready_delay(cpu, prev_op, pdst[a]);
+            d = delay > d ? delay : d;
+          }
+        }
+      }
+      /* Write after read, write after write: order only. The flag is
+       * only ordered towards the last setter */
+      int nreg_dst = ndst > 1 ? 1 : ndst, npreg_dst = npdst > 1 ? 1 : npdst;
+      if (shares(psrc, npsrc, dst, nreg_dst) || shares(pdst, npreg_dst, dst, nreg_dst)) {
+        d = d > 1 ? d : 1;
+      }
+      if (i == last_setter && npdst == 2) {
+        d = d > 1 ? d : 1;
+      }
+      if (is_memory(op) && is_memory(prev_op) && (is_store(op) || is_store(prev_op))) {
+        d = d > 1 ? d : 1;
+      }
+      if (is_terminator(op)) {
+        d = d > 1 ? d : 1;
+      }
+      distance[j * n + i] = d;
+    }
+  }
+}
+
+/*
+ * List-schedules the block of n instructions at first into order. ready
+ * and clock are the issue model at the block entry.
+ */
+static void schedule_block(Sched* s, int first, int n, const int* ready, int clock, int* order)
+{
+  int* distance = malloc(sizeof(int) * n * n);
+  int* height = malloc(sizeof(int) * n);
+  int* issue = malloc(sizeof(int) * n);
+  bool* done = calloc(n, sizeof(bool));
+  if (!distance || !height || !issue || !done) {
+    for (int i = 0; i < n; ++i) {
+      order[i] = first + i;
+    }
+    free(distance);
+    free(height);
+    free(issue);
+    free(done);
+    return;
+  }
+  build_dag(s, first, n, distance);
+
+  /* Priority: longest path to the end of the block */
+  for (int i = n - 1; i >= 0; --i) {
+    height[i] = ex1_cycles(s->cpu, get_opcode_id(s->code[first + i].opcode));
+    for (int k = i + 1; k < n; ++k) {
+      if (distance[i * n + k] && distance[i * n + k] + height[k] > height[i]) {
+        height[i] = distance[i * n + k] + height[k];
+      }
+    }
+  }
+
+  for (int p = 0; p < n; ++p) {
+    int best = -1, best_start = 0;
+    for (int i = 0; i < n; ++i) {
+      if (done[i]) {
+        continue;
+      }
+      int start = clock, blocked = 0, regs[3];
+      for (int k = sources(&s->code[first + i], regs) - 1; k >= 0; --k) {
+        start = ready[regs[k]] > start ? ready[regs[k]] : start;
+      }
+      for (int j = 0; j < i && !blocked; ++j) {
+        if (distance[j * n + i]) {
+          blocked = !done[j];
+          start = done[j] && issue[j] + distance[j * n + i] > start ? issue[j] + distance[j * n + i] : start;
+        }
+      }
+      if (blocked) {
+        continue;
+      }
+      /* Earliest start first, then the longer path, then program order */
+      if (best < 0 || start < best_start || (start == best_start && height[i] > height[best])) {
+        best = i;
+        best_start = start;
+      }
+    }
+    done[best] = true;
+    issue[best] = best_start;
+    order[p] = first + best;
+    clock = best_start + ex1_cycles(s->cpu, get_opcode_id(s->code[first + best].opcode));
+  }
+
+  free(distance);
+  free(height);
+  free(issue);
+  free(done);
+}
+
+/* Modelled stalls of the instructions at order[0..n), weighted by executions */
+static long model_stalls(Sched* s, const int* order, int n, int* ready, int* clock, bool weighted)
+{
+  long stalls = 0;
+  for (int p = 0; p < n; ++p) {
+    int stall = model_issue(s->cpu, &s->code[order[p]], ready, clock);
+    stalls += weighted ? stall * s->executions[order[p]] : stall;
+  }
+  return stalls;
+}
+
+static void schedule(Sched* s)
+{
+  int ready[SCHED_RESOURCES] = {0};
+  int clock = 0;
+  for (int first = 0; first < s->size;) {
+    int end = first + 1;
+    while (end < s->size && !s->leader[end]) {
+      end++;
+    }
+    int n = end - first;
+    int* order = &s->order[first];
+    schedule_block(s, first, n, ready, clock, order);
+
+    /* Keep the original order unless the schedule stalls less */
+    int try_ready[SCHED_RESOURCES], try_clock = clock;
+    memcpy(try_ready, ready, sizeof(ready));
+    long scheduled = model_stalls(s, order, n, try_ready, &try_clock, false);
+    int original[n];
+    for (int i = 0; i < n; ++i) {
+      original[i] = first + i;
+    }
+    int orig_clock = clock;
+    long unscheduled = model_stalls(s, original, n, ready, &orig_clock, false);
+    if (scheduled < unscheduled) {
+      memcpy(ready, try_ready, sizeof(ready));
+      clock = try_clock;
+      s->reordered++;
+    }
+    else {
+      memcpy(order, original, sizeof(int) * n);
+      clock = orig_clock;
+    }
+    s->blocks++;
+    first = end;
+  }
+}
+
+/*
+ * Writes ins as an assembly line; placed at position, a BZ/BNZ or LOOP
+ * branching to code index target.
+ */
+static int format_instruction(char* line, const APEX_Instruction* ins, int position, int target)
+{
+  switch (get_opcode_id(ins->opcode)) {
+  case OP_MOVC:
+    return sprintf(line, "MOVC,R%d,#%d\n", ins->rd, ins->imm);
+  case OP_ADD: case OP_SUB: case OP_MUL: case OP_AND: case OP_OR: case OP_EXOR: case OP_LDR:
+    return sprintf(line, "%s,R%d,R%d,R%d\n", ins->opcode, ins->rd, ins->rs1, ins->rs2);
+  case OP_ADDL: case OP_SUBL: case OP_LOAD:
+    return sprintf(line, "%s,R%d,R%d,#%d\n", ins->opcode, ins->rd, ins->rs1, ins->imm);
+  case OP_STORE:
+    return sprintf(line, "STORE,R%d,R%d,#%d\n", ins->rs1, ins->rs2, ins->imm);
+  case OP_STR:
+    return sprintf(line, "STR,R%d,R%d,R%d\n", ins->rs1, ins->rs2, ins->rs3);
+  case OP_BZ: case OP_BNZ:
+    return sprintf(line, "%s,#%d\n", ins->opcode, (target - position) * 4);
+  case OP_JUMP:
+    return sprintf(line, "JUMP,R%d,#%d\n", ins->rs1, ins->imm);
+  case OP_LOOP:
+    return sprintf(line, "LOOP,R%d,#%d\n", ins->rs1, position - target);
+  case OP_VLOAD:
+    return sprintf(line, "VLOAD,V%d,R%d,#%d\n", ins->rd - VREG_BASE, ins->rs1, ins->imm);
+  case OP_VSTORE:
+    return sprintf(line, "VSTORE,V%d,R%d,#%d\n", ins->rs1 - VREG_BASE, ins->rs2, ins->imm);
+  case OP_VADD: case OP_VSUB: case OP_VMUL: case OP_VAND: case OP_VOR:
+    return sprintf(line, "%s,V%d,V%d,V%d\n", ins->opcode, ins->rd - VREG_BASE, ins->rs1 - VREG_BASE, ins->rs2 - VREG_BASE);
+  case OP_HALT:
+    return sprintf(line, "HALT,,\n");
+  default:
+    return sprintf(line, "%s\n", ins->opcode);
+  }
+}
+
+/*
+ * Returns the program text with the instructions in order, NULL for the
+ * original order. The caller frees it.
+ */
+static char* program_text(Sched* s, const int* order)
+{
+  char* text = malloc((size_t)s->size * 64 + 1);
+  if (!text) {
+    return NULL;
+  }
+  size_t length = 0;
+  text[0] = '\0';
+  for (int p = 0; p < s->size; ++p) {
+    APEX_Instruction* ins = &s->code[order ? order[p] : p];
+
+    /* A branch target starts a block, which keeps its position */
+    int index = order ? order[p] : p;
+    int target = get_opcode_id(ins->opcode) == OP_LOOP ? index - ins->imm : index + ins->imm / 4;
+    length += format_instruction(text + length, ins, p, target);
+  }
+  return text;
+}
+
+static void count_execution(void* user, int pc, const char* opcode, int rd, int value)
+{
+  Sched* s = user;
+  int index = get_code_index(pc);
+  if (index >= 0 && index < s->size) {
+    s->executions[index]++;
+  }
+}
+
+/*
+ * Simulates text, counting executions if s is given.
+ * Returns the cycles, -1 if the program did not halt.
+ */
+static int simulate(const char* text, const char* config, int cycles, Sched* s, int* regs, int* memory)
+{
+  APEX_Sim* sim = APEX_sim_create_buffer(text, strlen(text));
+  if (!sim || (config && APEX_sim_configure(sim, config))) {
+    APEX_sim_destroy(sim);
+    return -1;
+  }
+  if (s) {
+    APEX_Callbacks callbacks = { count_execution, NULL, NULL };
+    APEX_sim_set_callbacks(sim, &callbacks, s);
+  }
+  int halted = APEX_sim_run(sim, cycles);
+  int result = halted ? APEX_sim_cycles(sim) : -1;
+  for (int i = 0; i < 16; ++i) {
+    regs[i] = APEX_sim_get_register(sim, i);
+  }
+  for (int i = 0; i < 4096; ++i) {
+    memory[i] = APEX_sim_read_memory(sim, i);
+  }
+  APEX_sim_destroy(sim);
+  return result;
+}
+
+static void usage(const char* name)
+{
+  fprintf(stderr, "APEX_Help : Usage %s <input_file> [options]\n", name);
+  fprintf(stderr, "APEX_Help :   --config=file          pipeline to schedule for (default pipeline.cfg values)\n");
+  fprintf(stderr, "APEX_Help :   --cycles=N             simulation budget of the report (default %d)\n", SCHED_MAX_CYCLES);
+  fprintf(stderr, "APEX_Help :   --output=file          default stdout\n");
+}
+
+int main(int argc, char const* argv[])
+{
+  const char* config = NULL;
+  const char* output = NULL;
+  int cycles = SCHED_MAX_CYCLES;
+  if (argc < 2) {
+    usage(argv[0]);
+    exit(1);
+  }
+  for (int i = 2; i < argc; ++i) {
+    if (strncmp(argv[i], "--config=", 9) == 0) {
+      config = argv[i] + 9;
+    }
+    else if (strncmp(argv[i], "--cycles=", 9) == 0) {
+      cycles = atoi(argv[i] + 9);
+    }
+    else if (strncmp(argv[i], "--output=", 9) == 0) {
+      output = argv[i] + 9;
+    }
+    else {
+      fprintf(stderr, "APEX_Error : Invalid option %s\n", argv[i]);
+      usage(argv[0]);
+      exit(1);
+    }
+  }
+
+  Sched s;
+  memset(&s, 0, sizeof(s));
+  s.cpu = calloc(1, sizeof(APEX_CPU));
+  s.code = create_code_memory(argv[1], &s.size);
+  if (!s.cpu || !s.code || s.size < 1) {
+    fprintf(stderr, "APEX_Error : Unable to load %s\n", argv[1]);
+    exit(1);
+  }
+  APEX_config_default(s.cpu);
+  if (config && APEX_config_load(s.cpu, config)) {
+    exit(1);
+  }
+  s.leader = calloc(s.size, sizeof(bool));
+  s.order = malloc(sizeof(int) * s.size);
+  s.executions = calloc(s.size, sizeof(long));
+  if (!s.leader || !s.order || !s.executions) {
+    fprintf(stderr, "APEX_Error : Out of memory\n");
+    exit(1);
+  }
+
+  find_leaders(&s);
+  schedule(&s);
+  char* original = program_text(&s, NULL);
+  char* scheduled = program_text(&s, s.order);
+  if (!original || !scheduled) {
+    fprintf(stderr, "APEX_Error : Out of memory\n");
+    exit(1);
+  }
+
+  FILE* out = output ? fopen(output, "w") : stdout;
+  if (!out) {
+    fprintf(stderr, "APEX_Error : Unable to open %s\n", output);
+    exit(1);
+  }
+  fputs(scheduled, out);
+  if (output) {
+    fclose(out);
+  }
+
+  /* Report: modelled stalls per execution count, then the simulations */
+  static int regs[2][16], memory[2][4096];
+  int before = simulate(original, config, cycles, &s, regs[0], memory[0]);
+  int after = simulate(scheduled, config, cycles, NULL, regs[1], memory[1]);
+  int identity[s.size];
+  for (int i = 0; i < s.size; ++i) {
+    identity[i] = i;
+  }
+  int ready[SCHED_RESOURCES] = {0}, clock = 0;
+  long stalls_before = model_stalls(&s, identity, s.size, ready, &clock, true);
+  memset(ready, 0, sizeof(ready));
+  clock = 0;
+  long stalls_after = model_stalls(&s, s.order, s.size, ready, &clock, true);
+
+  fprintf(stderr, "APEX_Sched : %d instructions, %d blocks, %d reordered\n", s.size, s.blocks, s.reordered);
+  fprintf(stderr, "APEX_Sched : predicted stall cycles %ld -> %ld\n", stalls_before, stalls_after);
+  if (before < 0 || after < 0) {
+    fprintf(stderr, "APEX_Sched : program did not halt within %d cycles, not simulated\n", cycles);
+  }
+  else {
+    fprintf(stderr, "APEX_Sched : simulated cycles %d -> %d\n", before, after);
+  }
+  if (memcmp(regs[0], regs[1], sizeof(regs[0])) || memcmp(memory[0], memory[1], sizeof(memory[0]))) {
+    fprintf(stderr, "APEX_Warning : Scheduled program ends with different registers or memory\n");
+  }
+
+  free(original);
+  free(scheduled);
+  free(s.leader);
+  free(s.order);
+  free(s.executions);
+  free(s.code);
+  free(s.cpu);
+  return 0;
+}
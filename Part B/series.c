@@ -0,0 +1,80 @@
+/*
+ *  series.c
+ *  Contains the interval time series. The cpu keeps running totals of
+ *  retired instructions, stall cycles by cause, flushes and memory
+ *  operations; a record is the difference of two snapshots, so sampling
+ *  costs nothing between records. Loop extrapolation may move the clock
+ *  past several boundaries at once, the record then covers all of them.
+ *
+ *  Each line holds: start,cycles,retired,ipc,raw_stalls,branch_stalls,
+ *  hold_stalls,flushes,loads,stores. apex_phases clusters the records.
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "series.h"
+
+APEX_Series* series_create(const char* filename, int interval)
+{
+  APEX_Series* series = calloc(1, sizeof(*series));
+  if (!series) {
+    return NULL;
+  }
+  series->file = fopen(filename, "w");
+  if (!series->file) {
+    free(series);
+    return NULL;
+  }
+  series->interval = interval > 0 ? interval : 1000;
+  series->next = series->interval;
+  fprintf(series->file, "start,cycles,retired,ipc,raw_stalls,branch_stalls,hold_stalls,flushes,loads,stores\n");
+  return series;
+}
+
+void series_free(APEX_Series* series)
+{
+  if (!series) {
+    return;
+  }
+  fclose(series->file);
+  free(series);
+}
+
+static void snapshot(const APEX_CPU* cpu, int* counters)
+{
+  counters[0] = cpu->ins_retired;
+  counters[1] = cpu->raw_stalls;
+  counters[2] = cpu->branch_stalls;
+  counters[3] = cpu->hold_stalls;
+  counters[4] = cpu->flushes;
+  counters[5] = cpu->mem_loads;
+  counters[6] = cpu->mem_stores;
+}
+
+/*
+ * Writes the record of the cycles up to clock and schedules the next one.
+ */
+void series_sample(APEX_CPU* cpu, int clock)
+{
+  APEX_Series* s = cpu->series;
+  int now[SERIES_FIELDS];
+  int cycles = clock - s->last_clock;
+  if (cycles <= 0) {
+    return;
+  }
+  snapshot(cpu, now);
+  fprintf(s->file, "%d,%d,%d,%.4f", s->last_clock, cycles, now[0] - s->last[0], (double)(now[0] - s->last[0]) / cycles);
+  for (int i = 1; i < SERIES_FIELDS; ++i) {
+    fprintf(s->file, ",%d", now[i] - s->last[i]);
+  }
+  fputc('\n', s->file);
+
+  memcpy(s->last, now, sizeof(now));
+  s->last_clock = clock;
+  s->next = clock - clock % s->interval + s->interval;
+  s->records++;
+}
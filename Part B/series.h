@@ -0,0 +1,34 @@
+#ifndef _APEX_SERIES_H_
+#define _APEX_SERIES_H_
+/**
+ *  series.h
+ *  Contains the interval time series: every N cycles the event counters of
+ *  the cpu are sampled and the differences written as one CSV record
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+
+#include "cpu.h"
+
+#define SERIES_FIELDS 7		    // Retired, raw, branch and hold stalls, flushes, loads, stores
+
+typedef struct APEX_Series
+{
+  FILE* file;
+  int interval;			    // Cycles between records
+  int next;			    // Clock of the next record
+  int last_clock;		    // Clock of the last record
+  int last[SERIES_FIELDS];	    // Counters at the last record
+  long records;
+} APEX_Series;
+
+APEX_Series* series_create(const char* filename, int interval);
+
+void series_free(APEX_Series* series);
+
+void series_sample(APEX_CPU* cpu, int clock);
+
+#endif
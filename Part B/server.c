@@ -0,0 +1,409 @@
+/*
+ *  server.c
+ *  Contains the APEX simulation server. It listens on a Unix domain socket
+ *  and runs simulation requests (see server.h) on a pool of worker
+ *  threads, one connection per worker at a time.
+ *
+ *  Parsed programs are cached by a hash of the program text, the
+ *  configuration text and the store buffer size. A cache entry is an
+ *  initialized cpu; a request copies it into the worker's own cpu, which
+ *  shares the read-only code memory, so a cached request never parses or
+ *  allocates.
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "cpu.h"
+#include "config.h"
+#include "lsq.h"
+#include "server.h"
+
+#define CACHE_ENTRIES 256
+#define QUEUE_SIZE 64
+
+/* Cached program and configuration */
+typedef struct Cache_Entry
+{
+  uint64_t hash;
+  char* text;			    // Program, configuration and store buffer size
+  size_t length;
+  APEX_CPU* cpu;		    // Initialized cpu, owns the code memory
+  int refs;			    // Workers using the entry
+  long last_used;
+} Cache_Entry;
+
+/* Per-worker event counters */
+typedef struct Run_Events
+{
+  uint32_t stalls;
+  uint32_t flushes;
+} Run_Events;
+
+static Cache_Entry cache[CACHE_ENTRIES];
+static long cache_clock;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Accepted connections waiting for a worker */
+static int queue[QUEUE_SIZE];
+static int queue_head;
+static int queue_count;
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t queue_space = PTHREAD_COND_INITIALIZER;
+
+static const char* socket_path;
+
+/*
+ * FNV-1a
+ */
+static uint64_t hash_bytes(const char* data, size_t length)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < length; ++i) {
+    hash = (hash ^ (unsigned char)data[i]) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+static int read_full(int fd, void* buffer, size_t length)
+{
+  char* p = buffer;
+  while (length) {
+    ssize_t n = read(fd, p, length);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return -1;
+    }
+    p += n;
+    length -= n;
+  }
+  return 0;
+}
+
+static int write_full(int fd, const void* buffer, size_t length)
+{
+  const char* p = buffer;
+  while (length) {
+    ssize_t n = write(fd, p, length);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return -1;
+    }
+    p += n;
+    length -= n;
+  }
+  return 0;
+}
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void count_event(APEX_CPU* cpu, int event, CPU_Stage* stage)
+{
+  Run_Events* events = cpu->event_data;
+  if (event == APEX_EVENT_STALL) {
+    events->stalls++;
+  }
+  else if (event == APEX_EVENT_FLUSH) {
+    events->flushes++;
+  }
+}
+
+/*
+ * Builds an initialized cpu for the request. Returns NULL and sets *status
+ * if the program or configuration is invalid.
+ */
+static APEX_CPU* build_cpu(APEX_Server_Request* request, const char* program, const char* config, uint32_t* status)
+{
+  int size;
+  APEX_Instruction* code_memory = create_code_memory_from_buffer(program, request->program_length, &size);
+  if (!code_memory) {
+    *status = APEX_SERVER_BAD_PROGRAM;
+    return NULL;
+  }
+  APEX_CPU* cpu = APEX_cpu_init_code(code_memory, size);
+  if (!cpu) {
+    *status = APEX_SERVER_NO_MEMORY;
+    return NULL;
+  }
+  if (APEX_config_load_buffer(cpu, config, request->config_length) || request->lsq_size > MAX_STORE_BUFFER) {
+    APEX_cpu_stop(cpu);
+    *status = APEX_SERVER_BAD_CONFIG;
+    return NULL;
+  }
+  cpu->lsq_size = request->lsq_size;
+  cpu->quiet = 1;
+  return cpu;
+}
+
+/*
+ * Returns the cache entry for the request text, building and inserting it
+ * on a miss. Returns NULL with *uncached set if every entry is in use.
+ */
+static Cache_Entry* cache_acquire(APEX_Server_Request* request, const char* text, size_t length, APEX_CPU** uncached, int* hit, uint32_t* status)
+{
+  uint64_t hash = hash_bytes(text, length);
+  *uncached = NULL;
+  *hit = 0;
+
+  pthread_mutex_lock(&cache_lock);
+  for (int i = 0; i < CACHE_ENTRIES; ++i) {
+    Cache_Entry* entry = &cache[i];
+    if (entry->cpu && entry->hash == hash && entry->length == length && memcmp(entry->text, text, length) == 0) {
+      entry->refs++;
+      entry->last_used = ++cache_clock;
+      pthread_mutex_unlock(&cache_lock);
+      *hit = 1;
+      return entry;
+    }
+  }
+  pthread_mutex_unlock(&cache_lock);
+
+  /* Parse outside the lock */
+  APEX_CPU* cpu = build_cpu(request, text, text + request->program_length, status);
+  char* copy = cpu ? malloc(length) : NULL;
+  if (!copy) {
+    if (cpu) {
+      *status = APEX_SERVER_NO_MEMORY;
+      APEX_cpu_stop(cpu);
+    }
+    return NULL;
+  }
+  memcpy(copy, text, length);
+
+  pthread_mutex_lock(&cache_lock);
+  Cache_Entry* victim = NULL;
+  for (int i = 0; i < CACHE_ENTRIES; ++i) {
+    Cache_Entry* entry = &cache[i];
+    if (entry->refs == 0 && (!victim || !entry->cpu || (victim->cpu && entry->last_used < victim->last_used))) {
+      victim = entry;
+    }
+  }
+  if (!victim) {
+    pthread_mutex_unlock(&cache_lock);
+    free(copy);
+    *uncached = cpu;
+    return NULL;
+  }
+  if (victim->cpu) {
+    APEX_cpu_stop(victim->cpu);
+    free(victim->text);
+  }
+  victim->hash = hash;
+  victim->text = copy;
+  victim->length = length;
+  victim->cpu = cpu;
+  victim->refs = 1;
+  victim->last_used = ++cache_clock;
+  pthread_mutex_unlock(&cache_lock);
+  return victim;
+}
+
+static void cache_release(Cache_Entry* entry)
+{
+  pthread_mutex_lock(&cache_lock);
+  entry->refs--;
+  pthread_mutex_unlock(&cache_lock);
+}
+
+/*
+ * Serves the requests of one connection until the client closes it.
+ */
+static void serve_connection(int fd, APEX_CPU* cpu, char** text, size_t* text_size, int32_t* reply_buffer)
+{
+  APEX_Server_Request request;
+  while (read_full(fd, &request, sizeof(request)) == 0) {
+    uint64_t start = now_ns();
+    if (request.magic != APEX_SERVER_MAGIC || request.program_length > APEX_SERVER_MAX_TEXT || request.config_length > APEX_SERVER_MAX_TEXT) {
+      return;
+    }
+
+    /* The cache key is the program, the configuration, the LSQ size and
+     * where the program ends */
+    size_t length = request.program_length + request.config_length + 2 * sizeof(uint32_t);
+    if (length > *text_size) {
+      char* bigger = realloc(*text, length);
+      if (!bigger) {
+        return;
+      }
+      *text = bigger;
+      *text_size = length;
+    }
+    if (read_full(fd, *text, request.program_length + request.config_length)) {
+      return;
+    }
+    char* key = *text + request.program_length + request.config_length;
+    memcpy(key, &request.lsq_size, sizeof(uint32_t));
+    memcpy(key + sizeof(uint32_t), &request.program_length, sizeof(uint32_t));
+
+    APEX_Server_Reply* reply = (APEX_Server_Reply*)reply_buffer;
+    int32_t* words = (int32_t*)(reply + 1);
+    memset(reply, 0, sizeof(*reply));
+    reply->magic = APEX_SERVER_MAGIC;
+
+    APEX_CPU* uncached;
+    int hit;
+    Cache_Entry* entry = cache_acquire(&request, *text, length, &uncached, &hit, &reply->status);
+    APEX_CPU* initial = entry ? entry->cpu : uncached;
+    if (initial) {
+      Run_Events events = { 0, 0 };
+      *cpu = *initial;
+      cpu->event_hook = count_event;
+      cpu->event_data = &events;
+
+      uint32_t i;
+      for (i = 0; i < request.cycles; ++i) {
+        if (APEX_cpu_cycle(cpu)) {
+          reply->halted = 1;
+          i++;
+          break;
+        }
+      }
+      lsq_flush(cpu);
+
+      reply->cached = hit;
+      reply->cycles = i;
+      reply->retired = cpu->ins_retired;
+      reply->stalls = events.stalls;
+      reply->flushes = events.flushes;
+      for (int r = 0; r < 16; ++r) {
+        reply->regs[r] = cpu->commit_regs[r];
+      }
+      if (request.flags & APEX_SERVER_MEMORY) {
+        for (int a = 0; a < 4096; ++a) {
+          if (cpu->data_memory[a]) {
+            words[2 * reply->memory_words] = a;
+            words[2 * reply->memory_words + 1] = cpu->data_memory[a];
+            reply->memory_words++;
+          }
+        }
+      }
+      if (entry) {
+        cache_release(entry);
+      }
+      else {
+        APEX_cpu_stop(uncached);
+      }
+    }
+    reply->service_ns = now_ns() - start;
+    if (write_full(fd, reply, sizeof(*reply) + 2 * sizeof(int32_t) * reply->memory_words)) {
+      return;
+    }
+  }
+}
+
+static void* worker(void* arg)
+{
+  APEX_CPU* cpu = malloc(sizeof(*cpu));
+  int32_t* reply_buffer = malloc(sizeof(APEX_Server_Reply) + 2 * sizeof(int32_t) * 4096);
+  size_t text_size = 4096;
+  char* text = malloc(text_size);
+  if (!cpu || !reply_buffer || !text) {
+    fprintf(stderr, "APEX_Error : Worker out of memory\n");
+    exit(1);
+  }
+
+  for (;;) {
+    pthread_mutex_lock(&queue_lock);
+    while (queue_count == 0) {
+      pthread_cond_wait(&queue_ready, &queue_lock);
+    }
+    int fd = queue[queue_head];
+    queue_head = (queue_head + 1) % QUEUE_SIZE;
+    queue_count--;
+    pthread_cond_signal(&queue_space);
+    pthread_mutex_unlock(&queue_lock);
+
+    serve_connection(fd, cpu, &text, &text_size, reply_buffer);
+    close(fd);
+  }
+  return NULL;
+}
+
+static void stop_server(int sig)
+{
+  unlink(socket_path);
+  _exit(0);
+}
+
+int main(int argc, char const* argv[])
+{
+  if (argc < 2) {
+    fprintf(stderr, "APEX_Help : Usage %s <socket_path> [threads]\n", argv[0]);
+    exit(1);
+  }
+  socket_path = argv[1];
+  int threads = argc > 2 ? atoi(argv[2]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (threads < 1) {
+    threads = 1;
+  }
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(socket_path) >= sizeof(address.sun_path)) {
+    fprintf(stderr, "APEX_Error : Socket path too long\n");
+    exit(1);
+  }
+  strcpy(address.sun_path, socket_path);
+
+  int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(socket_path);
+  if (listen_fd < 0 || bind(listen_fd, (struct sockaddr*)&address, sizeof(address)) || listen(listen_fd, 128)) {
+    perror("APEX_Error : Unable to listen");
+    exit(1);
+  }
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, stop_server);
+  signal(SIGTERM, stop_server);
+
+  for (int i = 0; i < threads; ++i) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, worker, NULL)) {
+      fprintf(stderr, "APEX_Error : Unable to start worker\n");
+      exit(1);
+    }
+    pthread_detach(thread);
+  }
+  fprintf(stderr, "APEX_Server : Listening on %s with %d workers\n", socket_path, threads);
+
+  for (;;) {
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("APEX_Error : accept");
+      break;
+    }
+    pthread_mutex_lock(&queue_lock);
+    while (queue_count == QUEUE_SIZE) {
+      pthread_cond_wait(&queue_space, &queue_lock);
+    }
+    queue[(queue_head + queue_count) % QUEUE_SIZE] = fd;
+    queue_count++;
+    pthread_cond_signal(&queue_ready);
+    pthread_mutex_unlock(&queue_lock);
+  }
+  unlink(socket_path);
+  return 1;
+}
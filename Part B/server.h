@@ -0,0 +1,63 @@
+#ifndef _APEX_SERVER_H_
+#define _APEX_SERVER_H_
+/**
+ *  server.h
+ *  Contains the protocol of the APEX simulation server. A client connects
+ *  to the server's Unix domain socket and sends any number of requests on
+ *  the connection; the server answers each one in order. All fields are
+ *  in host byte order, the socket is local.
+ *
+ *  Request : APEX_Server_Request, program text, configuration text
+ *  Reply   : APEX_Server_Reply, memory_words (address, value) int32 pairs
+ *
+ *  The program text has the input file format and the configuration text
+ *  the pipeline configuration file format (empty for the default pipeline).
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdint.h>
+
+#define APEX_SERVER_MAGIC 0x53585041	    // "APXS"
+#define APEX_SERVER_MAX_TEXT (1 << 20)
+
+/* Request flags */
+#define APEX_SERVER_MEMORY 1		    // Send non-zero data memory words
+
+/* Reply status */
+enum
+{
+  APEX_SERVER_OK,
+  APEX_SERVER_BAD_PROGRAM,
+  APEX_SERVER_BAD_CONFIG,
+  APEX_SERVER_NO_MEMORY
+};
+
+typedef struct APEX_Server_Request
+{
+  uint32_t magic;
+  uint32_t cycles;		    // Cycle budget
+  uint32_t lsq_size;		    // Store buffer entries, 0 disables the LSQ
+  uint32_t flags;
+  uint32_t program_length;	    // Bytes of program text that follow
+  uint32_t config_length;	    // Bytes of configuration text after it
+} APEX_Server_Request;
+
+typedef struct APEX_Server_Reply
+{
+  uint32_t magic;
+  uint32_t status;
+  uint32_t halted;		    // Program reached HALT within the budget
+  uint32_t cached;		    // Program and configuration were cached
+  uint32_t cycles;
+  uint32_t retired;
+  uint32_t stalls;		    // Cycles DRF was held
+  uint32_t flushes;		    // Taken branches
+  uint64_t service_ns;		    // Time from request to reply in the server
+  int32_t regs[16];		    // Registers of retired instructions
+  uint32_t memory_words;	    // (address, value) pairs that follow
+  uint32_t reserved;
+} APEX_Server_Reply;
+
+#endif
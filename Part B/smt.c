@@ -0,0 +1,359 @@
+/*
+ *  smt.c
+ *  Contains the fine-grained multithreading driver. The threads share the
+ *  pipeline latches and the data memory; each has its own program, PC,
+ *  register file, scoreboard and zero flag. Every latch carries the thread
+ *  of its instruction, and each stage is simulated with the context of that
+ *  thread loaded, so forwarding, stalls and branch flushes only ever see
+ *  instructions of the same thread.
+ *
+ *  Every cycle fetch picks one ready thread: round-robin after the thread
+ *  fetched last, or ICOUNT, the thread with the fewest instructions between
+ *  DRF and WB. A thread is not ready while it is redirecting after a taken
+ *  branch or once it has fetched HALT.
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "smt.h"
+#include "telemetry.h"
+#include "dram.h"
+
+/* Architectural and control state of a thread while it is not loaded */
+typedef struct SMT_Thread
+{
+  APEX_Instruction* code_memory;
+  int code_memory_size;
+  int pc;
+  int regs[32];
+  int regs_valid[32];
+  int dup_regs[32];
+  int reg_seq[32];
+  int commit_regs[32];
+  int vregs[NUM_VREGS][VECTOR_LANES];
+  int dup_vregs[NUM_VREGS][VECTOR_LANES];
+  int zeroFlag;
+  int commit_zeroFlag;
+  int flag_seq;
+  int branchTaken;
+  int haltEncountered;
+  int printedOnce;
+  int ins_completed;
+
+  /* Statistics */
+  int done;			    // HALT retired
+  int done_cycle;
+  long retired;			    // Instructions retired, HALT excluded
+  long fetched;			    // Instructions fetched into DRF
+  long drf_cycles;		    // Cycles its instruction held DRF
+} SMT_Thread;
+
+typedef struct SMT
+{
+  APEX_CPU* cpu;		    // Pipeline, holds the loaded context
+  SMT_Thread threads[APEX_MAX_THREADS];
+  int num_threads;
+  int policy;
+  int running;			    // Threads that have not retired HALT
+  int last;			    // Thread fetched last
+  long cycles;
+  long idle_fetch;		    // Cycles no thread was fetched
+} SMT;
+
+static void save_context(const APEX_CPU* cpu, SMT_Thread* t)
+{
+  t->code_memory = cpu->code_memory;
+  t->code_memory_size = cpu->code_memory_size;
+  t->pc = cpu->pc;
+  memcpy(t->regs, cpu->regs, sizeof(t->regs));
+  memcpy(t->regs_valid, cpu->regs_valid, sizeof(t->regs_valid));
+  memcpy(t->dup_regs, cpu->dup_regs, sizeof(t->dup_regs));
+  memcpy(t->reg_seq, cpu->reg_seq, sizeof(t->reg_seq));
+  memcpy(t->commit_regs, cpu->commit_regs, sizeof(t->commit_regs));
+  memcpy(t->vregs, cpu->vregs, sizeof(t->vregs));
+  memcpy(t->dup_vregs, cpu->dup_vregs, sizeof(t->dup_vregs));
+  t->zeroFlag = cpu->zeroFlag;
+  t->commit_zeroFlag = cpu->commit_zeroFlag;
+  t->flag_seq = cpu->flag_seq;
+  t->branchTaken = cpu->branchTaken;
+  t->haltEncountered = cpu->haltEncountered;
+  t->printedOnce = cpu->printedOnce;
+  t->ins_completed = cpu->ins_completed;
+}
+
+static void load_context(APEX_CPU* cpu, const SMT_Thread* t)
+{
+  cpu->code_memory = t->code_memory;
+  cpu->code_memory_size = t->code_memory_size;
+  cpu->pc = t->pc;
+  memcpy(cpu->regs, t->regs, sizeof(t->regs));
+  memcpy(cpu->regs_valid, t->regs_valid, sizeof(t->regs_valid));
+  memcpy(cpu->dup_regs, t->dup_regs, sizeof(t->dup_regs));
+  memcpy(cpu->reg_seq, t->reg_seq, sizeof(t->reg_seq));
+  memcpy(cpu->commit_regs, t->commit_regs, sizeof(t->commit_regs));
+  memcpy(cpu->vregs, t->vregs, sizeof(t->vregs));
+  memcpy(cpu->dup_vregs, t->dup_vregs, sizeof(t->dup_vregs));
+  cpu->zeroFlag = t->zeroFlag;
+  cpu->commit_zeroFlag = t->commit_zeroFlag;
+  cpu->flag_seq = t->flag_seq;
+  cpu->branchTaken = t->branchTaken;
+  cpu->haltEncountered = t->haltEncountered;
+  cpu->printedOnce = t->printedOnce;
+  cpu->ins_completed = t->ins_completed;
+}
+
+/* Loads the context of thread tid into the pipeline */
+static void switch_to(SMT* smt, int tid)
+{
+  APEX_CPU* cpu = smt->cpu;
+  if (cpu->tid == tid) {
+    return;
+  }
+  save_context(cpu, &smt->threads[cpu->tid]);
+  load_context(cpu, &smt->threads[tid]);
+  cpu->tid = tid;
+}
+
+/* Instructions of thread tid between DRF and WB */
+static int in_flight(APEX_CPU* cpu, int tid)
+{
+  int count = 0;
+  for (int i = DRF; i < cpu->num_stages; ++i) {
+    count += cpu->stage[i].tid == tid && !compare_opcode(cpu->stage[i].opcode, "NOP");
+  }
+  return count;
+}
+
+/*
+ * Picks the thread to fetch from. The saved contexts must be current.
+ * Returns -1 if no thread is ready.
+ */
+static int select_thread(SMT* smt)
+{
+  int best = -1, best_count = 0;
+  for (int k = 1; k <= smt->num_threads; ++k) {
+    int tid = (smt->last + k) % smt->num_threads;
+    SMT_Thread* t = &smt->threads[tid];
+    if (t->done || t->haltEncountered || t->branchTaken) {
+      continue;
+    }
+    if (smt->policy == APEX_FETCH_RR) {
+      return tid;
+    }
+    int count = in_flight(smt->cpu, tid);
+    if (best < 0 || count < best_count) {
+      best = tid;
+      best_count = count;
+    }
+  }
+  return best;
+}
+
+static void fetch_thread(SMT* smt)
+{
+  APEX_CPU* cpu = smt->cpu;
+  CPU_Stage* drf = &cpu->stage[DRF];
+  save_context(cpu, &smt->threads[cpu->tid]);
+
+  /* An instruction left in DRF by a thread that took a branch is squashed */
+  if (!compare_opcode(drf->opcode, "NOP") && smt->threads[drf->tid].branchTaken) {
+    memset(drf, 0, sizeof(*drf));
+    strcpy(drf->opcode, "NOP");
+  }
+
+  int tid = select_thread(smt);
+  if (tid >= 0) {
+    switch_to(smt, tid);
+    int pc = cpu->pc;
+    fetch(cpu);
+    if (cpu->pc != pc) {
+      smt->last = tid;
+      smt->threads[tid].fetched++;
+    }
+  }
+  else {
+    if (cpu->stall_stage <= F && !drf->stalled && !cpu->branchEncountered) {
+      memset(drf, 0, sizeof(*drf));
+      strcpy(drf->opcode, "NOP");
+    }
+    smt->idle_fetch++;
+  }
+
+  /* Taken branches have redirected their thread */
+  cpu->branchTaken = 0;
+  for (int i = 0; i < smt->num_threads; ++i) {
+    smt->threads[i].branchTaken = 0;
+  }
+}
+
+/*
+ * Simulates one clock cycle with every stage under the context of its
+ * instruction. Returns 1 once every thread has retired HALT.
+ */
+static int smt_cycle(SMT* smt)
+{
+  APEX_CPU* cpu = smt->cpu;
+  cpu->stall_stage = 0;
+  if (cpu->clock >= cpu->num_stages) {
+    stageScoreBoard(cpu);
+  }
+  smt->cycles++;
+
+  CPU_Stage* wb = &cpu->stage[cpu->wb];
+  int wb_tid = wb->tid;
+  int retiring = !wb->busy && !wb->stalled && !compare_opcode(wb->opcode, "NOP");
+  if (retiring) {
+    SMT_Thread* t = &smt->threads[wb_tid];
+    if (!compare_opcode(wb->opcode, "HALT")) {
+      t->retired += wb->fused != OP_NOP ? 2 : 1;
+    }
+    else if (!t->done) {
+      t->done = 1;
+      t->done_cycle = smt->cycles;
+      smt->running--;
+    }
+  }
+  switch_to(smt, wb_tid);
+  writeback(cpu);
+
+  /* Writeback only woke DRF for a register of its own thread */
+  CPU_Stage* drf = &cpu->stage[DRF];
+  if (retiring && drf->stalled && drf->tid != wb_tid) {
+    switch_to(smt, drf->tid);
+    if (!shouldStall(cpu)) {
+      drf->stalled = 0;
+    }
+  }
+
+  for (int i = cpu->wb - 1; i > cpu->mem1; --i) {
+    switch_to(smt, cpu->stage[i].tid);
+    memoryN(cpu, i);
+  }
+  switch_to(smt, cpu->stage[cpu->mem1].tid);
+  memory1(cpu);
+  if (cpu->dram.channels) {
+    dram_schedule(cpu);
+  }
+  for (int i = cpu->mem1 - 1; i > EX1; --i) {
+    switch_to(smt, cpu->stage[i].tid);
+    executeN(cpu, i);
+  }
+  switch_to(smt, cpu->stage[EX1].tid);
+  execute1(cpu);
+
+  switch_to(smt, drf->tid);
+  decode(cpu);
+  if (!compare_opcode(drf->opcode, "NOP") && (drf->stalled || cpu->branchEncountered)) {
+    smt->threads[drf->tid].drf_cycles++;
+  }
+  fetch_thread(smt);
+
+  if (smt->running == 0) {
+    return 1;
+  }
+  cpu->clock++;
+  if (cpu->telemetry && cpu->clock >= cpu->telemetry->next) {
+    telemetry_update(cpu, TELEMETRY_RUNNING);
+  }
+  return 0;
+}
+
+static void print_results(SMT* smt)
+{
+  APEX_CPU* cpu = smt->cpu;
+  long retired = 0;
+  save_context(cpu, &smt->threads[cpu->tid]);
+  for (int i = 0; i < smt->num_threads; ++i) {
+    printf("\n================Thread %d register file=============\n", i);
+    for (int r = 0; r <= 15; ++r) {
+      printf("|\tREG[%d]\t|\tValue = %d\t|\n", r, smt->threads[i].commit_regs[r]);
+    }
+    printf("===================================================\n");
+  }
+
+  printf("\n================State of Shared Data Memory=============\n");
+  for (int i = 0; i < 4096; ++i) {
+    if (cpu->data_memory[i] != 0) {
+      printf("|\tMEM[%d]\t|\tDataValue = %d\t|\n", i, cpu->data_memory[i]);
+    }
+  }
+  printf("=================================================");
+  printf("\nOther data memories are 0.\n");
+
+  printf("\n================Multithreading=============\n");
+  printf("%-7s %-9s %-9s %-9s %-8s %-6s\n", "thread", "retired", "fetched", "drf_held", "halted", "IPC");
+  for (int i = 0; i < smt->num_threads; ++i) {
+    SMT_Thread* t = &smt->threads[i];
+    char halted[16];
+    if (t->done) {
+      sprintf(halted, "%d", t->done_cycle);
+    }
+    else {
+      strcpy(halted, "no");
+    }
+    retired += t->retired;
+    printf("%-7d %-9ld %-9ld %-9ld %-8s %-6.3f\n", i, t->retired, t->fetched, t->drf_cycles, halted,
+           smt->cycles > 0 ? (double)t->retired / smt->cycles : 0.0);
+  }
+  printf("===========================================\n");
+  printf("Fetch policy         : %s\n", smt->policy == APEX_FETCH_ICOUNT ? "ICOUNT" : "round-robin");
+  printf("Cycles               : %ld\n", smt->cycles);
+  printf("Instructions retired : %ld\n", retired);
+  printf("Aggregate IPC        : %.3f\n", smt->cycles > 0 ? (double)retired / smt->cycles : 0.0);
+  printf("Idle fetch cycles    : %ld\n", smt->idle_fetch);
+  if (cpu->dram.channels) {
+    dram_print(cpu);
+  }
+}
+
+/*
+ *  Simulates the programs of num_threads initialized cpus as hardware
+ *  threads of the pipeline of cpus[0], for up to cycles cycles. The data
+ *  memory of cpus[0] is shared by all threads.
+ */
+int APEX_smt_run(APEX_CPU** cpus, int num_threads, int cycles, int policy)
+{
+  if (num_threads < 1 || num_threads > APEX_MAX_THREADS) {
+    fprintf(stderr, "APEX_Error : Between 1 and %d threads are supported\n", APEX_MAX_THREADS);
+    return -1;
+  }
+  SMT* smt = calloc(1, sizeof(*smt));
+  if (!smt) {
+    return -1;
+  }
+  APEX_CPU* cpu = cpus[0];
+  smt->cpu = cpu;
+  smt->num_threads = num_threads;
+  smt->policy = policy;
+  smt->running = num_threads;
+  smt->last = num_threads - 1;
+  for (int i = 0; i < num_threads; ++i) {
+    save_context(cpus[i], &smt->threads[i]);
+  }
+  cpu->tid = 0;
+  cpu->quiet = 1;
+  /* One loop buffer would be shared by the threads, LOOPs resolve as branches */
+  cpu->loop_buffer_size = 0;
+  cpu->debug = 0;
+
+  int start = cpu->clock;
+  while (cpu->clock - start < cycles) {
+    if (smt_cycle(smt)) {
+      break;
+    }
+  }
+  if (cpu->telemetry) {
+    telemetry_update(cpu, smt->running == 0 ? TELEMETRY_DONE : TELEMETRY_STOPPED);
+  }
+  print_results(smt);
+
+  /* cpus[0] is left with its own program loaded */
+  switch_to(smt, 0);
+  free(smt);
+  return 0;
+}
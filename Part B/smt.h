@@ -0,0 +1,26 @@
+#ifndef _APEX_SMT_H_
+#define _APEX_SMT_H_
+/**
+ *  smt.h
+ *  Contains the fine-grained multithreading driver: hardware threads with
+ *  their own program and architectural state share one pipeline and one
+ *  data memory
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include "cpu.h"
+
+#define APEX_MAX_THREADS 4
+
+/* Fetch policy */
+enum
+{
+  APEX_FETCH_RR,		    // Next ready thread after the last one fetched
+  APEX_FETCH_ICOUNT		    // Ready thread with the fewest instructions in DRF..WB
+};
+
+int APEX_smt_run(APEX_CPU** cpus, int num_threads, int cycles, int policy);
+
+#endif
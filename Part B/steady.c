@@ -0,0 +1,361 @@
+/*
+ *  steady.c
+ *  Contains the loop steady-state detector. A functional model follows the
+ *  retired instructions. Each time a backward branch retires, the timing
+ *  state of the pipeline is compared with the one at its previous
+ *  retirement: latch occupancy, register validity and branch control, but
+ *  not the values. When two iterations retire the same PCs and leave the
+ *  same timing state behind, every further iteration on the same path takes
+ *  the same number of cycles.
+ *
+ *  The remaining iterations are then run functionally until the path
+ *  changes. All but the last few are skipped: the pipeline is restarted
+ *  empty at the loop head and simulated until it is back in the steady
+ *  state, and the clock is set to where the full simulation would be at
+ *  that point. The loop exit is simulated in detail.
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "steady.h"
+
+APEX_Steady* steady_create(APEX_CPU* cpu)
+{
+  APEX_Steady* steady = calloc(1, sizeof(*steady));
+  if (!steady) {
+    return NULL;
+  }
+  APEX_func_init(&steady->func, cpu);
+  steady->active = 1;
+  steady->backoff = 1;
+  return steady;
+}
+
+void steady_free(APEX_Steady* steady)
+{
+  free(steady);
+}
+
+/*
+ * Keeps the functional model in step with the instruction retiring in
+ * writeback and notes the end of a loop iteration.
+ */
+void steady_commit(APEX_CPU* cpu, CPU_Stage* stage)
+{
+  APEX_Steady* s = cpu->steady;
+  if (!s->active) {
+    return;
+  }
+  if (s->func.pc != stage->pc || !APEX_func_step(&s->func, cpu)) {
+    s->active = 0;
+    return;
+  }
+
+  if (s->body_length >= 0) {
+    if (s->body_length < STEADY_MAX_BODY) {
+      s->body[s->body_length++] = stage->pc;
+    }
+    else {
+      s->body_length = -1;
+    }
+  }
+  if (s->func.branch_taken && s->func.pc <= stage->pc) {
+    s->boundary = 1;
+    s->branch_pc = stage->pc;
+    s->head_pc = s->func.pc;
+  }
+}
+
+static void capture(APEX_CPU* cpu, Steady_Point* point)
+{
+  Steady_Signature* sig = &point->sig;
+  memset(sig, 0, sizeof(*sig));
+  for (int i = 0; i < cpu->num_stages; ++i) {
+    CPU_Stage* stage = &cpu->stage[i];
+    Steady_Latch* latch = &sig->latch[i];
+    latch->opcode = get_opcode_id(stage->opcode);
+    if (latch->opcode != OP_NOP) {
+      latch->pc = stage->pc;
+      latch->rd = stage->rd;
+      latch->rs1 = stage->rs1;
+      latch->rs2 = stage->rs2;
+      latch->rs3 = stage->rs3;
+    }
+    latch->elapsed = stage->elapsed;
+    latch->busy = stage->busy;
+    latch->stalled = stage->stalled;
+  }
+  for (int i = 0; i < 32; ++i) {
+    sig->regs_valid[i] = cpu->regs_valid[i] != 0;
+    sig->reg_owner[i] = -1;
+    for (int k = EX1; k < cpu->num_stages; ++k) {
+      if (cpu->stage[k].seq == cpu->reg_seq[i] && get_opcode_id(cpu->stage[k].opcode) != OP_NOP) {
+        sig->reg_owner[i] = k;
+      }
+    }
+  }
+  sig->branchTaken = cpu->branchTaken;
+  sig->branchEncountered = cpu->branchEncountered;
+  sig->flag_owner = -1;
+  for (int k = EX1; k < cpu->num_stages; ++k) {
+    if (cpu->stage[k].seq == cpu->flag_seq && get_opcode_id(cpu->stage[k].opcode) != OP_NOP) {
+      sig->flag_owner = k;
+    }
+  }
+  sig->haltEncountered = cpu->haltEncountered;
+  sig->sb_count = cpu->sb_count;
+  sig->sb_port = cpu->sb_port_free > cpu->clock ? cpu->sb_port_free - cpu->clock : 0;
+  sig->loop_armed = cpu->loop.armed;
+  sig->loop_end = cpu->loop.armed ? cpu->loop.end : 0;
+
+  point->clock = cpu->clock;
+  point->ins_retired = cpu->ins_retired;
+  point->lsq[0] = cpu->lsq_stores;
+  point->lsq[1] = cpu->lsq_loads;
+  point->lsq[2] = cpu->lsq_forwards;
+  point->lsq[3] = cpu->lsq_drains;
+  point->lsq[4] = cpu->lsq_full_stalls;
+  point->lsq[5] = cpu->lsq_port_stalls;
+  point->events[0] = cpu->raw_stalls;
+  point->events[1] = cpu->branch_stalls;
+  point->events[2] = cpu->hold_stalls;
+  point->events[3] = cpu->flushes;
+  point->events[4] = cpu->mem_loads;
+  point->events[5] = cpu->mem_stores;
+  point->loop[0] = cpu->loop_hits;
+  point->loop[1] = cpu->loop_redirects;
+  point->loop[2] = cpu->loop_mispredicts;
+  point->loop[3] = cpu->loops_retired;
+  point->vector[0] = cpu->vector_ops;
+  point->vector[1] = cpu->vector_loads;
+  point->vector[2] = cpu->vector_stores;
+}
+
+/*
+ * Runs one iteration of the loop on the functional model. Returns 1 if it
+ * retired the same PCs as the last iteration and branched back to the head.
+ * legacy, if given, follows the register file as writeback leaves it.
+ */
+static int run_iteration(APEX_Steady* s, const APEX_CPU* cpu, APEX_Func_State* st, int* legacy)
+{
+  for (int i = 0; i < s->last_length; ++i) {
+    if (st->pc != s->last_body[i]) {
+      return 0;
+    }
+    APEX_Instruction* ins = &cpu->code_memory[get_code_index(st->pc)];
+    if (!APEX_func_step(st, cpu)) {
+      return 0;
+    }
+    if (legacy) {
+      int op = get_opcode_id(ins->opcode);
+      if (op == OP_MOVC || op == OP_AND || op == OP_OR || op == OP_EXOR || op == OP_LOAD || op == OP_LDR) {
+        legacy[ins->rd] = st->regs[ins->rd];
+      }
+    }
+  }
+  return st->branch_taken && st->pc == s->head_pc;
+}
+
+/*
+ * Empties the pipeline of cpu and loads the architectural state st, with
+ * fetch starting at pc.
+ */
+static void restart_empty(APEX_CPU* cpu, const APEX_Func_State* st, const int* legacy, int pc)
+{
+  for (int i = 0; i < MAX_STAGES; ++i) {
+    memset(&cpu->stage[i], 0, sizeof(CPU_Stage));
+    strcpy(cpu->stage[i].opcode, "NOP");
+  }
+  cpu->pc = pc;
+  cpu->zeroFlag = st->zeroFlag;
+  cpu->commit_zeroFlag = st->zeroFlag;
+  memcpy(cpu->regs, legacy, sizeof(cpu->regs));
+  memcpy(cpu->dup_regs, st->regs, sizeof(cpu->dup_regs));
+  memcpy(cpu->commit_regs, st->regs, sizeof(cpu->commit_regs));
+  memcpy(cpu->vregs, st->vregs, sizeof(cpu->vregs));
+  memcpy(cpu->dup_vregs, st->vregs, sizeof(cpu->dup_vregs));
+  memcpy(cpu->data_memory, st->data_memory, sizeof(st->data_memory));
+  for (int i = 0; i < 32; ++i) {
+    cpu->regs_valid[i] = 1;
+    cpu->reg_seq[i] = 0;
+  }
+  cpu->branchTaken = 0;
+  cpu->branchEncountered = 0;
+  cpu->flag_seq = 0;
+  cpu->stall_stage = 0;
+  cpu->sb_head = 0;
+  cpu->sb_count = 0;
+  cpu->sb_port_free = 0;
+  cpu->loop.armed = 0;
+}
+
+/*
+ * Skips iterations of a loop in the steady state reached at now.
+ * Returns 1 if cpu was moved forward.
+ */
+static int extrapolate(APEX_CPU* cpu, const Steady_Point* prev, const Steady_Point* now)
+{
+  APEX_Steady* s = cpu->steady;
+  int period = now->clock - prev->clock;
+  int per_retired = now->ins_retired - prev->ins_retired;
+  if (period <= 0) {
+    return 0;
+  }
+
+  /* Iterations on the same path that also end within the cycle budget.
+   * lag trails lead by the iterations left for the detailed re-entry. */
+  int limit = (s->budget - now->clock) / period - 1;
+  int n = 0;
+  s->lead = s->func;
+  s->lag = s->func;
+  memcpy(s->legacy_regs, cpu->regs, sizeof(s->legacy_regs));
+  while (n < limit && run_iteration(s, cpu, &s->lead, NULL)) {
+    n++;
+    if (n > STEADY_CALIBRATION) {
+      run_iteration(s, cpu, &s->lag, s->legacy_regs);
+    }
+  }
+  int skip = n - STEADY_CALIBRATION;
+  if (skip < 2) {
+    return 0;
+  }
+
+  /* Restart an empty pipeline after the skipped iterations and simulate
+   * until it is back in the steady state */
+  APEX_CPU* shadow = &s->shadow;
+  *shadow = *cpu;
+  shadow->steady = NULL;
+  shadow->profile = NULL;
+  shadow->series = NULL;
+  shadow->telemetry = NULL;
+  shadow->event_hook = NULL;
+  restart_empty(shadow, &s->lag, s->legacy_regs, s->head_pc);
+
+  Steady_Point point;
+  int detailed = 0, start = shadow->clock, limit_cycles = (STEADY_CALIBRATION + 1) * (period + cpu->num_stages);
+  while (detailed < STEADY_CALIBRATION && shadow->clock - start < limit_cycles) {
+    CPU_Stage* wb = &shadow->stage[shadow->wb];
+    int retiring = !wb->busy && !wb->stalled && !compare_opcode(wb->opcode, "NOP") && wb->pc == s->branch_pc;
+    if (APEX_cpu_cycle(shadow)) {
+      return 0;
+    }
+    if (retiring) {
+      detailed++;
+      capture(shadow, &point);
+      if (!memcmp(&point.sig, &now->sig, sizeof(point.sig))) {
+        break;
+      }
+    }
+  }
+  if (detailed == 0 || memcmp(&point.sig, &now->sig, sizeof(point.sig))) {
+    return 0;
+  }
+  int elapsed = shadow->clock - start;
+
+  /* Bring the functional model up to the re-entry */
+  for (int i = 0; i < detailed; ++i) {
+    if (!run_iteration(s, cpu, &s->lag, NULL)) {
+      return 0;
+    }
+  }
+  if (memcmp(shadow->commit_regs, s->lag.regs, sizeof(s->lag.regs)) || memcmp(shadow->vregs, s->lag.vregs, sizeof(s->lag.vregs))) {
+    return 0;
+  }
+
+  int iterations = skip + detailed;
+  shadow->steady = cpu->steady;
+  shadow->profile = cpu->profile;
+  shadow->series = cpu->series;
+  shadow->telemetry = cpu->telemetry;
+  shadow->event_hook = cpu->event_hook;
+  shadow->event_data = cpu->event_data;
+  /* The store being written keeps its remaining port cycles */
+  shadow->sb_port_free += now->clock + iterations * period - shadow->clock;
+  shadow->clock = now->clock + iterations * period;
+  shadow->ins_retired = now->ins_retired + iterations * per_retired;
+  shadow->lsq_stores = now->lsq[0] + iterations * (now->lsq[0] - prev->lsq[0]);
+  shadow->lsq_loads = now->lsq[1] + iterations * (now->lsq[1] - prev->lsq[1]);
+  shadow->lsq_forwards = now->lsq[2] + iterations * (now->lsq[2] - prev->lsq[2]);
+  shadow->lsq_drains = now->lsq[3] + iterations * (now->lsq[3] - prev->lsq[3]);
+  shadow->lsq_full_stalls = now->lsq[4] + iterations * (now->lsq[4] - prev->lsq[4]);
+  shadow->lsq_port_stalls = now->lsq[5] + iterations * (now->lsq[5] - prev->lsq[5]);
+  shadow->raw_stalls = now->events[0] + iterations * (now->events[0] - prev->events[0]);
+  shadow->branch_stalls = now->events[1] + iterations * (now->events[1] - prev->events[1]);
+  shadow->hold_stalls = now->events[2] + iterations * (now->events[2] - prev->events[2]);
+  shadow->flushes = now->events[3] + iterations * (now->events[3] - prev->events[3]);
+  shadow->mem_loads = now->events[4] + iterations * (now->events[4] - prev->events[4]);
+  shadow->mem_stores = now->events[5] + iterations * (now->events[5] - prev->events[5]);
+  shadow->loop_hits = now->loop[0] + iterations * (now->loop[0] - prev->loop[0]);
+  shadow->loop_redirects = now->loop[1] + iterations * (now->loop[1] - prev->loop[1]);
+  shadow->loop_mispredicts = now->loop[2] + iterations * (now->loop[2] - prev->loop[2]);
+  shadow->loops_retired = now->loop[3] + iterations * (now->loop[3] - prev->loop[3]);
+  shadow->vector_ops = now->vector[0] + iterations * (now->vector[0] - prev->vector[0]);
+  shadow->vector_loads = now->vector[1] + iterations * (now->vector[1] - prev->vector[1]);
+  shadow->vector_stores = now->vector[2] + iterations * (now->vector[2] - prev->vector[2]);
+  *cpu = *shadow;
+
+  s->func = s->lag;
+  s->loops++;
+  s->iterations += skip;
+  s->cycles += (long)iterations * period - elapsed;
+  return 1;
+}
+
+/*
+ * Compares the pipeline with the previous iteration once a loop branch has
+ * retired and extrapolates when it is in a steady state.
+ */
+void steady_end_cycle(APEX_CPU* cpu)
+{
+  APEX_Steady* s = cpu->steady;
+  if (!s->boundary) {
+    return;
+  }
+  s->boundary = 0;
+
+  Steady_Point now;
+  capture(cpu, &now);
+  int steady = s->have_last && s->last_branch_pc == s->branch_pc && s->body_length > 0 && s->body_length == s->last_length && !memcmp(s->body, s->last_body, sizeof(int) * s->body_length) && !memcmp(&now.sig, &s->last.sig, sizeof(now.sig));
+
+  /* Timing would be skipped without being printed or reported */
+  int watched = !cpu->quiet || cpu->debug || cpu->profile || cpu->event_hook;
+
+  if (steady && !watched && s->wait == 0) {
+    if (extrapolate(cpu, &s->last, &now)) {
+      s->backoff = 1;
+      capture(cpu, &now);
+    }
+    else {
+      s->wait = s->backoff;
+      s->backoff = s->backoff < 1024 ? 2 * s->backoff : s->backoff;
+    }
+  }
+  else if (s->wait > 0) {
+    s->wait--;
+  }
+
+  s->last = now;
+  s->have_last = 1;
+  s->last_branch_pc = s->branch_pc;
+  s->last_length = s->body_length;
+  if (s->body_length > 0) {
+    memcpy(s->last_body, s->body, sizeof(int) * s->body_length);
+  }
+  s->body_length = 0;
+}
+
+void steady_print(APEX_CPU* cpu)
+{
+  APEX_Steady* s = cpu->steady;
+  printf("================Steady-state loops=============\n");
+  printf("Loops extrapolated     : %d\n", s->loops);
+  printf("Iterations skipped     : %ld\n", s->iterations);
+  printf("Cycles added           : %ld\n", s->cycles);
+  printf("Total cycles           : %d\n", cpu->clock);
+  printf("===============================================\n");
+}
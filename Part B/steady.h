@@ -0,0 +1,101 @@
+#ifndef _APEX_STEADY_H_
+#define _APEX_STEADY_H_
+/**
+ *  steady.h
+ *  Contains the loop steady-state detector: iterations of a loop that
+ *  repeat the same pipeline timing are executed functionally and their
+ *  cycles added analytically
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include "functional.h"
+
+#define STEADY_MAX_BODY 4096	    // Longest loop body that is tracked
+#define STEADY_CALIBRATION 3	    // Detailed iterations allowed to re-enter the steady state
+
+/* Timing state of one latch, values are left out */
+typedef struct Steady_Latch
+{
+  int opcode;
+  int pc;
+  int rd;
+  int rs1;
+  int rs2;
+  int rs3;
+  int elapsed;
+  int busy;
+  int stalled;
+} Steady_Latch;
+
+/* Everything the timing of the following cycles depends on, apart from the
+ * path the program takes */
+typedef struct Steady_Signature
+{
+  Steady_Latch latch[MAX_STAGES];
+  int regs_valid[32];
+  int reg_owner[32];		    // Stage of the youngest writer past EX1, -1 if retired
+  int branchTaken;
+  int branchEncountered;
+  int flag_owner;		    // Stage of the zero flag producer past EX1, -1 if retired
+  int haltEncountered;
+  int sb_count;
+  int sb_port;			    // Cycles until the store being written frees the port
+  int loop_armed;		    // Fetch redirects at a buffered LOOP
+  int loop_end;
+} Steady_Signature;
+
+/* Pipeline state at the retirement of a loop branch */
+typedef struct Steady_Point
+{
+  Steady_Signature sig;
+  int clock;
+  int ins_retired;
+  int lsq[6];			    // Stores, loads, forwards, drains, full and port stalls
+  int events[6];		    // Raw, branch and hold stalls, flushes, loads, stores
+  int loop[4];			    // Loop buffer hits, buffered iterations, mispredicted and retired LOOPs
+  int vector[3];		    // Vector operations, loads and stores
+} Steady_Point;
+
+typedef struct APEX_Steady
+{
+  APEX_Func_State func;		    // Architectural state of the retired instructions
+  int active;			    // Cleared if the functional model leaves lockstep
+  int budget;			    // Clock at which the current run stops
+  int boundary;			    // A backward branch retired this cycle
+  int branch_pc;		    // Branch that closed the last iteration
+  int head_pc;			    // Loop head it branched to
+  int body[STEADY_MAX_BODY];	    // PCs retired since the last boundary
+  int body_length;		    // -1 once the body is too long to track
+  int last_body[STEADY_MAX_BODY];   // PCs of the previous iteration
+  int last_length;
+  int last_branch_pc;
+  int have_last;
+  Steady_Point last;		    // State at the previous boundary
+  int wait;			    // Boundaries to skip before the next attempt
+  int backoff;
+
+  /* Scratch state of an extrapolation */
+  APEX_Func_State lead;
+  APEX_Func_State lag;
+  int legacy_regs[32];
+  APEX_CPU shadow;
+
+  /* Statistics */
+  int loops;			    // Extrapolations
+  long iterations;		    // Iterations executed functionally
+  long cycles;			    // Cycles added analytically
+} APEX_Steady;
+
+APEX_Steady* steady_create(APEX_CPU* cpu);
+
+void steady_free(APEX_Steady* steady);
+
+void steady_commit(APEX_CPU* cpu, CPU_Stage* stage);
+
+void steady_end_cycle(APEX_CPU* cpu);
+
+void steady_print(APEX_CPU* cpu);
+
+#endif
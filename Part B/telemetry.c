@@ -0,0 +1,117 @@
+/*
+ *  telemetry.c
+ *  Contains the live telemetry page. The file is created with the size of
+ *  one APEX_Telemetry_Page and mapped shared; every N cycles the clock,
+ *  retired instructions, fetch PC, stall and flush counters and the
+ *  simulated cycles per second are stored into it. Between updates the
+ *  only cost is the clock check in APEX_cpu_cycle, and no system call is
+ *  made at an update except reading the time.
+ *
+ *  The magic number is stored last, so a reader that sees it sees the
+ *  header. The file is left behind with the final state when the run ends.
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "telemetry.h"
+
+#define STORE(field, value) __atomic_store_n(&(field), (value), __ATOMIC_RELAXED)
+
+static int64_t unix_ms(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+APEX_Telemetry* telemetry_create(const char* filename, int interval, const char* program)
+{
+  APEX_Telemetry* telemetry = calloc(1, sizeof(*telemetry));
+  if (!telemetry) {
+    return NULL;
+  }
+  /* A new file, so that readers of an old run never see it truncated */
+  unlink(filename);
+  int fd = open(filename, O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd < 0) {
+    free(telemetry);
+    return NULL;
+  }
+  if (ftruncate(fd, sizeof(APEX_Telemetry_Page)) != 0) {
+    close(fd);
+    free(telemetry);
+    return NULL;
+  }
+  void* page = mmap(NULL, sizeof(APEX_Telemetry_Page), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (page == MAP_FAILED) {
+    free(telemetry);
+    return NULL;
+  }
+  telemetry->page = page;
+  telemetry->interval = interval > 0 ? interval : 100000;
+  telemetry->next = telemetry->interval;
+  clock_gettime(CLOCK_MONOTONIC, &telemetry->last_time);
+
+  APEX_Telemetry_Page* p = telemetry->page;
+  snprintf(p->program, sizeof(p->program), "%s", program ? program : "");
+  p->version = TELEMETRY_VERSION;
+  p->pid = getpid();
+  p->state = TELEMETRY_RUNNING;
+  p->started = time(NULL);
+  p->updated_ms = unix_ms();
+  __atomic_store_n(&p->magic, TELEMETRY_MAGIC, __ATOMIC_RELEASE);
+  return telemetry;
+}
+
+/*
+ * Unmaps the page. A run that did not report its end is marked stopped.
+ */
+void telemetry_free(APEX_Telemetry* telemetry)
+{
+  if (!telemetry) {
+    return;
+  }
+  if (__atomic_load_n(&telemetry->page->state, __ATOMIC_RELAXED) == TELEMETRY_RUNNING) {
+    STORE(telemetry->page->state, TELEMETRY_STOPPED);
+  }
+  munmap(telemetry->page, sizeof(APEX_Telemetry_Page));
+  free(telemetry);
+}
+
+/*
+ * Publishes the counters of cpu and schedules the next update.
+ */
+void telemetry_update(APEX_CPU* cpu, int state)
+{
+  APEX_Telemetry* t = cpu->telemetry;
+  APEX_Telemetry_Page* p = t->page;
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  double seconds = (now.tv_sec - t->last_time.tv_sec) + (now.tv_nsec - t->last_time.tv_nsec) / 1e9;
+  if (seconds > 0 && cpu->clock > t->last_clock) {
+    STORE(p->cycles_per_sec, (int64_t)((cpu->clock - t->last_clock) / seconds));
+  }
+  t->last_time = now;
+  t->last_clock = cpu->clock;
+  t->next = cpu->clock - cpu->clock % t->interval + t->interval;
+
+  STORE(p->cycle, (int64_t)cpu->clock);
+  STORE(p->retired, (int64_t)cpu->ins_retired);
+  STORE(p->pc, (int64_t)cpu->pc);
+  STORE(p->raw_stalls, (int64_t)cpu->raw_stalls);
+  STORE(p->branch_stalls, (int64_t)cpu->branch_stalls);
+  STORE(p->hold_stalls, (int64_t)cpu->hold_stalls);
+  STORE(p->flushes, (int64_t)cpu->flushes);
+  STORE(p->updated_ms, unix_ms());
+  STORE(p->updates, p->updates + 1);
+  STORE(p->state, state);
+}
@@ -0,0 +1,68 @@
+#ifndef _APEX_TELEMETRY_H_
+#define _APEX_TELEMETRY_H_
+/**
+ *  telemetry.h
+ *  Contains the live telemetry page: a small memory-mapped file the
+ *  simulator updates every N cycles and apex_top reads while it runs
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdint.h>
+#include <time.h>
+
+#include "cpu.h"
+
+#define TELEMETRY_MAGIC 0x58455041	    // "APEX"
+#define TELEMETRY_VERSION 1
+
+/* State of the run */
+enum
+{
+  TELEMETRY_RUNNING,
+  TELEMETRY_DONE,		    // HALT retired
+  TELEMETRY_STOPPED		    // Cycle limit reached
+};
+
+/*
+ * Layout of the file. Every field is written and read with relaxed atomic
+ * stores and loads, so a reader may see fields of two neighbouring updates
+ * but never a torn value.
+ */
+typedef struct APEX_Telemetry_Page
+{
+  uint32_t magic;
+  uint32_t version;
+  int32_t pid;
+  int32_t state;
+  int64_t started;		    // Unix time the run started
+  int64_t updated_ms;		    // Unix time of the last update, in ms
+  int64_t updates;
+  int64_t cycle;
+  int64_t retired;
+  int64_t pc;
+  int64_t raw_stalls;
+  int64_t branch_stalls;
+  int64_t hold_stalls;
+  int64_t flushes;
+  int64_t cycles_per_sec;	    // Over the last interval
+  char program[128];
+} APEX_Telemetry_Page;
+
+typedef struct APEX_Telemetry
+{
+  APEX_Telemetry_Page* page;
+  int interval;			    // Cycles between updates
+  int next;			    // Clock of the next update
+  int last_clock;
+  struct timespec last_time;
+} APEX_Telemetry;
+
+APEX_Telemetry* telemetry_create(const char* filename, int interval, const char* program);
+
+void telemetry_free(APEX_Telemetry* telemetry);
+
+void telemetry_update(APEX_CPU* cpu, int state);
+
+#endif
@@ -0,0 +1,177 @@
+/*
+ *  top.c
+ *  Contains apex_top, the viewer of live telemetry pages written with
+ *  --telemetry. Each page is mapped read only and its fields read with
+ *  relaxed atomic loads, so watching a run never slows it down. A running
+ *  page whose process is gone is shown as killed, one that has not been
+ *  updated for a while as stale.
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "telemetry.h"
+
+#define LOAD(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+#define MAX_PAGES 64
+
+typedef struct Top_Page
+{
+  const char* filename;
+  const APEX_Telemetry_Page* page;  // NULL until the file holds a page
+  ino_t inode;			    // Of the mapped file
+} Top_Page;
+
+static int64_t unix_ms(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static const APEX_Telemetry_Page* map_page(const char* filename, ino_t* inode)
+{
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  /* Without the inode a new run in the file would go unnoticed */
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return NULL;
+  }
+  void* page = mmap(NULL, sizeof(APEX_Telemetry_Page), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (page == MAP_FAILED) {
+    return NULL;
+  }
+  const APEX_Telemetry_Page* p = page;
+  if (st.st_size < (off_t)sizeof(APEX_Telemetry_Page) || __atomic_load_n(&p->magic, __ATOMIC_ACQUIRE) != TELEMETRY_MAGIC ||
+      p->version != TELEMETRY_VERSION) {
+    munmap(page, sizeof(APEX_Telemetry_Page));
+    return NULL;
+  }
+  *inode = st.st_ino;
+  return p;
+}
+
+static const char* state_name(const APEX_Telemetry_Page* p, int64_t age_ms, int stale_ms)
+{
+  switch (LOAD(p->state)) {
+    case TELEMETRY_DONE:
+      return "done";
+    case TELEMETRY_STOPPED:
+      return "stopped";
+  }
+  if (kill(p->pid, 0) != 0 && errno == ESRCH) {
+    return "killed";
+  }
+  return age_ms > stale_ms ? "stale" : "running";
+}
+
+/*
+ * Prints one line per page. Returns the number of runs still going.
+ */
+static int print_pages(Top_Page* pages, int count, int stale_ms)
+{
+  int running = 0;
+  int64_t now = unix_ms();
+  printf("%-24s %-7s %-8s %-12s %-12s %-6s %-6s %-10s %-10s %-10s %-9s %-9s %s\n", "program", "pid", "state", "cycle", "retired",
+         "IPC", "PC", "raw", "branch", "hold", "flushes", "Mcyc/s", "age");
+  for (int i = 0; i < count; ++i) {
+    /* A new run replaces the file of an ended one */
+    struct stat st;
+    if (pages[i].page && LOAD(pages[i].page->state) != TELEMETRY_RUNNING && stat(pages[i].filename, &st) == 0 &&
+        st.st_ino != pages[i].inode) {
+      munmap((void*)pages[i].page, sizeof(APEX_Telemetry_Page));
+      pages[i].page = NULL;
+    }
+    if (!pages[i].page) {
+      pages[i].page = map_page(pages[i].filename, &pages[i].inode);
+    }
+    const APEX_Telemetry_Page* p = pages[i].page;
+    if (!p) {
+      printf("%-24.24s (no telemetry page yet)\n", pages[i].filename);
+      running++;
+      continue;
+    }
+    int64_t cycle = LOAD(p->cycle), retired = LOAD(p->retired);
+    int64_t age = now - LOAD(p->updated_ms);
+    const char* state = state_name(p, age, stale_ms);
+    running += strcmp(state, "running") == 0 || strcmp(state, "stale") == 0;
+    printf("%-24.24s %-7d %-8s %-12lld %-12lld %-6.3f %-6lld %-10lld %-10lld %-10lld %-9lld %-9.2f %.1fs\n", p->program, p->pid, state,
+           (long long)cycle, (long long)retired, cycle > 0 ? (double)retired / cycle : 0.0, (long long)LOAD(p->pc),
+           (long long)LOAD(p->raw_stalls), (long long)LOAD(p->branch_stalls), (long long)LOAD(p->hold_stalls),
+           (long long)LOAD(p->flushes), LOAD(p->cycles_per_sec) / 1e6, age / 1000.0);
+  }
+  return running;
+}
+
+static void usage(const char* name)
+{
+  fprintf(stderr, "APEX_Help : Usage %s <telemetry_file> [telemetry_file ...] [options]\n", name);
+  fprintf(stderr, "APEX_Help :   --once                 print once and exit\n");
+  fprintf(stderr, "APEX_Help :   --refresh=S            seconds between refreshes (default 1)\n");
+  fprintf(stderr, "APEX_Help :   --stale=S              a run not updated for S seconds is stale (default 10)\n");
+}
+
+int main(int argc, char const* argv[])
+{
+  Top_Page pages[MAX_PAGES];
+  int count = 0, once = 0;
+  double refresh = 1, stale = 10;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--once") == 0) {
+      once = 1;
+    }
+    else if (strncmp(argv[i], "--refresh=", 10) == 0 && atof(argv[i] + 10) > 0) {
+      refresh = atof(argv[i] + 10);
+    }
+    else if (strncmp(argv[i], "--stale=", 8) == 0 && atof(argv[i] + 8) > 0) {
+      stale = atof(argv[i] + 8);
+    }
+    else if (strncmp(argv[i], "--", 2) != 0 && count < MAX_PAGES) {
+      pages[count].filename = argv[i];
+      pages[count].page = NULL;
+      count++;
+    }
+    else {
+      fprintf(stderr, "APEX_Error : Invalid option %s\n", argv[i]);
+      usage(argv[0]);
+      exit(1);
+    }
+  }
+  if (count == 0) {
+    usage(argv[0]);
+    exit(1);
+  }
+
+  if (once) {
+    print_pages(pages, count, stale * 1000);
+    return 0;
+  }
+
+  /* Refresh until every run has ended */
+  for (;;) {
+    printf("\033[H\033[2J");
+    int running = print_pages(pages, count, stale * 1000);
+    fflush(stdout);
+    if (running == 0) {
+      break;
+    }
+    struct timespec pause = { (time_t)refresh, (long)((refresh - (time_t)refresh) * 1e9) };
+    nanosleep(&pause, NULL);
+  }
+  return 0;
+}
@@ -0,0 +1,514 @@
+/*
+ *  trace.c
+ *  Contains the commit trace recorder and the trace-driven timing model.
+ *
+ *  The recorder runs the program on the functional model and writes every
+ *  committed instruction to a binary trace. The replay model reproduces the
+ *  cycle behaviour of cpu.c for the configured pipeline shape (latches, DRF
+ *  stalls, EX1 latencies, forwarding, branch stall and flush, HALT drain)
+ *  on numeric latches only: no register values are computed,
+ *  and branches resolve from the recorded outcomes. Wrong-path fetch still
+ *  reads the static code memory, which is why replay is given the program.
+ *  Replay models the base pipeline; the load/store queue is not modelled.
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "functional.h"
+#include "trace.h"
+
+/*
+ * Writes the committed instruction stream of the program to filename.
+ */
+int APEX_trace_record(APEX_CPU* cpu, const char* filename, int max_instructions)
+{
+  FILE* fp = fopen(filename, "wb");
+  if (!fp) {
+    fprintf(stderr, "APEX_Error : Unable to open trace file %s\n", filename);
+    return -1;
+  }
+  APEX_Func_State* st = malloc(sizeof(*st));
+  if (!st) {
+    fclose(fp);
+    return -1;
+  }
+
+  APEX_Trace_Header header;
+  memset(&header, 0, sizeof(header));
+  header.magic = APEX_TRACE_MAGIC;
+  header.version = APEX_TRACE_VERSION;
+  header.code_memory_size = cpu->code_memory_size;
+  fwrite(&header, sizeof(header), 1, fp);
+
+  APEX_func_init(st, cpu);
+  while (header.count < (uint32_t)max_instructions) {
+    int pc = st->pc;
+    if (!APEX_func_step(st, cpu)) {
+      break;
+    }
+    APEX_Instruction* ins = &cpu->code_memory[get_code_index(pc)];
+    APEX_Trace_Record rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.pc = pc;
+    rec.opcode = get_opcode_id(ins->opcode);
+    rec.rd = ins->rd;
+    rec.rs1 = ins->rs1;
+    rec.rs2 = ins->rs2;
+    rec.rs3 = ins->rs3;
+    if (rec.opcode == OP_BZ || rec.opcode == OP_BNZ || rec.opcode == OP_JUMP || rec.opcode == OP_LOOP) {
+      rec.taken = st->branch_taken || rec.opcode == OP_JUMP;
+      rec.address = st->pc;
+    }
+    else {
+      rec.address = st->mem_address;
+    }
+    fwrite(&rec, sizeof(rec), 1, fp);
+    header.count++;
+  }
+  free(st);
+
+  rewind(fp);
+  fwrite(&header, sizeof(header), 1, fp);
+  fclose(fp);
+  printf("APEX_Trace : Recorded %u instructions to %s\n", header.count, filename);
+  return 0;
+}
+
+/* Latch of the replay model */
+typedef struct Replay_Stage
+{
+  int pc;
+  int opcode;
+  int rd;
+  int rs1;
+  int rs2;
+  int rs3;
+  int busy;
+  int stalled;
+  int elapsed;
+  int seq;
+} Replay_Stage;
+
+/* State of the replay model */
+typedef struct Replay_CPU
+{
+  Replay_Stage stage[MAX_STAGES];
+  Replay_Stage* code;		// Pre-decoded static code memory
+  int code_size;
+  int code_memory_size;
+  int pc;
+  int regs_valid[32];
+  int reg_seq[32];		// Youngest writer of each register past EX1
+  int fetch_seq;
+  int branchTaken;
+  int branchEncountered;
+  int flag_seq;			// Youngest zero flag producer past EX1
+  int haltEncountered;
+  int stall_stage;
+  int ins_completed;
+  int ins_retired;
+  int halt_retired;		// A HALT has reached writeback
+  int clock;
+  const APEX_CPU* cfg;		// Pipeline layout, latencies and forwarding
+  APEX_Trace_Record* trace;	// Committed instruction stream
+  int trace_count;
+  int next_branch;		// Next trace record to search for a branch
+} Replay_CPU;
+
+static const Replay_Stage replay_nop;
+
+static int is_branch(int opcode)
+{
+  return opcode == OP_BZ || opcode == OP_BNZ || opcode == OP_JUMP || opcode == OP_LOOP;
+}
+
+/* LOOP is a branch that also writes its count register */
+static int writes_register(int opcode)
+{
+  return opcode == OP_LOOP || (opcode != OP_NOP && opcode != OP_STORE && opcode != OP_STR && opcode != OP_VSTORE && !is_branch(opcode) && opcode != OP_HALT);
+}
+
+static int sets_flag(int opcode)
+{
+  return opcode == OP_ADD || opcode == OP_ADDL || opcode == OP_SUB || opcode == OP_SUBL || opcode == OP_MUL;
+}
+
+static int replay_flag_pending(Replay_CPU* r)
+{
+  for (int i = EX1 + 1; i <= EX1 + r->cfg->branch_stall && i < r->cfg->num_stages; ++i) {
+    if (r->stage[i].seq == r->flag_seq && sets_flag(r->stage[i].opcode)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int replay_should_stall(Replay_CPU* r)
+{
+  Replay_Stage* s = &r->stage[DRF];
+  switch (s->opcode) {
+    case OP_STR:
+      return !(r->regs_valid[s->rs1] && r->regs_valid[s->rs2] && r->regs_valid[s->rs3]);
+    case OP_ADDL:
+    case OP_SUBL:
+    case OP_LOAD:
+    case OP_JUMP:
+    case OP_LOOP:
+    case OP_VLOAD:
+      return !r->regs_valid[s->rs1];
+    case OP_MOVC:
+    case OP_BZ:
+    case OP_BNZ:
+    case OP_HALT:
+      return 0;
+    default:
+      return !(r->regs_valid[s->rs1] && r->regs_valid[s->rs2]);
+  }
+}
+
+/*
+ * Finds the recorded outcome of the next committed branch.
+ */
+static APEX_Trace_Record* replay_next_branch(Replay_CPU* r)
+{
+  while (r->next_branch < r->trace_count) {
+    APEX_Trace_Record* rec = &r->trace[r->next_branch++];
+    if (is_branch(rec->opcode)) {
+      return rec;
+    }
+  }
+  return NULL;
+}
+
+static int owns_register(Replay_CPU* r, Replay_Stage* s)
+{
+  return writes_register(s->opcode) && r->reg_seq[s->rd] == s->seq;
+}
+
+static int replay_forwards_in(Replay_CPU* r, Replay_Stage* s, int index)
+{
+  return r->cfg->forward[index] && !(index < r->cfg->mem1 && (s->opcode == OP_LOAD || s->opcode == OP_LDR || s->opcode == OP_VLOAD));
+}
+
+static void replay_forward(Replay_CPU* r, Replay_Stage* s, int index)
+{
+  if (replay_forwards_in(r, s, index) && owns_register(r, s)) {
+    r->regs_valid[s->rd] = 1;
+  }
+}
+
+/*
+ * Gives the registers written by the instructions a taken branch squashes
+ * after EX1, and the zero flag producer, back to the youngest older one in
+ * flight.
+ */
+static void replay_restore_scoreboard(Replay_CPU* r)
+{
+  const APEX_CPU* cfg = r->cfg;
+  int squashed[32] = {0};
+  int flag = 0;
+  for (int i = EX1 + 1; i < cfg->branch_stage; ++i) {
+    if (writes_register(r->stage[i].opcode)) {
+      squashed[r->stage[i].rd] = 1;
+    }
+    flag |= sets_flag(r->stage[i].opcode);
+  }
+  if (flag) {
+    r->flag_seq = 0;
+  }
+  for (int i = 0; i < 32; ++i) {
+    if (squashed[i]) {
+      r->reg_seq[i] = 0;
+      r->regs_valid[i] = 1;
+    }
+  }
+  for (int i = cfg->wb; i > cfg->branch_stage + 1; --i) {
+    Replay_Stage* s = &r->stage[i];
+    if (flag && sets_flag(s->opcode)) {
+      r->flag_seq = s->seq;
+    }
+    if (!writes_register(s->opcode) || !squashed[s->rd]) {
+      continue;
+    }
+    int forwarded = 0;
+    for (int k = EX1; k < i; ++k) {
+      forwarded |= replay_forwards_in(r, s, k);
+    }
+    r->reg_seq[s->rd] = s->seq;
+    r->regs_valid[s->rd] = forwarded;
+  }
+}
+
+static void replay_resolve_branch(Replay_CPU* r, Replay_Stage* s)
+{
+  if (!is_branch(s->opcode)) {
+    return;
+  }
+  APEX_Trace_Record* rec = replay_next_branch(r);
+  if (rec && rec->taken) {
+    r->pc = rec->address;
+    r->ins_completed = get_code_index(r->pc) - (s->opcode == OP_JUMP ? 3 : 0);
+    r->branchTaken = 1;
+    if (r->cfg->branch_stage > EX1) {
+      replay_restore_scoreboard(r);
+    }
+  }
+}
+
+static void replay_decode(Replay_CPU* r)
+{
+  const APEX_CPU* cfg = r->cfg;
+  Replay_Stage* s = &r->stage[DRF];
+  if (r->stall_stage > DRF || s->busy || s->stalled) {
+    return;
+  }
+  if (r->branchTaken) {
+    r->stage[EX1] = replay_nop;
+    return;
+  }
+  if (s->opcode == OP_BZ || s->opcode == OP_BNZ) {
+    if (cfg->branch_stage != DRF && replay_flag_pending(r)) {
+      r->branchEncountered = 1;
+      r->stage[EX1] = replay_nop;
+      return;
+    }
+  }
+  else if (s->opcode == OP_HALT) {
+    for (int i = EX1; i <= cfg->branch_stage; ++i) {
+      if (is_branch(r->stage[i].opcode)) {
+        r->branchEncountered = 1;
+        r->stage[EX1] = replay_nop;
+        return;
+      }
+    }
+    r->haltEncountered = 1;
+    r->stage[EX1] = r->stage[DRF];
+    return;
+  }
+  if (replay_should_stall(r)) {
+    r->stage[DRF].stalled = 1;
+    r->stage[EX1] = replay_nop;
+  }
+  else {
+    if (cfg->branch_stage == DRF) {
+      replay_resolve_branch(r, s);
+    }
+    r->stage[EX1] = r->stage[DRF];
+  }
+  r->branchEncountered = 0;
+}
+
+static void replay_fetch(Replay_CPU* r)
+{
+  Replay_Stage* s = &r->stage[F];
+  if (r->stall_stage > F || s->busy || s->stalled) {
+    return;
+  }
+  if (r->branchTaken) {
+    r->stage[DRF] = replay_nop;
+    r->branchTaken = 0;
+    return;
+  }
+  if (r->haltEncountered) {
+    r->code_memory_size = get_code_index(r->pc);
+    r->stage[DRF] = r->stage[F];
+    return;
+  }
+  int index = get_code_index(r->pc);
+  if (index >= 0 && index < r->code_size) {
+    *s = r->code[index];
+  }
+  else {
+    *s = replay_nop;
+    s->opcode = OP_HALT;
+  }
+  s->pc = r->pc;
+  s->seq = ++r->fetch_seq;
+  if (!r->stage[DRF].stalled && !r->branchEncountered) {
+    r->pc += 4;
+    r->stage[DRF] = r->stage[F];
+  }
+}
+
+static void replay_cycle_stages(Replay_CPU* r)
+{
+  const APEX_CPU* cfg = r->cfg;
+  Replay_Stage* s;
+  r->stall_stage = 0;
+
+  /* Writeback */
+  s = &r->stage[cfg->wb];
+  if (!s->busy && !s->stalled && s->opcode != OP_NOP) {
+    if (owns_register(r, s)) {
+      r->regs_valid[s->rd] = 1;
+    }
+    if (!replay_should_stall(r)) {
+      r->stage[DRF].stalled = 0;
+    }
+    r->ins_completed++;
+    if (s->opcode != OP_HALT || !r->halt_retired) {
+      r->ins_retired++;
+    }
+    if (s->opcode == OP_HALT) {
+      r->ins_completed++;
+      r->halt_retired = 1;
+    }
+  }
+
+  /* Memory stages */
+  for (int i = cfg->wb - 1; i >= cfg->mem1; --i) {
+    s = &r->stage[i];
+    if (!s->busy && !s->stalled) {
+      replay_forward(r, s, i);
+    }
+    r->stage[i + 1] = *s;
+  }
+
+  /* Execute stages after EX1 */
+  for (int i = cfg->mem1 - 1; i > EX1; --i) {
+    s = &r->stage[i];
+    if (!s->busy && !s->stalled) {
+      if (r->branchTaken && i < cfg->branch_stage) {
+        r->stage[i + 1] = replay_nop;
+        continue;
+      }
+      replay_forward(r, s, i);
+      if (i == cfg->branch_stage) {
+        replay_resolve_branch(r, s);
+      }
+    }
+    r->stage[i + 1] = *s;
+  }
+
+  /* Execute1 */
+  s = &r->stage[EX1];
+  if (!s->busy && !s->stalled) {
+    if (r->branchTaken) {
+      r->stage[EX1 + 1] = replay_nop;
+      goto front;
+    }
+    if (s->elapsed + 1 < cfg->latency[s->opcode]) {
+      s->elapsed++;
+      r->stall_stage = EX1;
+      r->stage[EX1 + 1] = replay_nop;
+      goto front;
+    }
+    if (writes_register(s->opcode)) {
+      r->regs_valid[s->rd] = 0;
+      r->reg_seq[s->rd] = s->seq;
+    }
+    if (sets_flag(s->opcode)) {
+      r->flag_seq = s->seq;
+    }
+    replay_forward(r, s, EX1);
+    if (cfg->branch_stage == EX1) {
+      replay_resolve_branch(r, s);
+    }
+  }
+  r->stage[EX1 + 1] = *s;
+
+front:
+  replay_decode(r);
+  replay_fetch(r);
+}
+
+/*
+ *  Replays a recorded trace through the timing model and reports cycles.
+ */
+int APEX_trace_replay(APEX_CPU* cpu, const char* filename, int cycles)
+{
+  FILE* fp = fopen(filename, "rb");
+  if (!fp) {
+    fprintf(stderr, "APEX_Error : Unable to open trace file %s\n", filename);
+    return -1;
+  }
+  APEX_Trace_Header header;
+  if (fread(&header, sizeof(header), 1, fp) != 1 || header.magic != APEX_TRACE_MAGIC ||
+      header.version != APEX_TRACE_VERSION) {
+    fprintf(stderr, "APEX_Error : %s is not an APEX trace\n", filename);
+    fclose(fp);
+    return -1;
+  }
+  if (header.code_memory_size != (uint32_t)cpu->code_memory_size) {
+    fprintf(stderr, "APEX_Error : Trace was recorded from a different program\n");
+    fclose(fp);
+    return -1;
+  }
+
+  Replay_CPU* r = calloc(1, sizeof(*r));
+  if (!r) {
+    fclose(fp);
+    return -1;
+  }
+  r->trace = malloc(sizeof(APEX_Trace_Record) * (header.count ? header.count : 1));
+  r->code = calloc(cpu->code_memory_size, sizeof(Replay_Stage));
+  if (!r->trace || !r->code || fread(r->trace, sizeof(APEX_Trace_Record), header.count, fp) != header.count) {
+    fprintf(stderr, "APEX_Error : Trace %s is truncated\n", filename);
+    free(r->trace);
+    free(r->code);
+    free(r);
+    fclose(fp);
+    return -1;
+  }
+  fclose(fp);
+  r->trace_count = header.count;
+
+  /* Decode the static program once */
+  r->code_size = cpu->code_memory_size;
+  for (int i = 0; i < r->code_size; ++i) {
+    APEX_Instruction* ins = &cpu->code_memory[i];
+    r->code[i].opcode = get_opcode_id(ins->opcode);
+    r->code[i].rd = ins->rd;
+    r->code[i].rs1 = ins->rs1;
+    r->code[i].rs2 = ins->rs2;
+    r->code[i].rs3 = ins->rs3;
+  }
+
+  r->cfg = cpu;
+  r->pc = cpu->pc;
+  r->code_memory_size = cpu->code_memory_size;
+  for (int i = 0; i < 32; ++i) {
+    r->regs_valid[i] = 1;
+  }
+  for (int i = 1; i < MAX_STAGES; ++i) {
+    r->stage[i].busy = 1;
+  }
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  int elapsed = 0;
+  while (elapsed < cycles) {
+    if (r->clock >= cpu->num_stages) {
+      for (int i = 0; i < cpu->num_stages; ++i) {
+        r->stage[i].busy = 0;
+      }
+    }
+    replay_cycle_stages(r);
+    elapsed++;
+    if (r->ins_completed >= r->code_memory_size + cpu->num_stages - 2) {
+      break;
+    }
+    r->clock++;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+  printf("\n================Trace Replay=============\n");
+  printf("Trace records        : %d\n", r->trace_count);
+  printf("Cycles               : %d\n", elapsed);
+  printf("Instructions retired : %d\n", r->ins_retired);
+  printf("IPC                  : %.3f\n", elapsed ? (double)r->ins_retired / elapsed : 0.0);
+  printf("Replay time          : %.6f s\n", seconds);
+  printf("=========================================\n");
+
+  free(r->trace);
+  free(r->code);
+  free(r);
+  return elapsed;
+}
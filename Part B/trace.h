@@ -0,0 +1,44 @@
+#ifndef _APEX_TRACE_H_
+#define _APEX_TRACE_H_
+/**
+ *  trace.h
+ *  Contains the commit trace recorder and the trace-driven timing model
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdint.h>
+#include "cpu.h"
+
+#define APEX_TRACE_MAGIC 0x54585041	// "APXT"
+#define APEX_TRACE_VERSION 1
+
+/* Trace file header */
+typedef struct APEX_Trace_Header
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t code_memory_size;	// Program the trace was recorded from
+  uint32_t count;		// Number of records that follow
+} APEX_Trace_Header;
+
+/* One committed instruction, 16 bytes */
+typedef struct APEX_Trace_Record
+{
+  int32_t pc;			// Program Counter
+  uint8_t opcode;		// Numeric opcode
+  uint8_t rd;			// Destination Register Address
+  uint8_t rs1;			// Source-1 Register Address
+  uint8_t rs2;			// Source-2 Register Address
+  uint8_t rs3;			// Source-3 Register Address
+  uint8_t taken;		// Branch outcome for BZ/BNZ/JUMP
+  uint16_t reserved;
+  int32_t address;		// Memory address for loads/stores, target for branches
+} APEX_Trace_Record;
+
+int APEX_trace_record(APEX_CPU* cpu, const char* filename, int max_instructions);
+
+int APEX_trace_replay(APEX_CPU* cpu, const char* filename, int cycles);
+
+#endif
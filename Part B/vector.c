@@ -0,0 +1,174 @@
+/*
+ *  vector.c
+ *  Contains the vector unit. VADD, VSUB, VMUL, VAND and VOR work lane by
+ *  lane on VECTOR_LANES 32-bit integers, and wrap around on overflow. On
+ *  hosts with SSE2 or NEON one host instruction does all the lanes;
+ *  elsewhere a plain loop does.
+ *
+ *  VLOAD and VSTORE move VECTOR_LANES consecutive words of data memory
+ *  from the address up. A VLOAD reads each lane from the store buffer or
+ *  from memory, a lane outside data memory reads 0. A VSTORE goes into
+ *  the store buffer whole, so it waits in MEM1 until there is room for
+ *  all of its lanes; a buffer too small for them is drained first and
+ *  the VSTORE writes memory itself. Lanes outside data memory are not
+ *  written.
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#if defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "vector.h"
+#include "lsq.h"
+
+/*
+ * Returns true for the opcodes of the vector unit
+ */
+bool is_vector_opcode(int op)
+{
+  return op >= OP_VLOAD && op <= OP_VOR;
+}
+
+/*
+ * Returns true if the program has a vector instruction
+ */
+bool is_vector_program(const APEX_CPU* cpu)
+{
+  for (int i = 0; i < cpu->code_memory_size; ++i) {
+    if (is_vector_opcode(get_opcode_id(cpu->code_memory[i].opcode))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+#if defined(__SSE2__)
+static __m128i multiply(__m128i a, __m128i b)
+{
+#if defined(__SSE4_1__)
+  return _mm_mullo_epi32(a, b);
+#else
+  /* Low halves of the even and the odd lane products */
+  __m128i even = _mm_mul_epu32(a, b);
+  __m128i odd = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+  return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+#endif
+}
+#endif
+
+/*
+ * Computes the lanes of result from the lanes of a and b
+ */
+void vector_execute(int op, const int* a, const int* b, int* result)
+{
+#if defined(__SSE2__) && VECTOR_LANES == 4
+  __m128i x = _mm_loadu_si128((const __m128i*)a);
+  __m128i y = _mm_loadu_si128((const __m128i*)b);
+  __m128i r;
+  switch (op) {
+    case OP_VADD: r = _mm_add_epi32(x, y); break;
+    case OP_VSUB: r = _mm_sub_epi32(x, y); break;
+    case OP_VMUL: r = multiply(x, y); break;
+    case OP_VAND: r = _mm_and_si128(x, y); break;
+    case OP_VOR: r = _mm_or_si128(x, y); break;
+    default: return;
+  }
+  _mm_storeu_si128((__m128i*)result, r);
+#elif defined(__ARM_NEON) && VECTOR_LANES == 4
+  int32x4_t x = vld1q_s32(a);
+  int32x4_t y = vld1q_s32(b);
+  int32x4_t r;
+  switch (op) {
+    case OP_VADD: r = vaddq_s32(x, y); break;
+    case OP_VSUB: r = vsubq_s32(x, y); break;
+    case OP_VMUL: r = vmulq_s32(x, y); break;
+    case OP_VAND: r = vandq_s32(x, y); break;
+    case OP_VOR: r = vorrq_s32(x, y); break;
+    default: return;
+  }
+  vst1q_s32(result, r);
+#else
+  for (int i = 0; i < VECTOR_LANES; ++i) {
+    unsigned int x = a[i], y = b[i];
+    switch (op) {
+      case OP_VADD: result[i] = (int)(x + y); break;
+      case OP_VSUB: result[i] = (int)(x - y); break;
+      case OP_VMUL: result[i] = (int)(x * y); break;
+      case OP_VAND: result[i] = (int)(x & y); break;
+      case OP_VOR: result[i] = (int)(x | y); break;
+    }
+  }
+#endif
+}
+
+/*
+ * Reads the lanes of a VLOAD in MEM1
+ */
+void vector_load(APEX_CPU* cpu, int address, int* values)
+{
+  for (int i = 0; i < VECTOR_LANES; ++i) {
+    int lane = address + i;
+    if (cpu->lsq_size && lsq_forward(cpu, lane, &values[i])) {
+      continue;
+    }
+    values[i] = lane >= 0 && lane < 4096 ? cpu->data_memory[lane] : 0;
+  }
+}
+
+/*
+ * Writes the lanes of a VSTORE in MEM1. Returns false if the store
+ * buffer has no room for them.
+ */
+bool vector_store(APEX_CPU* cpu, int address, const int* values)
+{
+  if (cpu->lsq_size >= VECTOR_LANES) {
+    if (cpu->lsq_size - cpu->sb_count < VECTOR_LANES) {
+      cpu->lsq_full_stalls++;
+      return false;
+    }
+    for (int i = 0; i < VECTOR_LANES; ++i) {
+      lsq_store(cpu, address + i, values[i]);
+    }
+    return true;
+  }
+  /* Older buffered stores reach memory first, the one being written too */
+  if (cpu->sb_count || cpu->clock < cpu->sb_port_free) {
+    cpu->lsq_full_stalls++;
+    return false;
+  }
+  for (int i = 0; i < VECTOR_LANES; ++i) {
+    int lane = address + i;
+    if (lane >= 0 && lane < 4096) {
+      cpu->data_memory[lane] = values[i];
+    }
+  }
+  return true;
+}
+
+void vector_print(APEX_CPU* cpu)
+{
+  printf("================Vector unit=============\n");
+  printf("|\tVREG\t|\tLanes\n");
+  for (int v = 0; v < NUM_VREGS; ++v) {
+    printf("|\tV%d\t|\t", v);
+    for (int i = 0; i < VECTOR_LANES; ++i) {
+      printf("%d%s", cpu->vregs[v][i], i + 1 < VECTOR_LANES ? ", " : "\n");
+    }
+  }
+  printf("Vector operations    : %d\n", cpu->vector_ops);
+  printf("Vector loads         : %d\n", cpu->vector_loads);
+  printf("Vector stores        : %d\n", cpu->vector_stores);
+  printf("========================================\n");
+}
@@ -0,0 +1,27 @@
+#ifndef _APEX_VECTOR_H_
+#define _APEX_VECTOR_H_
+/**
+ *  vector.h
+ *  Contains the vector unit: packed VECTOR_LANES x 32-bit operations,
+ *  executed with the SIMD instructions of the host where it has them,
+ *  and the vector accesses of MEM1
+ *
+ *  Author :
+ *  Saurabh Korade (skorade1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include "cpu.h"
+
+bool is_vector_opcode(int op);
+
+bool is_vector_program(const APEX_CPU* cpu);
+
+void vector_execute(int op, const int* a, const int* b, int* result);
+
+void vector_load(APEX_CPU* cpu, int address, int* values);
+
+bool vector_store(APEX_CPU* cpu, int address, const int* values);
+
+void vector_print(APEX_CPU* cpu);
+
+#endif